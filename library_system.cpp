@@ -5,6 +5,34 @@
 #include <vector>
 #include <ctime>
 #include <limits>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <set>
+#include <tuple>
+#include <functional>
+#include <list>
+#include <type_traits>
+#include <deque>
+#include <queue>
+#include <array>
+#include <shared_mutex>
+#include <string_view>
+#include <cstdint>
+#include <csignal>
 using namespace std;
 
 // Forward declarations
@@ -12,233 +40,4126 @@ class Account;
 class Book;
 class User;
 
+// Book keys. A real ISBN (ISBN-10 or ISBN-13, hyphens and spaces allowed)
+// is validated and packed as its ISBN-13 number, so both forms of the same
+// book give the same key. Book IDs from before ISBN support ("1" to "10" in
+// the seed data) are migrated as legacy keys with the top bit set: digit
+// strings of up to 18 digits by value (behind a leading 1 and flagged when
+// they start with a zero, so "007" stays "007"), other IDs of up to 8
+// characters as 7-bit characters. Longer IDs cannot be keyed.
+// A legacy ID that would also read as an ISBN is written with a leading '#'
+// so that it keeps its key when it is read back.
+typedef unsigned long long IsbnKey;
+const IsbnKey INVALID_ISBN = 0;
+const IsbnKey LEGACY_ISBN = 1ULL << 63;
+const IsbnKey LEGACY_TEXT_ISBN = 1ULL << 62;
+const IsbnKey LEGACY_PADDED_ISBN = 1ULL << 61;
+const char LEGACY_MARK = '#';
+
+// The 13 ISBN-13 digits for a valid ISBN-10/13, or "" when raw is not one
+string normalizeIsbn(const string& raw) {
+    char digits[13];
+    size_t n = 0;
+    for (char c : raw) {
+        if (c == '-' || isspace(static_cast<unsigned char>(c))) continue;
+        if (n == 13) return "";
+        if (isdigit(static_cast<unsigned char>(c))) digits[n++] = c;
+        else if (c == 'X' || c == 'x') digits[n++] = 'X';
+        else return "";
+    }
+
+    if (n == 10) {
+        int sum = 0;
+        for (int i = 0; i < 10; i++) {
+            if (digits[i] == 'X' && i != 9) return "";
+            sum += (10 - i) * (digits[i] == 'X' ? 10 : digits[i] - '0');
+        }
+        if (sum % 11 != 0) return "";
+        string isbn = "978" + string(digits, 9);
+        sum = 0;
+        for (int i = 0; i < 12; i++) {
+            sum += (i % 2 ? 3 : 1) * (isbn[i] - '0');
+        }
+        return isbn + char('0' + (10 - sum % 10) % 10);
+    }
+
+    if (n == 13) {
+        if (digits[0] != '9' || digits[1] != '7' || (digits[2] != '8' && digits[2] != '9')) return "";
+        int sum = 0;
+        for (int i = 0; i < 13; i++) {
+            if (digits[i] == 'X') return "";
+            sum += (i % 2 ? 3 : 1) * (digits[i] - '0');
+        }
+        if (sum % 10 != 0) return "";
+        return string(digits, 13);
+    }
+    return "";
+}
+
+bool isValidIsbn(const string& raw) {
+    return !normalizeIsbn(raw).empty();
+}
+
+string trimIsbn(const string& id) {
+    size_t first = id.find_first_not_of(" \t\r\n");
+    if (first == string::npos) return "";
+    return id.substr(first, id.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+// Legacy key for a trimmed ID, INVALID_ISBN when it does not fit in one
+IsbnKey packLegacyId(const string& raw) {
+    if (raw.empty()) return INVALID_ISBN;
+    bool numeric = raw.size() <= 18;
+    for (char c : raw) {
+        if (!isdigit(static_cast<unsigned char>(c))) numeric = false;
+    }
+    if (numeric && (raw[0] != '0' || raw.size() == 1)) return LEGACY_ISBN | stoull(raw);
+    if (numeric) return LEGACY_ISBN | LEGACY_PADDED_ISBN | stoull("1" + raw);
+
+    if (raw.size() > 8) return INVALID_ISBN;
+    IsbnKey key = LEGACY_ISBN | LEGACY_TEXT_ISBN;
+    for (size_t i = 0; i < raw.size(); i++) {
+        unsigned char c = raw[i];
+        if (c <= ' ' || c >= 0x7F) return INVALID_ISBN;
+        key |= static_cast<IsbnKey>(c) << (7 * (7 - i));
+    }
+    return key;
+}
+
+// Key for a book ID typed in by a user, INVALID_ISBN when it is neither an
+// ISBN nor a legacy ID
+IsbnKey packIsbn(const string& id) {
+    string raw = trimIsbn(id);
+    if (!raw.empty() && raw[0] == LEGACY_MARK) return packLegacyId(raw.substr(1));
+    string isbn = normalizeIsbn(raw);
+    if (!isbn.empty()) return stoull(isbn);
+    return packLegacyId(raw);
+}
+
+// Key for a book ID read back from a data file, a checkpoint or the
+// operation log. Those hold IDs in canonical form, so only the 13 digits of
+// a valid ISBN-13 are an ISBN here. Anything else is a legacy ID, even a
+// 10-digit one that passes the ISBN-10 check: files from before ISBN
+// support hold legacy IDs only, and this is where they are migrated.
+IsbnKey packStoredIsbn(const string& id) {
+    string raw = trimIsbn(id);
+    if (!raw.empty() && raw[0] == LEGACY_MARK) return packLegacyId(raw.substr(1));
+    if (raw.size() == 13 && normalizeIsbn(raw) == raw) return stoull(raw);
+    return packLegacyId(raw);
+}
+
+string unpackIsbn(IsbnKey key) {
+    if (!(key & LEGACY_ISBN)) return to_string(key);
+    string id;
+    if (!(key & LEGACY_TEXT_ISBN)) {
+        id = to_string(key & ~(LEGACY_ISBN | LEGACY_PADDED_ISBN));
+        if (key & LEGACY_PADDED_ISBN) id.erase(0, 1);
+    } else {
+        for (int i = 0; i < 8; i++) {
+            char c = (key >> (7 * (7 - i))) & 0x7F;
+            if (c == 0) break;
+            id += c;
+        }
+    }
+    if (id[0] == LEGACY_MARK || isValidIsbn(id)) id.insert(id.begin(), LEGACY_MARK);
+    return id;
+}
+
+// The form a book ID is stored and logged in: ISBN-13 digits or the legacy ID
+string canonicalIsbn(const string& raw) {
+    IsbnKey key = packIsbn(raw);
+    return key == INVALID_ISBN ? raw : unpackIsbn(key);
+}
+
+// Canonical form of a book ID read back from a file, "" when it is unusable
+string canonicalStoredIsbn(const string& stored) {
+    IsbnKey key = packStoredIsbn(stored);
+    return key == INVALID_ISBN ? "" : unpackIsbn(key);
+}
+
+// The rest of the input line as canonical book IDs separated by whitespace
+vector<string> readIsbnList(istream& in) {
+    string line, isbn;
+    in >> ws;
+    getline(in, line);
+    istringstream fields(line);
+    vector<string> isbns;
+    while (fields >> isbn) isbns.push_back(canonicalIsbn(isbn));
+    return isbns;
+}
+
+// An ordered map split into sorted chunks that its copies share: a copy
+// (one per version) copies one pointer per chunk, and a write copies only
+// its own chunk, and only while another copy still shares it. Chunks split
+// at twice CHUNK entries, so a write copies a few hundred entries however
+// large the map.
+template <typename Key, typename Value>
+class SharedChunks {
+private:
+    static const size_t CHUNK = 256;
+    typedef vector<pair<Key, Value>> Chunk;
+    vector<shared_ptr<Chunk>> chunks;  // In key order, none empty
+    size_t count;
+
+    static bool keyBefore(const pair<Key, Value>& entry, const Key& key) { return entry.first < key; }
+
+    // The chunk key is in or belongs in (the first for keys before them all)
+    size_t chunkFor(const Key& key) const {
+        auto it = upper_bound(chunks.begin() + 1, chunks.end(), key,
+                              [](const Key& k, const shared_ptr<Chunk>& chunk) { return k < chunk->front().first; });
+        return it - chunks.begin() - 1;
+    }
+
+    Chunk& writable(size_t index) {
+        if (chunks[index].use_count() > 1) chunks[index] = make_shared<Chunk>(*chunks[index]);
+        return *chunks[index];
+    }
+
+public:
+    SharedChunks() : count(0) {}
+
+    const Value* find(const Key& key) const {
+        if (chunks.empty()) return nullptr;
+        const Chunk& chunk = *chunks[chunkFor(key)];
+        auto it = lower_bound(chunk.begin(), chunk.end(), key, keyBefore);
+        return it != chunk.end() && it->first == key ? &it->second : nullptr;
+    }
+
+    // For changing an entry in place; null if there is none
+    Value* findWritable(const Key& key) {
+        if (!find(key)) return nullptr;
+        Chunk& chunk = writable(chunkFor(key));
+        return &lower_bound(chunk.begin(), chunk.end(), key, keyBefore)->second;
+    }
+
+    Value& operator[](const Key& key) {
+        if (chunks.empty()) chunks.push_back(make_shared<Chunk>());
+        size_t index = chunkFor(key);
+        Chunk& chunk = writable(index);
+        auto it = lower_bound(chunk.begin(), chunk.end(), key, keyBefore);
+        if (it != chunk.end() && it->first == key) return it->second;
+        size_t position = it - chunk.begin();
+        chunk.insert(it, {key, Value()});
+        count++;
+        if (chunk.size() < 2 * CHUNK) return chunk[position].second;
+        auto upper = make_shared<Chunk>(make_move_iterator(chunk.begin() + CHUNK), make_move_iterator(chunk.end()));
+        chunk.resize(CHUNK);
+        chunks.insert(chunks.begin() + index + 1, upper);
+        return position < CHUNK ? chunk[position].second : (*upper)[position - CHUNK].second;
+    }
+
+    void erase(const Key& key) {
+        if (!find(key)) return;
+        size_t index = chunkFor(key);
+        Chunk& chunk = writable(index);
+        chunk.erase(lower_bound(chunk.begin(), chunk.end(), key, keyBefore));
+        count--;
+        if (chunk.empty()) chunks.erase(chunks.begin() + index);
+    }
+
+    // Adds an entry after every key already in the map
+    void append(const Key& key, Value value) {
+        if (chunks.empty() || chunks.back()->size() >= CHUNK) chunks.push_back(make_shared<Chunk>());
+        writable(chunks.size() - 1).push_back({key, move(value)});
+        count++;
+    }
+
+    size_t size() const { return count; }
+
+    void clear() {
+        chunks.clear();
+        count = 0;
+    }
+
+    // In key order
+    template <typename Visit>
+    void forEach(Visit visit) const {
+        for (const auto& chunk : chunks) {
+            for (const auto& entry : *chunk) visit(entry.first, entry.second);
+        }
+    }
+};
+
 // Global variables (encapsulated in a Library class later)
 map<string, Account> accounts;  // Changed from int to string
-map<string, Book> books;
 map<string, User*> users;  // Changed from int to string
+unsigned long long usersRevision = 0;  // Bumped whenever a User is created or deleted
 int simulatedDate = 0;  // Global variable to track simulated date in seconds
 
+class BookStorage;
+extern unique_ptr<class BookStorage> books;  // Defined with the storage engines
+
+// Accounts as a version holds them: copies shared between versions until
+// the live account changes (see VersionStore::commit)
+typedef SharedChunks<string, shared_ptr<const Account>> AccountSnapshot;
+
+// The accounts changed or removed since the last commit, so that a commit
+// copies only those. Bulk loads and clears set allAccountsChanged instead,
+// and the next commit takes every account again.
+unordered_set<string> changedAccounts;
+mutex changedAccountsMutex;  // Repairs change accounts from several threads
+atomic<bool> allAccountsChanged(true);
+
+void markAccountChanged(const string& userId) {
+    if (allAccountsChanged) return;
+    lock_guard<mutex> lock(changedAccountsMutex);
+    changedAccounts.insert(userId);
+}
+
 // Forward declarations of file operations
 void saveAccounts();
 void loadAccounts();
 void saveBooks();
 void loadBooks();
+void saveUsers();
 void loadUsers();
+void saveLedger();
+void loadLedger();
+void loadCirculation();
+void seedCirculation();
+void writeAccounts(ostream &out);
+void readAccounts(istream &in);
+void writeBooks(ostream &out);
+void readBooks(istream &in);
+void writeUsers(ostream &out);
+void readUsers(istream &in);
+void writeAccounts(ostream &out, const AccountSnapshot& source);
+void writeAccountsCompact(ostream &out, const AccountSnapshot& source);
+void writeBooks(ostream &out, const BookStorage& source);
+void saveBooks(const BookStorage& source);
+void clearAllData();
+void rebuildRecommendations();
+void rebuildFuzzyIndex();
+void ensureFuzzyIndex();
+void rebuildDueIndex();
 int getCurrentDate();  // Forward declaration of getCurrentDate
+vector<string> splitFields(const string& line);
 
-class Book {
-private:
-    string isbn, title, author, publisher;
-    int year;
-    bool available, reserved;
+// Compact binary encoding helpers (accounts.dat). Unsigned LEB128 varints,
+// with zigzag mapping for signed deltas so small negatives stay short.
+void writeVarint(ostream &out, unsigned long long value) {
+    while (value >= 0x80) {
+        out.put(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.put(static_cast<char>(value));
+}
+
+unsigned long long readVarint(istream &in) {
+    unsigned long long value = 0;
+    int shift = 0;
+    streambuf* buf = in.rdbuf();
+    while (shift < 64) {
+        int c = buf->sbumpc();
+        if (c == EOF) {
+            in.setstate(ios::failbit);
+            return 0;
+        }
+        value |= static_cast<unsigned long long>(c & 0x7F) << shift;
+        if (!(c & 0x80)) break;
+        shift += 7;
+    }
+    return value;
+}
+
+void writeSignedVarint(ostream &out, long long value) {
+    writeVarint(out, (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63));
+}
+
+long long readSignedVarint(istream &in) {
+    unsigned long long value = readVarint(in);
+    return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+}
 
+void writeCompactString(ostream &out, const string& text) {
+    writeVarint(out, text.size());
+    out.write(text.data(), text.size());
+}
+
+string readCompactString(istream &in) {
+    string text(readVarint(in), '\0');
+    in.read(&text[0], text.size());
+    return text;
+}
+
+bool compactStorage = false;  // Save accounts as accounts.dat instead of accounts.txt
+bool compressedStorage = false;  // Save books and accounts as block-compressed .lmz files
+
+// Block compression for snapshot files. Text is cut into BLOCK_SIZE blocks
+// and each block is compressed on its own, so blocks can be compressed and
+// decompressed in parallel and a reader can start at any block. A
+// compressed block is a series of sequences: a token byte (literal count in
+// the high four bits, match length minus MIN_MATCH in the low four, 15
+// meaning length bytes follow that each add up to 255), the literals, and a
+// two-byte little-endian distance back to the match. The last sequence has
+// literals only.
+class BlockCodec {
 public:
-    Book(string t = "", string a = "", string p = "", int y = 0, string i = "", bool avail = true) 
-        : title(t), author(a), publisher(p), year(y), isbn(i), available(avail), reserved(false) {}
+    static const size_t BLOCK_SIZE = 64 * 1024;
+    enum Method { STORED = 0, LZ = 1 };  // A block that does not shrink is stored
 
-    string getISBN() const { return isbn; }
-    string getTitle() const { return title; }
-    string getAuthor() const { return author; }
-    string getPublisher() const { return publisher; }
-    int getYear() const { return year; }
-    bool isAvailable() const { return available; }
-    bool isReserved() const { return reserved; }
-    
-    void setISBN(const string& i) { isbn = i; }
-    void setTitle(const string& t) { title = t; }
-    void setAuthor(const string& a) { author = a; }
-    void setPublisher(const string& p) { publisher = p; }
-    void setYear(int y) { year = y; }
-    void setAvailability(bool status) { available = status; }
-    void setReserved(bool status) { reserved = status; }
+private:
+    static const size_t MIN_MATCH = 4;
+    static const int HASH_BITS = 14;
 
-    void displayISBN() const { cout << "ISBN: " << isbn << "\n"; }
-    void displayTitle() const { cout << "Title: " << title << "\n"; }
-    void displayAuthor() const { cout << "Author: " << author << "\n"; }
-    void displayPublisher() const { cout << "Publisher: " << publisher << "\n"; }
-    void displayYear() const { cout << "Year: " << year << "\n"; }
-    void displayStatus() const { 
-        cout << "Status: " << (available ? "Available" : "Borrowed")
-             << " | " << (reserved ? "Reserved" : "Not Reserved") << "\n"; 
+    static void putLength(string& out, size_t length) {
+        while (length >= 255) {
+            out += static_cast<char>(255);
+            length -= 255;
+        }
+        out += static_cast<char>(length);
     }
 
-    void display() const {
-        cout << "ISBN: " << isbn << "\nTitle: " << title << "\nAuthor: " << author 
-             << "\nPublisher: " << publisher << "\nYear: " << year
-             << "\nStatus: " << (available ? "Available" : "Borrowed")
-             << " | " << (reserved ? "Reserved" : "Not Reserved") << "\n";
+    static void putSequence(string& out, const char* literals, size_t count, size_t matchLength, size_t distance) {
+        size_t extra = matchLength ? matchLength - MIN_MATCH : 0;
+        out += static_cast<char>((min<size_t>(count, 15) << 4) | min<size_t>(extra, 15));
+        if (count >= 15) putLength(out, count - 15);
+        out.append(literals, count);
+        if (!matchLength) return;
+        out += static_cast<char>(distance & 0xFF);
+        out += static_cast<char>(distance >> 8);
+        if (extra >= 15) putLength(out, extra - 15);
     }
 
-    void saveToFile(ofstream &outfile) const {
-        outfile << isbn << "\n" << title << "\n" << author << "\n" 
-                << publisher << "\n" << year << "\n" << available << " " << reserved << "\n";
+public:
+    // FNV-1a over a block's raw bytes, kept in the index to catch damage
+    static uint32_t checksum(const char* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 16777619u;
+        }
+        return hash;
     }
-    
-    void loadFromFile(ifstream &infile) {
-        getline(infile, isbn);
-        getline(infile, title);
-        getline(infile, author);
-        getline(infile, publisher);
-        infile >> year;
-        infile >> available >> reserved;
-        infile.ignore();
+
+    // Matches are found through a hash of the next four bytes; distances fit
+    // in two bytes because a block is at most 64 KB
+    static string compress(const char* data, size_t size) {
+        string out;
+        out.reserve(size / 2 + 16);
+        vector<uint32_t> table(size_t(1) << HASH_BITS, UINT32_MAX);
+        size_t anchor = 0, pos = 0;
+        while (pos + MIN_MATCH <= size) {
+            uint32_t next;
+            memcpy(&next, data + pos, MIN_MATCH);
+            uint32_t& slot = table[(next * 2654435761u) >> (32 - HASH_BITS)];
+            size_t candidate = slot;
+            slot = pos;
+            if (candidate == UINT32_MAX || pos - candidate > 0xFFFF || memcmp(data + candidate, data + pos, MIN_MATCH) != 0) {
+                pos++;
+                continue;
+            }
+            size_t length = MIN_MATCH;
+            while (pos + length < size && data[candidate + length] == data[pos + length]) length++;
+            putSequence(out, data + anchor, pos - anchor, length, pos - candidate);
+            pos += length;
+            anchor = pos;
+        }
+        putSequence(out, data + anchor, size - anchor, 0, 0);
+        return out;
     }
-};
 
-class Account {
-private:
-    friend class User;  // Allow User class to access private members
-    string userID;
-    map<string, int> borrowedBooks;  // ISBN -> due date in seconds
-    map<string, int> lastFinePaidTime;  // ISBN -> last fine paid time in seconds
-    mutable map<string, double> bookFines;  // ISBN -> current fine amount
-    mutable double totalFine;
-    bool isFaculty;
-    int maxBooks;
-    int maxDays;
-    vector<pair<string, int>> borrowingHistory;
+    // False if the block is damaged; out must have room for rawSize bytes
+    static bool decompress(const char* data, size_t size, char* out, size_t rawSize) {
+        const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+        const unsigned char* end = in + size;
+        size_t written = 0;
+        auto readLength = [&](size_t& length) {
+            unsigned char byte;
+            do {
+                if (in == end) return false;
+                byte = *in++;
+                length += byte;
+            } while (byte == 255);
+            return true;
+        };
+        while (in < end) {
+            unsigned token = *in++;
+            size_t literals = token >> 4;
+            if (literals == 15 && !readLength(literals)) return false;
+            if (size_t(end - in) < literals || rawSize - written < literals) return false;
+            memcpy(out + written, in, literals);
+            in += literals;
+            written += literals;
+            if (in == end) break;
 
-public:
-    Account(string id = "", bool faculty = false) 
-        : userID(id), totalFine(0), isFaculty(faculty), 
-          maxBooks(faculty ? 5 : 3),  // Faculty can borrow 5 books, students 3
-          maxDays(faculty ? 30 : 15) {}  // Faculty gets 30 days, students 15
+            if (end - in < 2) return false;
+            size_t distance = in[0] | (in[1] << 8);
+            in += 2;
+            size_t length = token & 15;
+            if (length == 15 && !readLength(length)) return false;
+            length += MIN_MATCH;
+            if (distance == 0 || distance > written || rawSize - written < length) return false;
+            if (distance >= length) {
+                memcpy(out + written, out + written - distance, length);
+                written += length;
+            } else {
+                for (size_t i = 0; i < length; i++, written++) {
+                    out[written] = out[written - distance];  // Byte by byte: the match overlaps itself
+                }
+            }
+        }
+        return written == rawSize;
+    }
+};
 
-    string getUserID() const { return userID; }
-    double getTotalFine() const { return totalFine; }
-    map<string, int>& getBorrowedBooks() { return borrowedBooks; }
-    int getMaxBooks() const { return maxBooks; }
-    int getMaxDays() const { return maxDays; }
-    bool isFacultyMember() const { return isFaculty; }
-    const vector<pair<string, int>>& getBorrowingHistory() const { return borrowingHistory; }
+// .lmz layout: magic "LMSZ" and a version byte, the blocks, then the block
+// index (varint block count, then per block varint raw size, varint stored
+// size, a method byte and a 4-byte checksum of the raw bytes), and last the 8-byte little-endian offset of the
+// index followed by "LMSZ" again. The index is at the end so a file can be
+// written in one pass; blocks are located from it by adding up sizes.
+static const char SNAPSHOT_MAGIC[4] = {'L', 'M', 'S', 'Z'};
+static const size_t SNAPSHOT_HEADER = 5;
+static const size_t SNAPSHOT_FOOTER = 12;
 
-    double getBookFine(const string& isbn) const {
-        auto it = bookFines.find(isbn);
-        return (it != bookFines.end()) ? it->second : 0.0;
+// Compresses what is written to it into a .lmz file. Full blocks are kept
+// until there is one for every core, then compressed in parallel and
+// written in order. The file is written as path.tmp and renamed on close().
+class BlockCompressedWriter : public streambuf {
+private:
+    string path;
+    ofstream file;
+    string block;
+    vector<string> batch;
+    size_t batchLimit;
+    ostringstream index;
+    size_t blockCount;
+    bool failed;
+
+    void endBlock() {
+        block.resize(pptr() - pbase());
+        if (!block.empty()) batch.push_back(move(block));
+        block.assign(BlockCodec::BLOCK_SIZE, '\0');
+        setp(&block[0], &block[0] + block.size());
+        if (batch.size() >= batchLimit) writeBatch();
     }
 
-    bool payBookFine(const string& isbn, double amount, int currentDate) {
-        // Recalculate fines before payment
-        updateFines(currentDate);
-        
-        if (!isFaculty) {  // Faculty members don't pay fines
-            auto it = bookFines.find(isbn);
-            if (it == bookFines.end() || amount != it->second) {
-                cout << "\nPayment REJECTED!\n";
-                cout << "Please pay the exact fine amount for this book: " << it->second << " rupees\n";
-                return false;
+    void writeBatch() {
+        vector<string> compressed(batch.size());
+        vector<uint32_t> checksums(batch.size());
+        auto encode = [&](size_t i) {
+            compressed[i] = BlockCodec::compress(batch[i].data(), batch[i].size());
+            checksums[i] = BlockCodec::checksum(batch[i].data(), batch[i].size());
+        };
+        if (batch.size() == 1) {
+            encode(0);
+        } else {
+            vector<thread> threads;
+            for (size_t i = 0; i < batch.size(); i++) {
+                threads.emplace_back(encode, i);
+            }
+            for (auto& t : threads) {
+                t.join();
             }
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            bool stored = compressed[i].size() >= batch[i].size();
+            const string& data = stored ? batch[i] : compressed[i];
+            file.write(data.data(), data.size());
+            writeVarint(index, batch[i].size());
+            writeVarint(index, data.size());
+            index.put(stored ? BlockCodec::STORED : BlockCodec::LZ);
+            for (int byte = 0; byte < 4; byte++) {
+                index.put(static_cast<char>((checksums[i] >> (8 * byte)) & 0xFF));
+            }
+            blockCount++;
+        }
+        batch.clear();
+        if (!file) failed = true;
+    }
 
-            cout << "\n=== Fine Payment Details ===\n";
-            cout << "Book Fine amount: " << it->second << " rupees\n";
-            cout << "Payment amount: " << amount << " rupees\n";
-            
-            // Remove the fine and reset due date
-            totalFine -= it->second;
-            bookFines.erase(isbn);
-            
-            // Set new due date (using actual days)
-            int newDueDate = currentDate + (maxDays * 24 * 60 * 60);
-            borrowedBooks[isbn] = newDueDate;
-            lastFinePaidTime[isbn] = currentDate;  // Update last fine paid time
-            
-            cout << "\nPayment ACCEPTED!\n";
-            cout << "Fine of " << amount << " rupees has been paid for this book.\n";
-            cout << "Book has been reissued with new due date.\n";
-            
-            // Convert due date to human-readable format
-            time_t dueTime = newDueDate;
-            struct tm* dueTm = localtime(&dueTime);
-            char dueStr[26];
-            strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
-            cout << "New due date: " << dueStr << "\n";
-            cout << "Remaining total fine: " << totalFine << " rupees\n";
-            
-            return true;
+protected:
+    int_type overflow(int_type c) override {
+        if (failed) return traits_type::eof();
+        endBlock();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
         }
-        // For faculty members, just reissue the book without requiring payment
-        int newDueDate = currentDate + (maxDays * 24 * 60 * 60);
-        borrowedBooks[isbn] = newDueDate;
-        lastFinePaidTime[isbn] = currentDate;
-        
-        // Convert due date to human-readable format
-        time_t dueTime = newDueDate;
-        struct tm* dueTm = localtime(&dueTime);
-        char dueStr[26];
-        strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
-        
-        cout << "\nBook has been reissued.\n";
-        cout << "New due date: " << dueStr << "\n";
+        return traits_type::not_eof(c);
+    }
+
+public:
+    BlockCompressedWriter()
+        : batchLimit(max(1u, min(thread::hardware_concurrency(), 8u))), blockCount(0), failed(true) {}
+
+    bool open(const string& target) {
+        path = target;
+        file.open(path + ".tmp", ios::out | ios::binary | ios::trunc);
+        if (!file) return false;
+        file.write(SNAPSHOT_MAGIC, 4);
+        file.put(1);
+        block.assign(BlockCodec::BLOCK_SIZE, '\0');
+        setp(&block[0], &block[0] + block.size());
+        failed = false;
         return true;
     }
 
-    bool payFine(double amount, int currentDate) {
-        // Faculty members don't need to pay fines
-        if (isFaculty) {
-            cout << "\nFaculty members do not incur fines.\n";
-            return true;
+    // Write the last blocks and the index, then put the file in place
+    bool close() {
+        if (failed) return false;
+        endBlock();
+        writeBatch();
+        unsigned long long indexOffset = file.tellp();
+        writeVarint(file, blockCount);
+        string entries = index.str();
+        file.write(entries.data(), entries.size());
+        for (int i = 0; i < 8; i++) {
+            file.put(static_cast<char>((indexOffset >> (8 * i)) & 0xFF));
         }
-        
-        // Recalculate fines before payment
-        updateFines(currentDate);
-        
-        cout << "\n=== Fine Payment Details ===\n";
-        cout << "Total fine amount: " << totalFine << " rupees\n";
-        cout << "Payment amount: " << amount << " rupees\n";
+        file.write(SNAPSHOT_MAGIC, 4);
+        file.close();
+        failed = true;  // Nothing more can be written
+        if (!file) return false;
+        error_code ec;
+        filesystem::rename(path + ".tmp", path, ec);
+        return !ec;
+    }
+};
 
-        if (amount < totalFine) {
-            cout << "\nPayment REJECTED!\n";
-            cout << "Payment amount is less than the total fine.\n";
-            cout << "Remaining amount to pay: " << (totalFine - amount) << " rupees\n";
-            cout << "Please pay the exact amount of " << totalFine << " rupees.\n";
+// Reads a .lmz file as a stream. Blocks are read and decompressed a batch
+// at a time (one block per core, in parallel), so memory stays bounded by
+// one batch however large the file. Seeking to any position decompresses
+// only the batch that starts with the block holding it.
+class BlockCompressedReader : public streambuf {
+private:
+    struct Block {
+        unsigned long long rawOffset, fileOffset;
+        size_t rawSize, storedSize;
+        int method;
+        uint32_t checksum;
+    };
+
+    ifstream file;
+    vector<Block> blocks;
+    unsigned long long rawSize;
+    size_t batchLimit;
+    vector<string> window;  // Decompressed blocks windowFirst, windowFirst + 1, ...
+    size_t windowFirst;
+    size_t current;         // The block in the get area; blocks.size() at the end
+    static const size_t NOT_STARTED = SIZE_MAX;
+    bool damaged;
+
+    bool loadWindow(size_t first) {
+        size_t count = min(batchLimit, blocks.size() - first);
+        const Block& last = blocks[first + count - 1];
+        unsigned long long begin = blocks[first].fileOffset;
+        string stored(last.fileOffset + last.storedSize - begin, '\0');
+        file.clear();
+        file.seekg(begin);
+        file.read(&stored[0], stored.size());
+        if (!file) {
+            damaged = true;
             return false;
         }
-        if (amount > totalFine) {
-            cout << "\nPayment REJECTED!\n";
-            cout << "Payment amount is more than the total fine.\n";
-            cout << "Excess amount: " << (amount - totalFine) << " rupees\n";
-            cout << "Please pay the exact amount of " << totalFine << " rupees.\n";
+
+        window.assign(count, string());
+        vector<char> ok(count, 0);
+        auto decode = [&](size_t i) {
+            const Block& b = blocks[first + i];
+            const char* data = stored.data() + (b.fileOffset - begin);
+            if (b.method == BlockCodec::STORED) {
+                window[i].assign(data, b.storedSize);
+                ok[i] = b.storedSize == b.rawSize;
+            } else {
+                window[i].assign(b.rawSize, '\0');
+                ok[i] = BlockCodec::decompress(data, b.storedSize, &window[i][0], b.rawSize);
+            }
+            ok[i] = ok[i] && BlockCodec::checksum(window[i].data(), window[i].size()) == b.checksum;
+        };
+        if (count == 1) {
+            decode(0);
+        } else {
+            vector<thread> threads;
+            for (size_t i = 0; i < count; i++) {
+                threads.emplace_back(decode, i);
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+        }
+        windowFirst = first;
+        if (find(ok.begin(), ok.end(), 0) != ok.end()) {
+            damaged = true;
+            window.clear();
             return false;
         }
-        
-        cout << "\nPayment ACCEPTED!\n";
-        cout << "Fine of " << totalFine << " rupees has been paid successfully.\n";
-        
-        // Update last fine paid time and reissue all books with new due dates
-        for (auto& book : borrowedBooks) {
-            lastFinePaidTime[book.first] = currentDate;
-            // For testing: 10 seconds = 1 day
-            int newDueDate = currentDate + (maxDays * 24 * 60 * 60);  // Changed from (24 * 60 * 60) to 10 for testing
-            book.second = newDueDate;
-            
-            // Convert due date to human-readable format for display
-            time_t dueTime = newDueDate;
-            struct tm* dueTm = localtime(&dueTime);
-            char dueStr[26];
-            strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
-            
-            cout << "\nBook " << book.first << " has been reissued.\n";
-            cout << "New due date: " << dueStr << "\n";
+        return true;
+    }
+
+    // Make block number the get area, starting offset bytes into it
+    bool enter(size_t number, size_t offset) {
+        if (number >= blocks.size()) {
+            current = blocks.size();
+            setg(nullptr, nullptr, nullptr);
+            return false;
         }
-        
-        totalFine = 0;
-        bookFines.clear();  // Clear all book fines after total payment
-        
+        if (number < windowFirst || number >= windowFirst + window.size()) {
+            if (!loadWindow(number)) {
+                current = blocks.size();
+                setg(nullptr, nullptr, nullptr);
+                return false;
+            }
+        }
+        current = number;
+        string& data = window[number - windowFirst];
+        setg(&data[0], &data[0] + offset, &data[0] + data.size());
         return true;
     }
 
-    void addToHistory(const string& isbn, int returnDate) {
-        borrowingHistory.push_back({isbn, returnDate});
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        if (current == blocks.size()) return traits_type::eof();
+        if (!enter(current == NOT_STARTED ? 0 : current + 1, 0)) return traits_type::eof();
+        return traits_type::to_int_type(*gptr());
     }
 
-    bool returnBook(const string& isbn, int currentDate) {
-        // Update fines before checking
-        updateFines(currentDate);
-        
-        auto it = borrowedBooks.find(isbn);
-        if (it == borrowedBooks.end()) {
-            cout << "Book not found in borrowed list.\n";
-            return false;
+    pos_type seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which) override {
+        unsigned long long base = 0;
+        if (dir == ios_base::cur) {
+            if (current == NOT_STARTED) base = 0;
+            else if (current == blocks.size()) base = rawSize;
+            else base = blocks[current].rawOffset + (gptr() - eback());
+        } else if (dir == ios_base::end) {
+            base = rawSize;
+        }
+        return seekpos(pos_type(off_type(base) + off), which);
+    }
+
+    pos_type seekpos(pos_type pos, ios_base::openmode) override {
+        off_type target = pos;
+        if (target < 0 || (unsigned long long)target > rawSize) return pos_type(off_type(-1));
+        if ((unsigned long long)target == rawSize) {
+            enter(blocks.size(), 0);
+            return pos;
+        }
+        auto it = upper_bound(blocks.begin(), blocks.end(), (unsigned long long)target,
+                              [](unsigned long long offset, const Block& b) { return offset < b.rawOffset; });
+        size_t number = (it - blocks.begin()) - 1;
+        if (!enter(number, target - blocks[number].rawOffset)) return pos_type(off_type(-1));
+        return pos;
+    }
+
+public:
+    BlockCompressedReader()
+        : rawSize(0), batchLimit(max(1u, min(thread::hardware_concurrency(), 8u))),
+          windowFirst(0), current(NOT_STARTED), damaged(false) {}
+
+    // Read the header and the block index; false if this is not a .lmz file
+    bool open(const string& path) {
+        file.open(path, ios::in | ios::binary);
+        if (!file) return false;
+        char header[SNAPSHOT_HEADER], footer[SNAPSHOT_FOOTER];
+        file.read(header, SNAPSHOT_HEADER);
+        file.seekg(0, ios::end);
+        long long fileSize = file.tellg();
+        if (!file || fileSize < (long long)(SNAPSHOT_HEADER + SNAPSHOT_FOOTER) ||
+            memcmp(header, SNAPSHOT_MAGIC, 4) != 0 || header[4] != 1) {
+            return false;
+        }
+        file.seekg(fileSize - SNAPSHOT_FOOTER);
+        file.read(footer, SNAPSHOT_FOOTER);
+        unsigned long long indexOffset = 0;
+        for (int i = 7; i >= 0; i--) {
+            indexOffset = (indexOffset << 8) | static_cast<unsigned char>(footer[i]);
+        }
+        if (!file || memcmp(footer + 8, SNAPSHOT_MAGIC, 4) != 0 ||
+            indexOffset < SNAPSHOT_HEADER || indexOffset > (unsigned long long)fileSize - SNAPSHOT_FOOTER) {
+            return false;
+        }
+
+        file.seekg(indexOffset);
+        unsigned long long count = readVarint(file);
+        unsigned long long fileOffset = SNAPSHOT_HEADER;
+        for (unsigned long long i = 0; i < count && file; i++) {
+            Block b;
+            b.rawOffset = rawSize;
+            b.fileOffset = fileOffset;
+            b.rawSize = readVarint(file);
+            b.storedSize = readVarint(file);
+            b.method = file.get();
+            b.checksum = 0;
+            for (int byte = 0; byte < 4; byte++) {
+                b.checksum |= static_cast<uint32_t>(file.get() & 0xFF) << (8 * byte);
+            }
+            if (b.rawSize == 0 || b.rawSize > BlockCodec::BLOCK_SIZE) break;
+            blocks.push_back(b);
+            rawSize += b.rawSize;
+            fileOffset += b.storedSize;
+        }
+        // The blocks must exactly fill the space before the index
+        if (!file || blocks.size() != count || fileOffset != indexOffset) {
+            blocks.clear();
+            rawSize = 0;
+            return false;
+        }
+        return true;
+    }
+
+    // A block could not be read or decompressed; the stream ended early
+    bool isDamaged() const { return damaged; }
+};
+
+// An istream over a .lmz file; fails at once if the file is missing or not one
+class SnapshotReader : public istream {
+private:
+    BlockCompressedReader buffer;
+
+public:
+    explicit SnapshotReader(const string& path) : istream(nullptr) {
+        rdbuf(&buffer);
+        if (!buffer.open(path)) setstate(ios::failbit);
+    }
+
+    bool isDamaged() const { return buffer.isDamaged(); }
+};
+
+// An ostream writing a .lmz file; nothing replaces path until close() succeeds
+class SnapshotWriter : public ostream {
+private:
+    BlockCompressedWriter buffer;
+
+public:
+    explicit SnapshotWriter(const string& path) : ostream(nullptr) {
+        rdbuf(&buffer);
+        if (!buffer.open(path)) setstate(ios::failbit);
+    }
+
+    bool close() {
+        return good() && buffer.close();
+    }
+};
+
+// Money is kept as whole paise (1 rupee = 100 paise) so that fines add up and
+// compare exactly; rupee text is only produced and parsed at the edges.
+typedef long long Paise;
+const Paise FINE_PER_DAY = 1000;  // 10 rupees per overdue day
+
+string formatRupees(Paise amount) {
+    Paise absolute = amount < 0 ? -amount : amount;
+    string text = (amount < 0 ? "-" : "") + to_string(absolute / 100);
+    if (absolute % 100 != 0) {
+        char paise[8];
+        snprintf(paise, sizeof(paise), ".%02lld", absolute % 100);
+        text += paise;
+    }
+    return text;
+}
+
+// Parse a rupee amount such as "25", "25.5" or "25.50" exactly. Digits past
+// the paise must be zero, which also accepts the old "25.000000" file format.
+bool parseRupees(const string& text, Paise& amount) {
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+        negative = text[pos] == '-';
+        pos++;
+    }
+    Paise rupees = 0;
+    int digits = 0;
+    while (pos < text.size() && isdigit((unsigned char)text[pos])) {
+        rupees = rupees * 10 + (text[pos++] - '0');
+        if (++digits > 15) return false;
+    }
+    Paise paise = 0;
+    if (pos < text.size() && text[pos] == '.') {
+        pos++;
+        int place = 0;
+        for (; pos < text.size() && isdigit((unsigned char)text[pos]); place++, pos++) {
+            if (place < 2) paise = paise * 10 + (text[pos] - '0');
+            else if (text[pos] != '0') return false;
+        }
+        if (place == 1) paise *= 10;
+        digits += place;
+    }
+    if (digits == 0 || pos != text.size()) return false;
+    amount = (rupees * 100 + paise) * (negative ? -1 : 1);
+    return true;
+}
+
+// Read a rupee amount typed at the console; -1 if it is not a valid amount
+Paise readRupees(istream &in) {
+    string text;
+    in >> text;
+    Paise amount;
+    return parseRupees(text, amount) ? amount : -1;
+}
+
+// One entry of an account's append-only fine ledger
+struct FineLedgerEntry {
+    enum Kind { CHARGE = 'C', PAYMENT = 'P', WAIVER = 'W' };
+    int time;
+    char kind;
+    Paise amount;
+    string isbn;
+};
+
+// Fine ledger of every account. Charges, payments and waivers are appended
+// and each account's balance is maintained incrementally. Balances also live
+// in contiguous blocks so the branch-wide outstanding total is a plain
+// sequential sum that the compiler vectorizes. Copies of the ledger (one per
+// version) share the account map, each account's entries and the balance
+// blocks, and a write copies only the chunk, ledger and block it touches.
+class FineLedger {
+private:
+    static const size_t BALANCE_BLOCK = 4096;
+    typedef array<Paise, BALANCE_BLOCK> BalanceBlock;
+
+    struct AccountLedger {
+        vector<FineLedgerEntry> entries;
+        Paise balance;
+        size_t slot;
+    };
+    SharedChunks<string, shared_ptr<AccountLedger>> ledgers;  // userID -> ledger
+    vector<shared_ptr<BalanceBlock>> balances;                // slot -> balance, in blocks
+    size_t slots = 0;
+    vector<size_t> freeSlots;
+
+    void setBalance(size_t slot, Paise balance) {
+        auto& block = balances[slot / BALANCE_BLOCK];
+        if (block.use_count() > 1) block = make_shared<BalanceBlock>(*block);
+        (*block)[slot % BALANCE_BLOCK] = balance;
+    }
+
+    // The account's ledger, copied first if another copy of the ledger shares it
+    AccountLedger& ledgerFor(const string& userId) {
+        if (shared_ptr<AccountLedger>* found = ledgers.findWritable(userId)) {
+            if (found->use_count() > 1) *found = make_shared<AccountLedger>(**found);
+            return **found;
+        }
+        size_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = slots++;
+            if (slot % BALANCE_BLOCK == 0) {
+                balances.push_back(make_shared<BalanceBlock>());
+                balances.back()->fill(0);
+            }
+        }
+        auto& ledger = ledgers[userId];
+        ledger = make_shared<AccountLedger>();
+        ledger->balance = 0;
+        ledger->slot = slot;
+        return *ledger;
+    }
+
+public:
+    void append(const string& userId, const FineLedgerEntry& entry) {
+        AccountLedger& ledger = ledgerFor(userId);
+        ledger.entries.push_back(entry);
+        ledger.balance += entry.kind == FineLedgerEntry::CHARGE ? entry.amount : -entry.amount;
+        setBalance(ledger.slot, ledger.balance);
+    }
+
+    Paise balance(const string& userId) const {
+        const shared_ptr<AccountLedger>* found = ledgers.find(userId);
+        return found ? (*found)->balance : 0;
+    }
+
+    const vector<FineLedgerEntry>& entries(const string& userId) const {
+        static const vector<FineLedgerEntry> none;
+        const shared_ptr<AccountLedger>* found = ledgers.find(userId);
+        return found ? (*found)->entries : none;
+    }
+
+    Paise outstandingTotal() const {
+        Paise total = 0;
+        for (const auto& block : balances) {
+            const Paise* data = block->data();
+            for (size_t i = 0; i < BALANCE_BLOCK; i++) {
+                total += data[i];
+            }
+        }
+        return total;
+    }
+
+    void removeAccount(const string& userId) {
+        const shared_ptr<AccountLedger>* found = ledgers.find(userId);
+        if (!found) return;
+        size_t slot = (*found)->slot;
+        setBalance(slot, 0);
+        freeSlots.push_back(slot);
+        ledgers.erase(userId);
+    }
+
+    void clear() {
+        ledgers.clear();
+        balances.clear();
+        slots = 0;
+        freeSlots.clear();
+    }
+
+    void write(ostream &out) const {
+        out << ledgers.size() << "\n";
+        ledgers.forEach([&](const string& userId, const shared_ptr<AccountLedger>& ledger) {
+            out << userId << "\n" << ledger->entries.size() << "\n";
+            for (const auto& entry : ledger->entries) {
+                out << entry.time << " " << entry.kind << " " << entry.amount << "\n"
+                    << entry.isbn << "\n";
+            }
+        });
+    }
+
+    void read(istream &in) {
+        int numAccounts;
+        in >> numAccounts;
+        in.ignore();
+        for (int i = 0; i < numAccounts && in; i++) {
+            string userId;
+            int numEntries;
+            getline(in, userId);
+            in >> numEntries;
+            in.ignore();
+            for (int j = 0; j < numEntries && in; j++) {
+                FineLedgerEntry entry;
+                in >> entry.time >> entry.kind >> entry.amount;
+                in.ignore();
+                getline(in, entry.isbn);
+                string isbn = canonicalStoredIsbn(entry.isbn);
+                if (!isbn.empty()) entry.isbn = isbn;
+                append(userId, entry);
+            }
+        }
+    }
+};
+
+FineLedger fineLedger;
+
+// Structured event log: diagnostics and business events (loans, returns,
+// fines, loading and saving) go to events.log as one JSON object per line
+// instead of being printed while state is being changed. record() copies
+// the event name and fields into a ring buffer owned by the calling thread
+// and returns: no lock, no formatting, no I/O. A background writer drains
+// every thread's ring every FLUSH_MS, formats the events and appends them
+// to the file; errors are also echoed to stderr. Events below the minimum
+// severity (LMS_LOG_LEVEL=debug|info|warn|error, default info) are
+// discarded before anything is copied, and an event that finds its ring
+// full is dropped and counted instead of making the caller wait.
+class EventLog {
+public:
+    enum Severity { DEBUG, INFO, WARN, ERROR };
+
+    static constexpr int MAX_FIELDS = 8;
+    static constexpr int TEXT_BYTES = 46;  // Longer text values are truncated
+
+    // A key and a number or a short text, held inline so capturing never allocates
+    struct Field {
+        const char* key;
+        long long number;
+        bool isText;
+        unsigned char length;
+        char text[TEXT_BYTES];
+
+        Field() : key(""), number(0), isText(false), length(0) {}
+        template <typename Number, typename enable_if<is_integral<Number>::value, int>::type = 0>
+        Field(const char* k, Number n) : key(k), number(static_cast<long long>(n)), isText(false), length(0) {}
+        Field(const char* k, const char* s) : key(k), number(0), isText(true) { setText(s, strlen(s)); }
+        Field(const char* k, const string& s) : key(k), number(0), isText(true) { setText(s.data(), s.size()); }
+
+    private:
+        void setText(const char* s, size_t size) {
+            length = static_cast<unsigned char>(min(size, static_cast<size_t>(TEXT_BYTES)));
+            memcpy(text, s, length);
+        }
+    };
+
+private:
+    static constexpr size_t RING_SIZE = 1024;
+    static constexpr int FLUSH_MS = 50;
+
+    struct Event {
+        long long time;  // Nanoseconds since the epoch
+        Severity severity;
+        const char* name;  // Event names are string literals
+        int fieldCount;
+        Field fields[MAX_FIELDS];
+    };
+
+    // Single producer (the owning thread), single consumer (whoever drains)
+    struct Ring {
+        vector<Event> slots;
+        atomic<size_t> head;  // Next slot the producer writes
+        atomic<size_t> tail;  // Next slot the consumer reads
+        atomic<size_t> dropped;
+        atomic<bool> abandoned;  // The thread has exited
+
+        Ring() : slots(RING_SIZE), head(0), tail(0), dropped(0), abandoned(false) {}
+    };
+
+    // Registers the thread's ring on first use, marks it abandoned at thread exit
+    struct RingHolder {
+        shared_ptr<Ring> ring;
+        ~RingHolder() {
+            if (ring) ring->abandoned = true;
+        }
+    };
+
+    atomic<int> minSeverity;
+    string path;
+    mutex ringsMutex;
+    vector<shared_ptr<Ring>> rings;
+    mutex drainMutex;  // One drain at a time: the writer or flush()
+    ofstream file;
+    mutex stopMutex;
+    condition_variable wake;
+    bool stopping;
+    thread writer;
+
+    Ring* localRing() {
+        thread_local RingHolder holder;
+        if (!holder.ring) {
+            holder.ring = make_shared<Ring>();
+            lock_guard<mutex> lock(ringsMutex);
+            rings.push_back(holder.ring);
+        }
+        return holder.ring.get();
+    }
+
+    static const char* severityName(Severity severity) {
+        static const char* names[] = {"debug", "info", "warn", "error"};
+        return names[severity];
+    }
+
+    static void appendJsonText(string& out, const char* text, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            char c = text[i];
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+    }
+
+    static void format(const Event& event, string& json, string& console) {
+        json += "{\"time\":";
+        json += to_string(event.time);
+        json += ",\"level\":\"";
+        json += severityName(event.severity);
+        json += "\",\"event\":\"";
+        json += event.name;
+        json += '"';
+        if (event.severity == ERROR) console = string("Error: ") + event.name;
+        for (int i = 0; i < event.fieldCount; i++) {
+            const Field& field = event.fields[i];
+            json += ",\"";
+            json += field.key;
+            json += "\":";
+            string value = field.isText ? string(field.text, field.length) : to_string(field.number);
+            if (field.isText) {
+                json += '"';
+                appendJsonText(json, field.text, field.length);
+                json += '"';
+            } else {
+                json += value;
+            }
+            if (event.severity == ERROR) console += string(" ") + field.key + "=" + value;
+        }
+        json += "}\n";
+    }
+
+    // Format and write everything captured so far
+    void drain() {
+        lock_guard<mutex> drainLock(drainMutex);
+        vector<shared_ptr<Ring>> current;
+        {
+            lock_guard<mutex> lock(ringsMutex);
+            current = rings;
+        }
+
+        string out, errors;
+        size_t dropped = 0;
+        for (const auto& ring : current) {
+            size_t tail = ring->tail.load(memory_order_relaxed);
+            size_t head = ring->head.load(memory_order_acquire);
+            for (; tail != head; tail++) {
+                string console;
+                format(ring->slots[tail % RING_SIZE], out, console);
+                if (!console.empty()) errors += console + "\n";
+            }
+            ring->tail.store(tail, memory_order_release);
+            dropped += ring->dropped.exchange(0);
+        }
+        if (dropped > 0) {
+            out += "{\"time\":" + to_string(now()) + ",\"level\":\"warn\",\"event\":\"events.dropped\",\"count\":" +
+                   to_string(dropped) + "}\n";
+        }
+
+        if (!out.empty()) {
+            if (!file.is_open()) file.open(path, ios::out | ios::app);
+            file << out;
+            file.flush();
+        }
+        if (!errors.empty()) cerr << errors;
+
+        // Rings of threads that have exited go once they are empty
+        lock_guard<mutex> lock(ringsMutex);
+        rings.erase(remove_if(rings.begin(), rings.end(), [](const shared_ptr<Ring>& ring) {
+                        return ring->abandoned && ring->tail.load() == ring->head.load();
+                    }),
+                    rings.end());
+    }
+
+    void run() {
+        unique_lock<mutex> lock(stopMutex);
+        while (!stopping) {
+            wake.wait_for(lock, chrono::milliseconds(FLUSH_MS));
+            lock.unlock();
+            drain();
+            lock.lock();
+        }
+    }
+
+    static long long now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    EventLog(string file = "events.log") : minSeverity(INFO), path(file), stopping(false) {
+        const char* level = getenv("LMS_LOG_LEVEL");
+        if (level) {
+            string name = level;
+            if (name == "debug") minSeverity = DEBUG;
+            else if (name == "warn") minSeverity = WARN;
+            else if (name == "error") minSeverity = ERROR;
+        }
+        writer = thread(&EventLog::run, this);
+    }
+
+    ~EventLog() {
+        {
+            lock_guard<mutex> lock(stopMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        writer.join();
+        drain();
+    }
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    bool enabled(Severity severity) const { return severity >= minSeverity.load(memory_order_relaxed); }
+    Severity getMinSeverity() const { return static_cast<Severity>(minSeverity.load()); }
+    void setMinSeverity(Severity severity) { minSeverity = severity; }
+
+    void record(Severity severity, const char* name, initializer_list<Field> fields = {}) {
+        if (!enabled(severity)) return;
+        Ring* ring = localRing();
+        size_t head = ring->head.load(memory_order_relaxed);
+        if (head - ring->tail.load(memory_order_acquire) >= RING_SIZE) {
+            ring->dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        Event& event = ring->slots[head % RING_SIZE];
+        event.time = now();
+        event.severity = severity;
+        event.name = name;
+        event.fieldCount = 0;
+        for (const Field& field : fields) {
+            if (event.fieldCount == MAX_FIELDS) break;
+            event.fields[event.fieldCount++] = field;
+        }
+        ring->head.store(head + 1, memory_order_release);
+    }
+
+    // Write everything recorded so far before returning
+    void flush() { drain(); }
+};
+
+EventLog events;
+
+// Book IDs in the data files that are neither an ISBN nor a legacy ID
+atomic<size_t> unusableBookIds(0);
+
+// Key for a book ID read back from a file; one that cannot be keyed is
+// reported and counted, and the caller skips the record it belongs to
+IsbnKey loadIsbn(const string& stored, const char* file) {
+    IsbnKey key = packStoredIsbn(stored);
+    if (key == INVALID_ISBN) {
+        unusableBookIds++;
+        events.record(EventLog::ERROR, "load.unusable_id", {{"file", file}, {"isbn", stored}});
+    }
+    return key;
+}
+
+// Operation log: every mutation made by a Librarian, Student or Faculty is
+// appended to operations.log with its timestamp so that the library state can
+// be rebuilt up to any point in time. Checkpoints (full snapshots) are written
+// every CHECKPOINT_INTERVAL operations so a restore only replays the tail.
+class OperationLog {
+private:
+    string logFile;
+    string checkpointDir;
+    ofstream logStream;
+    long long lastSeq;
+    long long opsSinceCheckpoint;
+    bool replaying;  // Suppresses logging while operations are being re-applied
+
+    static const int CHECKPOINT_INTERVAL = 1000;
+
+    struct CheckpointInfo {
+        long long seq;
+        int time;
+        string path;
+    };
+
+    vector<CheckpointInfo> listCheckpoints() const;
+    void readCheckpoint(const CheckpointInfo& base, long long& seq, long long& offset);
+
+public:
+    OperationLog(string file = "operations.log", string dir = "checkpoints")
+        : logFile(file), checkpointDir(dir), lastSeq(0), opsSinceCheckpoint(0), replaying(false) {}
+
+    void open();
+    // Stop appending; open() starts again from whatever log is then in place
+    void close() {
+        logStream.close();
+        lastSeq = 0;
+        opsSinceCheckpoint = 0;
+    }
+    void record(const string& op, const vector<string>& args);
+    void recordAll(const vector<pair<string, vector<string>>>& operations);
+    void writeCheckpoint();
+    bool restoreTo(int targetTime);
+    bool isReplaying() const { return replaying; }
+
+    // For read replicas (see ReadReplica), which follow the log without writing it
+    bool loadLatestCheckpoint(long long minSeq, long long& seq, long long& offset);
+    bool applyOperation(const vector<string>& fields);
+    const string& getLogFile() const { return logFile; }
+};
+
+OperationLog opLog;
+
+// Append-only pool of the author and publisher names in the catalogue. Each
+// distinct name is stored once and books hold its 32-bit ID, so a publisher
+// shared by thousands of books costs four bytes per book, and books can be
+// grouped by author or publisher by comparing IDs. IDs are never reused or
+// removed, so a Book stays valid however the dictionary grows.
+class StringDictionary {
+private:
+    mutable shared_mutex m;
+    deque<string> strings;  // Indexed by ID; a deque keeps the strings in place as it grows
+    unordered_map<string_view, uint32_t> ids;  // Views of the strings above
+
+public:
+    StringDictionary() { intern(""); }  // ID 0 is the empty string
+
+    StringDictionary(const StringDictionary&) = delete;
+    StringDictionary& operator=(const StringDictionary&) = delete;
+
+    uint32_t intern(const string& value) {
+        {
+            shared_lock<shared_mutex> lock(m);
+            auto it = ids.find(value);
+            if (it != ids.end()) return it->second;
+        }
+        unique_lock<shared_mutex> lock(m);
+        auto it = ids.find(value);
+        if (it != ids.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(strings.size());
+        strings.push_back(value);
+        ids.emplace(strings.back(), id);
+        return id;
+    }
+
+    const string& lookup(uint32_t id) const {
+        shared_lock<shared_mutex> lock(m);
+        return strings[id];
+    }
+
+    size_t size() const {
+        shared_lock<shared_mutex> lock(m);
+        return strings.size();
+    }
+};
+
+StringDictionary catalogueStrings;
+
+class Book {
+private:
+    string isbn, title;
+    uint32_t author, publisher;  // IDs in catalogueStrings
+    int year;
+    bool available, reserved;
+
+public:
+    Book(string t = "", string a = "", string p = "", int y = 0, string i = "", bool avail = true) 
+        : isbn(i), title(t), author(catalogueStrings.intern(a)), publisher(catalogueStrings.intern(p)), year(y),
+          available(avail), reserved(false) {}
+
+    string getISBN() const { return isbn; }
+    string getTitle() const { return title; }
+    const string& getAuthor() const { return catalogueStrings.lookup(author); }
+    const string& getPublisher() const { return catalogueStrings.lookup(publisher); }
+    uint32_t getAuthorID() const { return author; }
+    uint32_t getPublisherID() const { return publisher; }
+    int getYear() const { return year; }
+    bool isAvailable() const { return available; }
+    bool isReserved() const { return reserved; }
+    
+    void setISBN(const string& i) { isbn = i; }
+    void setTitle(const string& t) { title = t; }
+    void setAuthor(const string& a) { author = catalogueStrings.intern(a); }
+    void setPublisher(const string& p) { publisher = catalogueStrings.intern(p); }
+    void setYear(int y) { year = y; }
+    void setNameIDs(uint32_t authorID, uint32_t publisherID) {
+        author = authorID;
+        publisher = publisherID;
+    }
+    void setAvailability(bool status) { available = status; }
+    void setReserved(bool status) { reserved = status; }
+
+    void displayISBN() const { cout << "ISBN: " << isbn << "\n"; }
+    void displayTitle() const { cout << "Title: " << title << "\n"; }
+    void displayAuthor() const { cout << "Author: " << getAuthor() << "\n"; }
+    void displayPublisher() const { cout << "Publisher: " << getPublisher() << "\n"; }
+    void displayYear() const { cout << "Year: " << year << "\n"; }
+    void displayStatus() const { 
+        cout << "Status: " << (available ? "Available" : "Borrowed")
+             << " | " << (reserved ? "Reserved" : "Not Reserved") << "\n"; 
+    }
+
+    void display() const {
+        cout << "ISBN: " << isbn << "\nTitle: " << title << "\nAuthor: " << getAuthor()
+             << "\nPublisher: " << getPublisher() << "\nYear: " << year
+             << "\nStatus: " << (available ? "Available" : "Borrowed")
+             << " | " << (reserved ? "Reserved" : "Not Reserved") << "\n";
+    }
+
+    void saveToFile(ostream &outfile) const {
+        outfile << isbn << "\n" << title << "\n" << getAuthor() << "\n"
+                << getPublisher() << "\n" << year << "\n" << available << " " << reserved << "\n";
+    }
+    
+    void loadFromFile(istream &infile) {
+        string authorName, publisherName;
+        getline(infile, isbn);
+        getline(infile, title);
+        getline(infile, authorName);
+        getline(infile, publisherName);
+        author = catalogueStrings.intern(authorName);
+        publisher = catalogueStrings.intern(publisherName);
+        infile >> year;
+        infile >> available >> reserved;
+        infile.ignore();
+    }
+};
+
+// Where the catalogue lives. Book lookups go through this interface so the
+// catalogue can be held in memory and saved as books.txt (the default) or
+// kept on disk in pages read on demand (books-N.db, see PagedBookStorage).
+class BookStorage {
+public:
+    virtual ~BookStorage() {}
+
+    // Copy the book stored under key into book; false if there is none
+    virtual bool find(IsbnKey key, Book& book) const = 0;
+    virtual void store(IsbnKey key, const Book& book) = 0;
+    virtual bool erase(IsbnKey key) = 0;
+    // Visit every book in key order
+    virtual void forEach(const function<void(IsbnKey, const Book&)>& visit) const = 0;
+    virtual size_t size() const = 0;
+    virtual void clear() = 0;
+    // An immutable copy of the current contents for a version (see VersionStore)
+    virtual shared_ptr<const BookStorage> snapshot() const = 0;
+    // Write the contents to the data files
+    virtual void save() const = 0;
+    virtual bool isPaged() const = 0;
+
+    bool contains(IsbnKey key) const {
+        Book book;
+        return find(key, book);
+    }
+
+    // Returns false if there is no such book
+    bool setAvailability(IsbnKey key, bool available) {
+        Book book;
+        if (!find(key, book)) return false;
+        book.setAvailability(available);
+        store(key, book);
+        return true;
+    }
+};
+
+// The catalogue held in memory: a map of every book as of the last save,
+// shared with the snapshots taken since, plus the changes made after it.
+// A version's snapshot copies only those changes; the background writer
+// saves it, merges it into a new map off the interactive thread and hands
+// that back, and the changes it covers are dropped (as PagedBookStorage does
+// with books-N.db).
+class MemoryBookStorage : public BookStorage {
+private:
+    typedef map<IsbnKey, Book> BookMap;
+
+    struct Change {
+        unsigned long long seq;
+        bool erased;
+        Book book;
+    };
+
+    mutable mutex m;  // The writer hands merged maps back from its own thread
+    shared_ptr<const BookMap> base;
+    map<IsbnKey, Change> changes;
+    unsigned long long nextSeq;
+    unsigned long long clears;
+    size_t count;
+    MemoryBookStorage* origin;  // For a snapshot, the live storage it was taken from
+
+    bool findLocked(IsbnKey key, Book& book) const {
+        auto it = changes.find(key);
+        if (it != changes.end()) {
+            if (it->second.erased) return false;
+            book = it->second.book;
+            return true;
+        }
+        auto stored = base->find(key);
+        if (stored == base->end()) return false;
+        book = stored->second;
+        return true;
+    }
+
+    // Called with the map merged from a snapshot holding changes up to coveredSeq
+    void adopt(const shared_ptr<const BookMap>& expected, unsigned long long snapshotClears,
+               const shared_ptr<const BookMap>& merged, unsigned long long coveredSeq) {
+        lock_guard<mutex> lock(m);
+        if (base != expected || clears != snapshotClears) return;  // Replaced since
+        base = merged;
+        for (auto it = changes.begin(); it != changes.end();) {
+            if (it->second.seq <= coveredSeq) {
+                it = changes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+public:
+    MemoryBookStorage() : base(make_shared<const BookMap>()), nextSeq(1), clears(0), count(0), origin(nullptr) {}
+
+    bool find(IsbnKey key, Book& book) const override {
+        lock_guard<mutex> lock(m);
+        return findLocked(key, book);
+    }
+
+    void store(IsbnKey key, const Book& book) override {
+        lock_guard<mutex> lock(m);
+        Book existing;
+        if (!findLocked(key, existing)) count++;
+        changes[key] = Change{nextSeq++, false, book};
+    }
+
+    bool erase(IsbnKey key) override {
+        lock_guard<mutex> lock(m);
+        Book existing;
+        if (!findLocked(key, existing)) return false;
+        changes[key] = Change{nextSeq++, true, Book()};
+        count--;
+        return true;
+    }
+
+    // Merge the shared map with the pending changes, both in key order
+    void forEach(const function<void(IsbnKey, const Book&)>& visit) const override {
+        shared_ptr<const BookMap> stored;
+        map<IsbnKey, Change> pending;
+        {
+            lock_guard<mutex> lock(m);
+            stored = base;
+            pending = changes;
+        }
+        auto next = pending.begin();
+        for (const auto& p : *stored) {
+            for (; next != pending.end() && next->first < p.first; ++next) {
+                if (!next->second.erased) visit(next->first, next->second.book);
+            }
+            if (next != pending.end() && next->first == p.first) {
+                if (!next->second.erased) visit(next->first, next->second.book);  // Replaces the stored book
+                ++next;
+            } else {
+                visit(p.first, p.second);
+            }
+        }
+        for (; next != pending.end(); ++next) {
+            if (!next->second.erased) visit(next->first, next->second.book);
+        }
+    }
+
+    size_t size() const override {
+        lock_guard<mutex> lock(m);
+        return count;
+    }
+
+    void clear() override {
+        lock_guard<mutex> lock(m);
+        base = make_shared<const BookMap>();
+        changes.clear();
+        count = 0;
+        clears++;
+    }
+
+    bool isPaged() const override { return false; }
+
+    shared_ptr<const BookStorage> snapshot() const override {
+        lock_guard<mutex> lock(m);
+        auto copy = make_shared<MemoryBookStorage>();
+        copy->base = base;
+        copy->changes = changes;
+        copy->nextSeq = nextSeq;
+        copy->clears = clears;
+        copy->count = count;
+        copy->origin = origin ? origin : const_cast<MemoryBookStorage*>(this);
+        return copy;
+    }
+
+    // Write books.txt, then fold the changes into a new shared map for the live storage
+    void save() const override {
+        if (!origin) {
+            snapshot()->save();
+            return;
+        }
+        saveBooks(*this);
+        if (changes.empty()) return;
+
+        auto merged = make_shared<BookMap>();
+        forEach([&](IsbnKey key, const Book& book) { merged->emplace_hint(merged->end(), key, book); });
+        origin->adopt(base, clears, merged, nextSeq - 1);
+    }
+};
+
+// One immutable catalogue file, books-N.db: a B+-tree bulk-loaded from the
+// books in key order. Leaf pages hold the books, inner pages the first key
+// and location of each child, and the header at the start of the file
+// locates the root, so opening a file reads nothing but the header. Pages
+// are read on demand and kept decoded in a buffer pool of the POOL_PAGES
+// most recently used ones, so the upper levels of the tree and the books in
+// circulation stay in memory while the rest of the catalogue stays on disk.
+class BookPageFile {
+private:
+    static constexpr size_t PAGE_SIZE = 4096;  // Encoded size a page is filled up to
+    static constexpr size_t POOL_PAGES = 1024;
+    static constexpr int VERSION = 2;
+    static constexpr int HEADER_SIZE = 64;
+    static constexpr int VERSION_1_HEADER_SIZE = 48;  // Version 1 kept names inline in each book
+
+    struct PageRef {
+        IsbnKey firstKey;
+        unsigned long long offset;
+        unsigned long long length;
+    };
+
+    struct Page {
+        bool leaf;
+        vector<IsbnKey> keys;      // Of every book, or the first key of every child
+        vector<Book> books;        // Leaf pages
+        vector<PageRef> children;  // Inner pages
+    };
+
+    static atomic<unsigned long long> lastGeneration;
+
+    string path;
+    unsigned long long generation;
+    int version;
+    unsigned long long leafStart;
+    vector<uint32_t> names;  // The file's name table: position -> ID in catalogueStrings
+    unsigned long long count;
+    unsigned long long leafEnd;
+    PageRef root;
+    unsigned long long height;  // 0 for an empty catalogue
+    bool valid;
+    atomic<bool> retired;
+
+    mutable mutex poolMutex;
+    mutable ifstream file;
+    mutable list<unsigned long long> recentlyUsed;  // Page offsets, most recent first
+    mutable unordered_map<unsigned long long, pair<shared_ptr<const Page>, list<unsigned long long>::iterator>> pool;
+
+    static void writeFixed64(ostream &out, unsigned long long value) {
+        for (int i = 0; i < 8; i++) {
+            out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    static unsigned long long readFixed64(istream &in) {
+        unsigned long long value = 0;
+        for (int i = 0; i < 8; i++) {
+            value |= static_cast<unsigned long long>(static_cast<unsigned char>(in.get())) << (8 * i);
+        }
+        return value;
+    }
+
+    // Numbers the names a file uses in the order it first meets them
+    struct NameTable {
+        vector<uint32_t> position;  // ID in catalogueStrings -> position + 1, 0 if not yet used
+        vector<uint32_t> ids;
+
+        uint32_t add(uint32_t id) {
+            if (id >= position.size()) position.resize(max<size_t>(id + 1, position.size() * 2), 0);
+            if (position[id] == 0) {
+                ids.push_back(id);
+                position[id] = static_cast<uint32_t>(ids.size());
+            }
+            return position[id] - 1;
+        }
+    };
+
+    static void writeBook(ostream &out, IsbnKey key, const Book& book, NameTable& table) {
+        writeVarint(out, key);
+        writeCompactString(out, book.getTitle());
+        writeVarint(out, table.add(book.getAuthorID()));
+        writeVarint(out, table.add(book.getPublisherID()));
+        writeSignedVarint(out, book.getYear());
+        out.put(static_cast<char>((book.isAvailable() ? 1 : 0) | (book.isReserved() ? 2 : 0)));
+    }
+
+    IsbnKey readBook(istream &in, Book& book) const {
+        IsbnKey key = readVarint(in);
+        string title = readCompactString(in);
+        if (version == 1) {
+            string author = readCompactString(in);
+            string publisher = readCompactString(in);
+            book = Book(title, author, publisher, 0, unpackIsbn(key));
+        } else {
+            unsigned long long author = readVarint(in);
+            unsigned long long publisher = readVarint(in);
+            if (author >= names.size() || publisher >= names.size()) {
+                in.setstate(ios::failbit);
+                return key;
+            }
+            book = Book(title, "", "", 0, unpackIsbn(key));
+            book.setNameIDs(names[author], names[publisher]);
+        }
+        book.setYear(static_cast<int>(readSignedVarint(in)));
+        int flags = in.get();
+        book.setAvailability(flags & 1);
+        book.setReserved(flags & 2);
+        return key;
+    }
+
+    // Write one page and note where it went
+    static void writePage(ostream &out, char kind, size_t entries, const string& body,
+                          IsbnKey firstKey, vector<PageRef>& level) {
+        unsigned long long offset = out.tellp();
+        out.put(kind);
+        writeVarint(out, entries);
+        out.write(body.data(), body.size());
+        level.push_back({firstKey, offset, static_cast<unsigned long long>(out.tellp()) - offset});
+    }
+
+    shared_ptr<const Page> fetch(const PageRef& ref) const {
+        lock_guard<mutex> lock(poolMutex);
+        auto cached = pool.find(ref.offset);
+        if (cached != pool.end()) {
+            recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, cached->second.second);
+            return cached->second.first;
+        }
+
+        string bytes(ref.length, '\0');
+        file.clear();
+        file.seekg(ref.offset);
+        file.read(&bytes[0], bytes.size());
+        if (!file) return nullptr;
+
+        istringstream in(bytes);
+        auto page = make_shared<Page>();
+        page->leaf = in.get() == 'L';
+        size_t entries = readVarint(in);
+        for (size_t i = 0; i < entries && in; i++) {
+            if (page->leaf) {
+                Book book;
+                page->keys.push_back(readBook(in, book));
+                page->books.push_back(book);
+            } else {
+                PageRef child;
+                child.firstKey = readVarint(in);
+                child.offset = readVarint(in);
+                child.length = readVarint(in);
+                page->keys.push_back(child.firstKey);
+                page->children.push_back(child);
+            }
+        }
+        if (!in) return nullptr;
+
+        recentlyUsed.push_front(ref.offset);
+        pool[ref.offset] = {page, recentlyUsed.begin()};
+        if (pool.size() > POOL_PAGES) {
+            pool.erase(recentlyUsed.back());
+            recentlyUsed.pop_back();
+        }
+        return page;
+    }
+
+public:
+    BookPageFile(const string& filePath, unsigned long long fileGeneration)
+        : path(filePath), generation(fileGeneration), version(0), leafStart(HEADER_SIZE), count(0),
+          leafEnd(HEADER_SIZE), root{0, 0, 0}, height(0), valid(false), retired(false) {
+        file.open(path, ios::in | ios::binary);
+        char magic[4];
+        if (!file.read(magic, 4) || memcmp(magic, "LMSB", 4) != 0) return;
+        version = file.get();
+        if (version != 1 && version != VERSION) return;
+        file.seekg(8);
+        count = readFixed64(file);
+        leafEnd = readFixed64(file);
+        root.offset = readFixed64(file);
+        root.length = readFixed64(file);
+        height = readFixed64(file);
+        if (version == 1) {
+            leafStart = VERSION_1_HEADER_SIZE;
+        } else {
+            unsigned long long tableOffset = readFixed64(file);
+            unsigned long long tableEntries = readFixed64(file);
+            file.seekg(tableOffset);
+            for (unsigned long long i = 0; i < tableEntries && file; i++) {
+                names.push_back(catalogueStrings.intern(readCompactString(file)));
+            }
+        }
+        valid = static_cast<bool>(file);
+
+        unsigned long long seen = lastGeneration.load();
+        while (seen < generation && !lastGeneration.compare_exchange_weak(seen, generation)) {}
+    }
+
+    ~BookPageFile() {
+        file.close();
+        if (retired) {
+            error_code ec;
+            filesystem::remove(path, ec);
+        }
+    }
+
+    BookPageFile(const BookPageFile&) = delete;
+    BookPageFile& operator=(const BookPageFile&) = delete;
+
+    bool isValid() const { return valid; }
+    size_t size() const { return count; }
+    const string& getPath() const { return path; }
+
+    // A newer file replaced this one; delete it once nothing reads it any more
+    void retire() { retired = true; }
+
+    static unsigned long long nextGeneration() { return ++lastGeneration; }
+
+    bool lookup(IsbnKey key, Book& book) const {
+        if (height == 0) return false;
+        PageRef ref = root;
+        while (true) {
+            shared_ptr<const Page> page = fetch(ref);
+            if (!page) {
+                cerr << "Error: Unable to read a page of " << path << "!\n";
+                return false;
+            }
+            if (page->leaf) {
+                auto it = lower_bound(page->keys.begin(), page->keys.end(), key);
+                if (it == page->keys.end() || *it != key) return false;
+                book = page->books[it - page->keys.begin()];
+                return true;
+            }
+            auto it = upper_bound(page->keys.begin(), page->keys.end(), key);
+            if (it == page->keys.begin()) return false;
+            ref = page->children[it - page->keys.begin() - 1];
+        }
+    }
+
+    // Read the leaves front to back; a full scan does not go through the pool
+    void scan(const function<void(IsbnKey, const Book&)>& visit) const {
+        ifstream in(path, ios::in | ios::binary);
+        in.seekg(leafStart);
+        unsigned long long seen = 0;
+        while (seen < count && in) {
+            in.get();  // Page kind, always a leaf here
+            size_t entries = readVarint(in);
+            for (size_t i = 0; i < entries && in; i++, seen++) {
+                Book book;
+                IsbnKey key = readBook(in, book);
+                if (in) visit(key, book);
+            }
+        }
+        if (seen < count) {
+            cerr << "Error: " << path << " ended after " << seen << " of " << count << " books!\n";
+        }
+    }
+
+    // Bulk-load source into a new file at filePath
+    static bool build(const string& filePath, const BookStorage& source) {
+        ofstream out(filePath, ios::out | ios::binary | ios::trunc);
+        if (!out) {
+            events.record(EventLog::ERROR, "save.open_failed", {{"file", filePath}});
+            return false;
+        }
+        out.write(string(HEADER_SIZE, '\0').data(), HEADER_SIZE);
+
+        vector<PageRef> level;
+        ostringstream body;
+        size_t entries = 0;
+        IsbnKey firstKey = 0;
+        unsigned long long total = 0;
+        NameTable table;
+        source.forEach([&](IsbnKey key, const Book& book) {
+            if (entries == 0) firstKey = key;
+            writeBook(body, key, book, table);
+            entries++;
+            total++;
+            if (static_cast<size_t>(body.tellp()) >= PAGE_SIZE) {
+                writePage(out, 'L', entries, body.str(), firstKey, level);
+                body.str("");
+                entries = 0;
+            }
+        });
+        if (entries > 0) writePage(out, 'L', entries, body.str(), firstKey, level);
+        unsigned long long leaves = out.tellp();
+
+        // Each inner level indexes the one below until a single root is left
+        unsigned long long levels = level.empty() ? 0 : 1;
+        while (level.size() > 1) {
+            vector<PageRef> parents;
+            body.str("");
+            entries = 0;
+            for (const auto& child : level) {
+                if (entries == 0) firstKey = child.firstKey;
+                writeVarint(body, child.firstKey);
+                writeVarint(body, child.offset);
+                writeVarint(body, child.length);
+                entries++;
+                if (static_cast<size_t>(body.tellp()) >= PAGE_SIZE) {
+                    writePage(out, 'I', entries, body.str(), firstKey, parents);
+                    body.str("");
+                    entries = 0;
+                }
+            }
+            if (entries > 0) writePage(out, 'I', entries, body.str(), firstKey, parents);
+            level.swap(parents);
+            levels++;
+        }
+
+        // The names the books refer to, after the pages
+        unsigned long long tableOffset = out.tellp();
+        for (uint32_t id : table.ids) {
+            writeCompactString(out, catalogueStrings.lookup(id));
+        }
+
+        out.seekp(0);
+        out.write("LMSB", 4);
+        out.put(VERSION);
+        out.write("\0\0\0", 3);
+        writeFixed64(out, total);
+        writeFixed64(out, leaves);
+        writeFixed64(out, level.empty() ? 0 : level[0].offset);
+        writeFixed64(out, level.empty() ? 0 : level[0].length);
+        writeFixed64(out, levels);
+        writeFixed64(out, tableOffset);
+        writeFixed64(out, table.ids.size());
+        out.close();
+        return static_cast<bool>(out);
+    }
+};
+
+atomic<unsigned long long> BookPageFile::lastGeneration(0);
+
+// books-N.delta: the changes made since books-N.db was written, appended a
+// batch per save instead of rewriting the catalogue file. A batch is its
+// length, the changed books in key order (an erased book is just its key)
+// and a checksum, so a batch cut short by a crash is recognised on load,
+// dropped and cut off the file, and the next batch goes after the last good
+// one. Names are written out in full: the delta has no name table.
+class BookDeltaLog {
+public:
+    static string pathFor(const string& cataloguePath) {
+        return cataloguePath.substr(0, cataloguePath.rfind(".db")) + ".delta";
+    }
+
+    // Books are null for erased keys. On failure the file is cut back to
+    // where it was, so a half-written batch never hides a later one.
+    static bool append(const string& path, const vector<pair<IsbnKey, const Book*>>& batch) {
+        error_code ec;
+        unsigned long long before = filesystem::exists(path, ec) ? filesystem::file_size(path, ec) : 0;
+        if (ec) return false;
+
+        ostringstream body;
+        writeVarint(body, batch.size());
+        for (const auto& change : batch) {
+            body.put(change.second ? 'S' : 'E');
+            writeVarint(body, change.first);
+            if (!change.second) continue;
+            const Book& book = *change.second;
+            writeCompactString(body, book.getTitle());
+            writeCompactString(body, book.getAuthor());
+            writeCompactString(body, book.getPublisher());
+            writeSignedVarint(body, book.getYear());
+            body.put(static_cast<char>((book.isAvailable() ? 1 : 0) | (book.isReserved() ? 2 : 0)));
+        }
+        string bytes = body.str();
+        uint32_t checksum = BlockCodec::checksum(bytes.data(), bytes.size());
+
+        ofstream out(path, ios::out | ios::binary | ios::app);
+        if (before == 0) {
+            out.write("LMSD", 4);
+            out.put(1);
+        }
+        writeVarint(out, bytes.size());
+        out.write(bytes.data(), bytes.size());
+        for (int byte = 0; byte < 4; byte++) {
+            out.put(static_cast<char>((checksum >> (8 * byte)) & 0xFF));
+        }
+        out.close();
+        if (out) return true;
+        events.record(EventLog::ERROR, "save.failed", {{"file", path}});
+        if (before == 0) {
+            filesystem::remove(path, ec);
+        } else {
+            filesystem::resize_file(path, before, ec);
+        }
+        return false;
+    }
+
+    // Visit every change of every complete batch, oldest first
+    static void read(const string& path, const function<void(IsbnKey, const Book*)>& visit) {
+        ifstream file(path, ios::in | ios::binary);
+        if (!file) return;
+        string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        file.close();
+        if (data.size() < 5 || data.compare(0, 4, "LMSD") != 0 || data[4] != 1) {
+            events.record(EventLog::ERROR, "load.damaged", {{"file", path}, {"action", "ignored"}});
+            return;
+        }
+
+        istringstream in(data);
+        in.seekg(5);
+        size_t good = 5;
+        while (good < data.size()) {
+            unsigned long long length = readVarint(in);
+            size_t start = in ? static_cast<size_t>(in.tellg()) : data.size();
+            if (!in || length + 4 > data.size() - start) break;
+            uint32_t checksum = 0;
+            for (int byte = 0; byte < 4; byte++) {
+                checksum |= static_cast<uint32_t>(static_cast<unsigned char>(data[start + length + byte])) << (8 * byte);
+            }
+            if (checksum != BlockCodec::checksum(data.data() + start, length)) break;
+
+            istringstream batch(data.substr(start, length));
+            unsigned long long changes = readVarint(batch);
+            for (unsigned long long i = 0; i < changes && batch; i++) {
+                char kind = static_cast<char>(batch.get());
+                IsbnKey key = readVarint(batch);
+                if (kind != 'S') {
+                    visit(key, nullptr);
+                    continue;
+                }
+                string title = readCompactString(batch);
+                string author = readCompactString(batch);
+                string publisher = readCompactString(batch);
+                int year = static_cast<int>(readSignedVarint(batch));
+                int flags = batch.get();
+                Book book(title, author, publisher, year, unpackIsbn(key), flags & 1);
+                book.setReserved(flags & 2);
+                visit(key, &book);
+            }
+            good = start + length + 4;
+            in.seekg(good);
+        }
+        if (good < data.size()) {
+            events.record(EventLog::WARN, "load.damaged", {{"file", path}, {"action", "dropped an unfinished batch"}});
+            error_code ec;
+            filesystem::resize_file(path, good, ec);
+        }
+    }
+};
+
+// The catalogue kept on disk: the newest books-N.db plus the changes made
+// since it was written. The changes stay in memory and each save appends
+// the new ones to books-N.delta (see BookDeltaLog), which costs what changed
+// rather than the size of the catalogue. Once the delta has grown to
+// 1/MERGE_SHARE of the file (and MERGE_MIN_BYTES), the background writer
+// merges everything into books-(N+1).db and the file is adopted here, in
+// the manner of a log-structured merge tree. Opening it at startup reads
+// one file header and the delta however large the catalogue is. A
+// version's snapshot shares the file and the chunks of the change map.
+class PagedBookStorage : public BookStorage {
+private:
+    static constexpr unsigned long long MERGE_SHARE = 4;
+    static constexpr unsigned long long MERGE_MIN_BYTES = 1 << 20;
+
+    struct Change {
+        unsigned long long seq;
+        bool erased;
+        Book book;
+    };
+
+    mutable mutex m;  // The writer adopts new files from its own thread
+    shared_ptr<BookPageFile> base;  // Null until a file has been written
+    vector<shared_ptr<BookPageFile>> superseded;  // Dropped by clear(), retired on the next adopt
+    SharedChunks<IsbnKey, Change> changes;
+    unsigned long long loggedSeq;  // Changes up to this one are in base's delta
+    unsigned long long nextSeq;
+    unsigned long long clears;
+    size_t count;
+    PagedBookStorage* origin;  // For a snapshot, the live storage it was taken from
+
+    bool findLocked(IsbnKey key, Book& book) const {
+        const Change* change = changes.find(key);
+        if (change) {
+            if (change->erased) return false;
+            book = change->book;
+            return true;
+        }
+        return base && base->lookup(key, book);
+    }
+
+    static void retire(const shared_ptr<BookPageFile>& file) {
+        error_code ec;
+        filesystem::remove(BookDeltaLog::pathFor(file->getPath()), ec);
+        file->retire();
+    }
+
+    // Whether this snapshot's file is still the live one, and if so how far its delta goes
+    bool loggedFor(const shared_ptr<BookPageFile>& expected, unsigned long long snapshotClears,
+                   unsigned long long& logged) {
+        lock_guard<mutex> lock(m);
+        logged = loggedSeq;
+        return base == expected && clears == snapshotClears;
+    }
+
+    // Called once the changes up to seq are in the delta of the snapshot's file
+    void logged(const shared_ptr<BookPageFile>& expected, unsigned long long snapshotClears,
+                unsigned long long seq) {
+        lock_guard<mutex> lock(m);
+        if (base == expected && clears == snapshotClears) loggedSeq = max(loggedSeq, seq);
+    }
+
+    // Called with the file written from a snapshot holding changes up to coveredSeq
+    void adopt(const shared_ptr<BookPageFile>& expected, unsigned long long snapshotClears,
+               const shared_ptr<BookPageFile>& written, unsigned long long coveredSeq) {
+        lock_guard<mutex> lock(m);
+        if (base != expected || clears != snapshotClears) {
+            written->retire();  // Written from contents that have since been replaced
+            return;
+        }
+        if (base) retire(base);
+        for (auto& file : superseded) {
+            retire(file);
+        }
+        superseded.clear();
+        base = written;
+        loggedSeq = coveredSeq;
+        vector<IsbnKey> covered;
+        changes.forEach([&](IsbnKey key, const Change& change) {
+            if (change.seq <= coveredSeq) covered.push_back(key);
+        });
+        for (IsbnKey key : covered) {
+            changes.erase(key);
+        }
+    }
+
+    // Bring a books-N.db up to date from the changes in its delta
+    void applyLogged(IsbnKey key, const Book* book) {
+        Book existing;
+        bool found = findLocked(key, existing);
+        if (book) {
+            if (!found) count++;
+            changes[key] = Change{nextSeq++, false, *book};
+        } else if (found) {
+            changes[key] = Change{nextSeq++, true, Book()};
+            count--;
+        }
+    }
+
+    // Whether the next save should merge rather than append to the delta
+    bool deltaTooLarge() const {
+        error_code ec;
+        unsigned long long delta = filesystem::file_size(BookDeltaLog::pathFor(base->getPath()), ec);
+        if (ec) return false;
+        unsigned long long file = filesystem::file_size(base->getPath(), ec);
+        return delta >= MERGE_MIN_BYTES && (ec || delta >= file / MERGE_SHARE);
+    }
+
+    // Write everything into a new books-N.db and hand it to the live storage
+    void merge() const {
+        unsigned long long generation = BookPageFile::nextGeneration();
+        string path = "books-" + to_string(generation) + ".db";
+        if (!BookPageFile::build(path + ".tmp", *this)) return;
+        error_code ec;
+        filesystem::rename(path + ".tmp", path, ec);
+        if (ec) {
+            cerr << "Error: Unable to replace " << path << ": " << ec.message() << "\n";
+            return;
+        }
+        auto written = make_shared<BookPageFile>(path, generation);
+        if (!written->isValid()) {
+            cerr << "Error: " << path << " could not be read back!\n";
+            written->retire();
+            return;
+        }
+        origin->adopt(base, clears, written, nextSeq - 1);
+    }
+
+public:
+    PagedBookStorage(shared_ptr<BookPageFile> file = nullptr)
+        : base(file), loggedSeq(0), nextSeq(1), clears(0), count(file ? file->size() : 0), origin(nullptr) {}
+
+    // Read back the changes saved in the file's delta, at startup
+    void loadDelta() {
+        lock_guard<mutex> lock(m);
+        if (!base) return;
+        BookDeltaLog::read(BookDeltaLog::pathFor(base->getPath()),
+                           [&](IsbnKey key, const Book* book) { applyLogged(key, book); });
+        loggedSeq = nextSeq - 1;
+    }
+
+    bool find(IsbnKey key, Book& book) const override {
+        lock_guard<mutex> lock(m);
+        return findLocked(key, book);
+    }
+
+    void store(IsbnKey key, const Book& book) override {
+        lock_guard<mutex> lock(m);
+        Book existing;
+        if (!findLocked(key, existing)) count++;
+        changes[key] = Change{nextSeq++, false, book};
+    }
+
+    bool erase(IsbnKey key) override {
+        lock_guard<mutex> lock(m);
+        Book existing;
+        if (!findLocked(key, existing)) return false;
+        changes[key] = Change{nextSeq++, true, Book()};
+        count--;
+        return true;
+    }
+
+    // Merge the file with the pending changes, both in key order
+    void forEach(const function<void(IsbnKey, const Book&)>& visit) const override {
+        shared_ptr<BookPageFile> file;
+        SharedChunks<IsbnKey, Change> held;  // Keeps the chunks pending points into
+        {
+            lock_guard<mutex> lock(m);
+            file = base;
+            held = changes;
+        }
+        vector<pair<IsbnKey, const Change*>> pending;
+        pending.reserve(held.size());
+        held.forEach([&](IsbnKey key, const Change& change) { pending.push_back({key, &change}); });
+
+        auto next = pending.begin();
+        auto emitBefore = [&](IsbnKey key, bool inclusive) {
+            while (next != pending.end() && (next->first < key || (inclusive && next->first == key))) {
+                if (!next->second->erased) visit(next->first, next->second->book);
+                ++next;
+            }
+        };
+        if (file) {
+            file->scan([&](IsbnKey key, const Book& book) {
+                emitBefore(key, false);
+                if (next != pending.end() && next->first == key) {
+                    emitBefore(key, true);  // The change replaces the stored book
+                } else {
+                    visit(key, book);
+                }
+            });
+        }
+        while (next != pending.end()) {
+            if (!next->second->erased) visit(next->first, next->second->book);
+            ++next;
+        }
+    }
+
+    size_t size() const override {
+        lock_guard<mutex> lock(m);
+        return count;
+    }
+
+    void clear() override {
+        lock_guard<mutex> lock(m);
+        if (base) superseded.push_back(base);
+        base.reset();
+        changes.clear();
+        loggedSeq = 0;
+        count = 0;
+        clears++;
+    }
+
+    bool isPaged() const override { return true; }
+
+    shared_ptr<const BookStorage> snapshot() const override {
+        lock_guard<mutex> lock(m);
+        auto copy = make_shared<PagedBookStorage>(base);
+        copy->changes = changes;
+        copy->loggedSeq = loggedSeq;
+        copy->nextSeq = nextSeq;
+        copy->clears = clears;
+        copy->count = count;
+        copy->origin = origin ? origin : const_cast<PagedBookStorage*>(this);
+        return copy;
+    }
+
+    // Append the changes made since the last save to books-N.delta, or merge
+    // into a new books-N.db when there is no file yet or the delta is large
+    void save() const override {
+        if (!origin) {
+            snapshot()->save();
+            return;
+        }
+        unsigned long long logged;
+        if (base && origin->loggedFor(base, clears, logged) && !deltaTooLarge()) {
+            if (logged >= nextSeq - 1) return;  // Nothing new since the last save
+            vector<pair<IsbnKey, const Book*>> batch;
+            changes.forEach([&](IsbnKey key, const Change& change) {
+                if (change.seq > logged) batch.push_back({key, change.erased ? nullptr : &change.book});
+            });
+            if (BookDeltaLog::append(BookDeltaLog::pathFor(base->getPath()), batch)) {
+                origin->logged(base, clears, nextSeq - 1);
+                return;
+            }
+        }
+        merge();
+    }
+};
+
+unique_ptr<BookStorage> books(new MemoryBookStorage());
+bool pagedStorage = false;  // Convert books.txt to a paged books-N.db
+
+// "Patrons who borrowed this also borrowed": a sparse item-to-item
+// co-occurrence matrix over borrowing histories (how many patrons have
+// borrowed both books) with the top K neighbours of every ISBN kept
+// precomputed, so a lookup never scans histories. Built in parallel across
+// accounts at load time and kept current from Account::addToHistory, and
+// from the paths that remove patrons or prune history.
+class RecommendationEngine {
+private:
+    typedef map<string, map<string, int>> CoOccurrence;
+    CoOccurrence coCounts;                              // ISBN -> ISBN -> patrons
+    map<string, vector<pair<string, int>>> topNeighbours;  // ISBN -> best K, highest first
+
+    static constexpr size_t TOP_K = 5;
+
+    static bool ranksBefore(const pair<string, int>& a, const pair<string, int>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    }
+
+    static void addPatron(CoOccurrence& counts, const vector<string>& distinctIsbns) {
+        for (const auto& a : distinctIsbns) {
+            for (const auto& b : distinctIsbns) {
+                if (a != b) counts[a][b]++;
+            }
+        }
+    }
+
+    void rankNeighbours(const string& isbn) {
+        auto row = coCounts.find(isbn);
+        if (row == coCounts.end()) {
+            topNeighbours.erase(isbn);
+            return;
+        }
+        auto& top = topNeighbours[isbn];
+        top.assign(row->second.begin(), row->second.end());
+        size_t keep = min(TOP_K, top.size());
+        partial_sort(top.begin(), top.begin() + keep, top.end(), ranksBefore);
+        top.resize(keep);
+    }
+
+    // A grown count either moves within the top K or has to beat the
+    // current last place
+    void bumpNeighbour(const string& isbn, const string& neighbour, int count) {
+        auto& top = topNeighbours[isbn];
+        auto it = find_if(top.begin(), top.end(),
+                          [&](const pair<string, int>& entry) { return entry.first == neighbour; });
+        if (it != top.end()) {
+            it->second = count;
+        } else if (top.size() < TOP_K) {
+            top.push_back({neighbour, count});
+        } else if (ranksBefore({neighbour, count}, top.back())) {
+            top.back() = {neighbour, count};
+        } else {
+            return;
+        }
+        sort(top.begin(), top.end(), ranksBefore);
+    }
+
+public:
+    // Rebuild from every account's history, one partial matrix per thread
+    void build(const vector<const vector<pair<string, int>>*>& histories) {
+        unsigned numThreads = max(1u, min(thread::hardware_concurrency(), 8u));
+        vector<CoOccurrence> partial(numThreads);
+        vector<thread> workers;
+        for (unsigned t = 0; t < numThreads; t++) {
+            workers.emplace_back([&, t]() {
+                for (size_t i = t; i < histories.size(); i += numThreads) {
+                    vector<string> distinctIsbns;
+                    for (const auto& entry : *histories[i]) {
+                        distinctIsbns.push_back(entry.first);
+                    }
+                    sort(distinctIsbns.begin(), distinctIsbns.end());
+                    distinctIsbns.erase(unique(distinctIsbns.begin(), distinctIsbns.end()), distinctIsbns.end());
+                    addPatron(partial[t], distinctIsbns);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        coCounts.clear();
+        topNeighbours.clear();
+        for (const auto& counts : partial) {
+            for (const auto& row : counts) {
+                for (const auto& cell : row.second) {
+                    coCounts[row.first][cell.first] += cell.second;
+                }
+            }
+        }
+        for (const auto& row : coCounts) {
+            rankNeighbours(row.first);
+        }
+    }
+
+    // Called before isbn is appended to a patron's history
+    void addToHistory(const vector<pair<string, int>>& history, const string& isbn) {
+        vector<string> others;
+        for (const auto& entry : history) {
+            if (entry.first == isbn) return;  // Already counted for this patron
+            others.push_back(entry.first);
+        }
+        sort(others.begin(), others.end());
+        others.erase(unique(others.begin(), others.end()), others.end());
+
+        for (const auto& other : others) {
+            int count = ++coCounts[isbn][other];
+            ++coCounts[other][isbn];
+            bumpNeighbour(isbn, other, count);
+            bumpNeighbour(other, isbn, count);
+        }
+    }
+
+    // Called when a patron and their history are removed
+    void removePatron(const vector<pair<string, int>>& history) {
+        vector<string> distinctIsbns;
+        for (const auto& entry : history) {
+            distinctIsbns.push_back(entry.first);
+        }
+        sort(distinctIsbns.begin(), distinctIsbns.end());
+        distinctIsbns.erase(unique(distinctIsbns.begin(), distinctIsbns.end()), distinctIsbns.end());
+
+        for (const auto& a : distinctIsbns) {
+            auto row = coCounts.find(a);
+            if (row == coCounts.end()) continue;
+            for (const auto& b : distinctIsbns) {
+                auto cell = row->second.find(b);
+                if (cell != row->second.end() && --cell->second == 0) row->second.erase(cell);
+            }
+            if (row->second.empty()) coCounts.erase(row);
+        }
+        // A lowered count can drop out of the top K, so those are re-ranked
+        for (const auto& a : distinctIsbns) {
+            auto top = topNeighbours.find(a);
+            if (top == topNeighbours.end()) continue;
+            bool affected = any_of(top->second.begin(), top->second.end(), [&](const pair<string, int>& entry) {
+                return binary_search(distinctIsbns.begin(), distinctIsbns.end(), entry.first);
+            });
+            if (affected) rankNeighbours(a);
+        }
+    }
+
+    // Called when the given books are pruned from every patron's history
+    void removeBooks(const unordered_set<IsbnKey>& gone) {
+        vector<string> removed;
+        for (const auto& row : coCounts) {
+            if (gone.count(packIsbn(row.first))) removed.push_back(row.first);
+        }
+        set<string> reranked;
+        for (const auto& isbn : removed) {
+            for (const auto& cell : coCounts[isbn]) {
+                auto row = coCounts.find(cell.first);
+                if (row == coCounts.end()) continue;
+                row->second.erase(isbn);
+                if (row->second.empty()) coCounts.erase(row);
+                reranked.insert(cell.first);
+            }
+            coCounts.erase(isbn);
+            topNeighbours.erase(isbn);
+        }
+        for (const auto& isbn : reranked) {
+            rankNeighbours(isbn);
+        }
+    }
+
+    const vector<pair<string, int>>& recommend(const string& isbn) const {
+        static const vector<pair<string, int>> none;
+        auto it = topNeighbours.find(isbn);
+        return it != topNeighbours.end() ? it->second : none;
+    }
+
+    void clear() {
+        coCounts.clear();
+        topNeighbours.clear();
+    }
+};
+
+RecommendationEngine recommender;
+
+void displayRecommendations(const string& isbn) {
+    const auto& neighbours = recommender.recommend(isbn);
+    if (neighbours.empty()) return;
+    cout << "\nPatrons who borrowed this also borrowed:\n";
+    for (const auto& neighbour : neighbours) {
+        Book book;
+        if (!books->find(packIsbn(neighbour.first), book)) continue;
+        cout << "- " << book.getTitle() << " (ISBN: " << neighbour.first << ", "
+             << (book.isAvailable() ? "Available" : "Borrowed") << ")\n";
+    }
+}
+
+// Every loan ordered by due date, kept current by the Account loan
+// primitives, so "everything due between A and B" is a range scan instead
+// of a walk over every account.
+class DueDateIndex {
+public:
+    struct Loan {
+        int dueDate;
+        string userId;
+        IsbnKey isbn;
+
+        bool operator<(const Loan& other) const {
+            return tie(dueDate, userId, isbn) < tie(other.dueDate, other.userId, other.isbn);
+        }
+    };
+
+private:
+    set<Loan> loans;
+
+public:
+    void add(int dueDate, const string& userId, IsbnKey isbn) {
+        loans.insert({dueDate, userId, isbn});
+    }
+
+    void remove(int dueDate, const string& userId, IsbnKey isbn) {
+        loans.erase({dueDate, userId, isbn});
+    }
+
+    // Drop all of a user's loans (the account is being deleted)
+    void removeAll(const string& userId, const map<IsbnKey, int>& borrowed) {
+        for (const auto& loan : borrowed) {
+            remove(loan.second, userId, loan.first);
+        }
+    }
+
+    void clear() { loans.clear(); }
+    size_t size() const { return loans.size(); }
+    bool contains(int dueDate, const string& userId, IsbnKey isbn) const {
+        return loans.count({dueDate, userId, isbn}) > 0;
+    }
+
+    // Loans with from <= due date < until, in due date order
+    vector<Loan> range(int from, int until) const {
+        vector<Loan> due;
+        for (auto it = loans.lower_bound({from, "", 0}); it != loans.end() && it->dueDate < until; ++it) {
+            due.push_back(*it);
+        }
+        return due;
+    }
+};
+
+DueDateIndex dueIndex;
+
+// Circulation statistics kept up to date as books are lent and returned, so
+// questions like "average loan length for faculty" or "how often is this
+// title borrowed" are answered without reading every account. Totals are
+// kept per user, per title and per role; each loan start and end updates
+// three of them. Loans and returns from before the statistics were
+// kept (seeded from the borrowing histories) count as borrows and returns
+// but have no known length or lateness, so averages and late rates only
+// use the returns that were timed. A loan counts as late if it comes back
+// after its due date or was reissued after it (a student paying the fine).
+struct CirculationTotals {
+    long long borrows = 0;
+    long long returns = 0;
+    long long timedReturns = 0;  // Returns whose loan start is known
+    long long loanSeconds = 0;   // Summed over the timed returns
+    long long lateReturns = 0;   // Timed returns after the due date
+    int lastBorrowed = 0;
+
+    void borrowed(int time) {
+        borrows++;
+        lastBorrowed = max(lastBorrowed, time);
+    }
+
+    void returned(long long seconds, bool late) {
+        returns++;
+        timedReturns++;
+        loanSeconds += seconds;
+        if (late) lateReturns++;
+    }
+
+    void write(ostream &out) const {
+        out << borrows << " " << returns << " " << timedReturns << " " << loanSeconds << " "
+            << lateReturns << " " << lastBorrowed;
+    }
+
+    void read(istream &in) {
+        in >> borrows >> returns >> timedReturns >> loanSeconds >> lateReturns >> lastBorrowed;
+    }
+};
+
+class CirculationStats {
+private:
+    struct OpenLoan {
+        int since;
+        bool late;  // Reissued after its due date
+    };
+
+    struct UserStats {
+        CirculationTotals totals;
+        unordered_map<IsbnKey, OpenLoan> open;  // The current loans
+    };
+
+    SharedChunks<string, UserStats> users;
+    SharedChunks<IsbnKey, CirculationTotals> titles;
+    CirculationTotals roles[2];  // Student, faculty
+
+public:
+    void loanStarted(const string& userId, IsbnKey isbn, bool faculty, int time) {
+        UserStats& user = users[userId];
+        user.totals.borrowed(time);
+        user.open[isbn] = {time, false};
+        titles[isbn].borrowed(time);
+        roles[faculty].borrowed(time);
+    }
+
+    void loanRenewed(const string& userId, IsbnKey isbn, int dueDate, int time) {
+        if (time <= dueDate) return;
+        UserStats* user = users.findWritable(userId);
+        if (!user) return;
+        auto loan = user->open.find(isbn);
+        if (loan != user->open.end()) loan->second.late = true;
+    }
+
+    void loanEnded(const string& userId, IsbnKey isbn, bool faculty, int dueDate, int time) {
+        UserStats& user = users[userId];
+        auto loan = user.open.find(isbn);
+        if (loan == user.open.end()) return;  // Not a loan this account had
+        long long seconds = max(0, time - loan->second.since);
+        bool late = time > dueDate || loan->second.late;
+        user.open.erase(loan);
+        user.totals.returned(seconds, late);
+        titles[isbn].returned(seconds, late);
+        roles[faculty].returned(seconds, late);
+    }
+
+    // Start from an account's history and loans, for data saved before statistics were kept
+    void seed(const string& userId, bool faculty, int loanDays,
+              const vector<pair<string, int>>& history, const map<IsbnKey, int>& loans) {
+        UserStats& user = users[userId];
+        for (const auto& entry : history) {
+            CirculationTotals* totals[] = {&user.totals, &titles[packIsbn(entry.first)], &roles[faculty]};
+            for (CirculationTotals* t : totals) {
+                t->borrows++;
+                t->returns++;
+            }
+        }
+        for (const auto& loan : loans) {
+            int start = loan.second - loanDays * 24 * 60 * 60;
+            user.totals.borrowed(start);
+            user.open[loan.first] = {start, false};
+            titles[loan.first].borrowed(start);
+            roles[faculty].borrowed(start);
+        }
+    }
+
+    void clear() {
+        users.clear();
+        titles.clear();
+        roles[0] = roles[1] = CirculationTotals();
+    }
+
+    const CirculationTotals* forUser(const string& userId) const {
+        const UserStats* user = users.find(userId);
+        return user ? &user->totals : nullptr;
+    }
+
+    const CirculationTotals* forTitle(IsbnKey isbn) const {
+        return titles.find(isbn);
+    }
+
+    const CirculationTotals& forRole(bool faculty) const { return roles[faculty]; }
+
+    static void print(const CirculationTotals& totals) {
+        cout << "Borrows: " << totals.borrows;
+        if (totals.lastBorrowed > 0) {
+            time_t last = totals.lastBorrowed;
+            char lastStr[26];
+            strftime(lastStr, sizeof(lastStr), "%Y-%m-%d %H:%M:%S", localtime(&last));
+            cout << " (last on " << lastStr << ")";
+        }
+        cout << "\nReturns: " << totals.returns << "\n";
+        if (totals.timedReturns > 0) {
+            double days = totals.loanSeconds / (24.0 * 60 * 60) / totals.timedReturns;
+            double lateRate = 100.0 * totals.lateReturns / totals.timedReturns;
+            cout << "Average loan length: " << round(days * 10) / 10 << " days\n"
+                 << "Late returns: " << totals.lateReturns << " of " << totals.timedReturns << " ("
+                 << round(lateRate * 10) / 10 << "%)\n";
+        } else {
+            cout << "Average loan length: no timed returns yet\n";
+        }
+    }
+
+    // The count most borrowed titles, most borrowed first
+    vector<pair<IsbnKey, const CirculationTotals*>> mostBorrowed(size_t count) const {
+        vector<pair<IsbnKey, const CirculationTotals*>> ranked;
+        titles.forEach([&](IsbnKey isbn, const CirculationTotals& totals) { ranked.push_back({isbn, &totals}); });
+        auto byBorrows = [](const pair<IsbnKey, const CirculationTotals*>& a,
+                            const pair<IsbnKey, const CirculationTotals*>& b) {
+            return a.second->borrows != b.second->borrows ? a.second->borrows > b.second->borrows : a.first < b.first;
+        };
+        count = min(count, ranked.size());
+        partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(), byBorrows);
+        ranked.resize(count);
+        return ranked;
+    }
+
+    void write(ostream &out) const {
+        for (const auto& role : roles) {
+            role.write(out);
+            out << "\n";
+        }
+        out << titles.size() << "\n";
+        titles.forEach([&](IsbnKey isbn, const CirculationTotals& totals) {
+            out << unpackIsbn(isbn) << " ";
+            totals.write(out);
+            out << "\n";
+        });
+        out << users.size() << "\n";
+        users.forEach([&](const string& userId, const UserStats& user) {
+            out << userId << "\n";
+            user.totals.write(out);
+            out << " " << user.open.size();
+            for (const auto& loan : user.open) {
+                out << " " << unpackIsbn(loan.first) << " " << loan.second.since << " " << loan.second.late;
+            }
+            out << "\n";
+        });
+    }
+
+    void read(istream &in) {
+        clear();
+        for (auto& role : roles) {
+            role.read(in);
+        }
+        size_t numTitles;
+        in >> numTitles;
+        for (size_t i = 0; i < numTitles && in; i++) {
+            string isbn;
+            in >> isbn;
+            IsbnKey key = loadIsbn(isbn, "circulation.txt");
+            CirculationTotals skipped;
+            (key == INVALID_ISBN ? skipped : titles[key]).read(in);
+        }
+        size_t numUsers;
+        in >> numUsers;
+        in.ignore();
+        for (size_t i = 0; i < numUsers && in; i++) {
+            string userId;
+            getline(in, userId);
+            UserStats& user = users[userId];
+            user.totals.read(in);
+            size_t numOpen;
+            in >> numOpen;
+            for (size_t j = 0; j < numOpen && in; j++) {
+                string isbn;
+                OpenLoan loan;
+                in >> isbn >> loan.since >> loan.late;
+                IsbnKey key = loadIsbn(isbn, "circulation.txt");
+                if (key != INVALID_ISBN) user.open[key] = loan;
+            }
+            in.ignore();
+        }
+    }
+};
+
+CirculationStats circulation;
+
+class Account {
+private:
+    friend class User;  // Allow User class to access private members
+    string userID;
+    map<IsbnKey, int> borrowedBooks;  // ISBN -> due date in seconds
+    map<IsbnKey, int> lastFinePaidTime;  // ISBN -> last fine paid time in seconds
+    mutable map<IsbnKey, Paise> bookFines;  // ISBN -> current fine amount
+    mutable Paise totalFine;
+    bool isFaculty;
+    int maxBooks;
+    int maxDays;
+    vector<pair<string, int>> borrowingHistory;
+
+    // Cached fine state: the fines computed by updateFines stay correct for
+    // every date in [fineValidFrom, fineValidUntil), i.e. until some loan's
+    // overdue day count changes. Loan mutations drop the cache.
+    mutable bool fineCacheValid;
+    mutable long long fineValidFrom;
+    mutable long long fineValidUntil;
+
+    // Stamp of the last change to anything saved; a copy keeps the stamp, so
+    // a version can go on sharing the copy it took while they still match
+    mutable unsigned long long revision;
+    static atomic<unsigned long long> lastRevision;
+
+    void invalidateFines() { fineCacheValid = false; }
+    void changed() const {
+        revision = ++lastRevision;
+        markAccountChanged(userID);
+    }
+
+    // Every change to a book's fine goes through here so that it is written
+    // to the ledger: increases are charges, decreases are recorded as `reduction`
+    void setBookFine(IsbnKey isbn, Paise fine, int currentDate, char reduction) const {
+        auto it = bookFines.find(isbn);
+        Paise previous = (it != bookFines.end()) ? it->second : 0;
+        if (fine == previous) return;
+        changed();
+        if (fine > previous) {
+            fineLedger.append(userID, {currentDate, FineLedgerEntry::CHARGE, fine - previous, unpackIsbn(isbn)});
+        } else {
+            fineLedger.append(userID, {currentDate, reduction, previous - fine, unpackIsbn(isbn)});
+        }
+        if (fine > 0) bookFines[isbn] = fine;
+        else bookFines.erase(it);
+        totalFine += fine - previous;
+    }
+
+    // Bring the ledger in line with fines read from a data file
+    void reconcileLedger(int currentDate) const {
+        Paise difference = totalFine - fineLedger.balance(userID);
+        if (difference > 0) {
+            fineLedger.append(userID, {currentDate, FineLedgerEntry::CHARGE, difference, ""});
+        } else if (difference < 0) {
+            fineLedger.append(userID, {currentDate, FineLedgerEntry::WAIVER, -difference, ""});
+        }
+    }
+
+public:
+    Account(string id = "", bool faculty = false) 
+        : userID(id), totalFine(0), isFaculty(faculty), 
+          maxBooks(faculty ? 5 : 3),  // Faculty can borrow 5 books, students 3
+          maxDays(faculty ? 30 : 15),  // Faculty gets 30 days, students 15
+          fineCacheValid(false), fineValidFrom(0), fineValidUntil(0), revision(++lastRevision) {}
+
+    string getUserID() const { return userID; }
+    unsigned long long getRevision() const { return revision; }
+    Paise getTotalFine() const { return totalFine; }
+    const map<IsbnKey, int>& getBorrowedBooks() const { return borrowedBooks; }
+    int getMaxBooks() const { return maxBooks; }
+    int getMaxDays() const { return maxDays; }
+    bool isFacultyMember() const { return isFaculty; }
+    const vector<pair<string, int>>& getBorrowingHistory() const { return borrowingHistory; }
+
+    Paise getBookFine(const string& isbn) const {
+        auto it = bookFines.find(packIsbn(isbn));
+        return (it != bookFines.end()) ? it->second : 0;
+    }
+
+    // Pay off one book's fine without any checks (used by operation replay)
+    void settleBookFine(const string& isbn, int currentDate) {
+        setBookFine(packIsbn(isbn), 0, currentDate, FineLedgerEntry::PAYMENT);
+        invalidateFines();
+    }
+
+    bool payBookFine(const string& isbn, Paise amount, int currentDate) {
+        // Recalculate fines before payment
+        updateFines(currentDate);
+        
+        if (!isFaculty) {  // Faculty members don't pay fines
+            Paise fine = getBookFine(isbn);
+            if (fine == 0 || amount != fine) {
+                cout << "\nPayment REJECTED!\n";
+                cout << "Please pay the exact fine amount for this book: " << formatRupees(fine) << " rupees\n";
+                return false;
+            }
+
+            cout << "\n=== Fine Payment Details ===\n";
+            cout << "Book Fine amount: " << formatRupees(fine) << " rupees\n";
+            cout << "Payment amount: " << formatRupees(amount) << " rupees\n";
+            
+            // Remove the fine and reset due date
+            settleBookFine(isbn, currentDate);
+            
+            // Set new due date (using actual days)
+            int newDueDate = reissueLoan(isbn, currentDate);
+            opLog.record("REISSUE", {userID, isbn, to_string(currentDate)});
+            events.record(EventLog::INFO, "loan.reissued", {{"user", userID}, {"isbn", isbn}, {"due", newDueDate}});
+            
+            cout << "\nPayment ACCEPTED!\n";
+            cout << "Fine of " << formatRupees(amount) << " rupees has been paid for this book.\n";
+            cout << "Book has been reissued with new due date.\n";
+            
+            // Convert due date to human-readable format
+            time_t dueTime = newDueDate;
+            struct tm* dueTm = localtime(&dueTime);
+            char dueStr[26];
+            strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
+            cout << "New due date: " << dueStr << "\n";
+            cout << "Remaining total fine: " << formatRupees(totalFine) << " rupees\n";
+            
+            return true;
+        }
+        // For faculty members, just reissue the book without requiring payment
+        int newDueDate = reissueLoan(isbn, currentDate);
+        opLog.record("REISSUE", {userID, isbn, to_string(currentDate)});
+        events.record(EventLog::INFO, "loan.reissued", {{"user", userID}, {"isbn", isbn}, {"due", newDueDate}});
+        
+        // Convert due date to human-readable format
+        time_t dueTime = newDueDate;
+        struct tm* dueTm = localtime(&dueTime);
+        char dueStr[26];
+        strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
+        
+        cout << "\nBook has been reissued.\n";
+        cout << "New due date: " << dueStr << "\n";
+        return true;
+    }
+
+    bool payFine(Paise amount, int currentDate) {
+        // Faculty members don't need to pay fines
+        if (isFaculty) {
+            cout << "\nFaculty members do not incur fines.\n";
+            return true;
+        }
+        
+        // Recalculate fines before payment
+        updateFines(currentDate);
+        
+        cout << "\n=== Fine Payment Details ===\n";
+        cout << "Total fine amount: " << formatRupees(totalFine) << " rupees\n";
+        cout << "Payment amount: " << formatRupees(amount) << " rupees\n";
+
+        if (amount != totalFine) {
+            events.record(EventLog::INFO, "fine.payment_rejected",
+                          {{"user", userID}, {"amount_paise", amount}, {"fine_paise", totalFine}});
+        }
+        if (amount < totalFine) {
+            cout << "\nPayment REJECTED!\n";
+            cout << "Payment amount is less than the total fine.\n";
+            cout << "Remaining amount to pay: " << formatRupees(totalFine - amount) << " rupees\n";
+            cout << "Please pay the exact amount of " << formatRupees(totalFine) << " rupees.\n";
+            return false;
+        }
+        if (amount > totalFine) {
+            cout << "\nPayment REJECTED!\n";
+            cout << "Payment amount is more than the total fine.\n";
+            cout << "Excess amount: " << formatRupees(amount - totalFine) << " rupees\n";
+            cout << "Please pay the exact amount of " << formatRupees(totalFine) << " rupees.\n";
+            return false;
+        }
+        
+        cout << "\nPayment ACCEPTED!\n";
+        cout << "Fine of " << formatRupees(totalFine) << " rupees has been paid successfully.\n";
+
+        // Record the payment against every fined book before reissuing
+        vector<IsbnKey> finedBooks;
+        for (const auto& fine : bookFines) {
+            finedBooks.push_back(fine.first);
+        }
+        for (IsbnKey isbn : finedBooks) {
+            setBookFine(isbn, 0, currentDate, FineLedgerEntry::PAYMENT);
+        }
+        invalidateFines();
+        
+        // Update last fine paid time and reissue all books with new due dates
+        for (auto& book : borrowedBooks) {
+            int newDueDate = reissueLoan(unpackIsbn(book.first), currentDate);
+            
+            // Convert due date to human-readable format for display
+            time_t dueTime = newDueDate;
+            struct tm* dueTm = localtime(&dueTime);
+            char dueStr[26];
+            strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
+            
+            cout << "\nBook " << unpackIsbn(book.first) << " has been reissued.\n";
+            cout << "New due date: " << dueStr << "\n";
+        }
+        
+        opLog.record("PAY_FINE", {userID, to_string(currentDate)});
+        events.record(EventLog::INFO, "fine.paid", {{"user", userID}, {"books", borrowedBooks.size()}});
+        
+        return true;
+    }
+
+    void addToHistory(const string& isbn, int returnDate) {
+        recommender.addToHistory(borrowingHistory, isbn);
+        borrowingHistory.push_back({isbn, returnDate});
+        changed();
+    }
+
+    // Drop the history entries of the given books; returns how many went
+    size_t removeHistoryOf(const unordered_set<IsbnKey>& gone) {
+        size_t before = borrowingHistory.size();
+        changed();
+        borrowingHistory.erase(remove_if(borrowingHistory.begin(), borrowingHistory.end(),
+                                         [&](const pair<string, int>& entry) { return gone.count(packIsbn(entry.first)) > 0; }),
+                               borrowingHistory.end());
+        return before - borrowingHistory.size();
+    }
+
+    // Loan primitives shared by the borrow/return paths and operation replay
+    void addLoan(const string& isbn, int dueDate) {
+        IsbnKey key = packIsbn(isbn);
+        auto it = borrowedBooks.find(key);
+        if (it != borrowedBooks.end()) {
+            dueIndex.remove(it->second, userID, key);
+        } else {
+            circulation.loanStarted(userID, key, isFaculty, dueDate - maxDays * 24 * 60 * 60);
+        }
+        borrowedBooks[key] = dueDate;
+        dueIndex.add(dueDate, userID, key);
+        invalidateFines();
+        changed();
+    }
+
+    void removeLoan(const string& isbn, int currentDate) {
+        IsbnKey key = packIsbn(isbn);
+        auto it = borrowedBooks.find(key);
+        if (it != borrowedBooks.end()) {
+            dueIndex.remove(it->second, userID, key);
+            circulation.loanEnded(userID, key, isFaculty, it->second, currentDate);
+        }
+        borrowedBooks.erase(key);
+        lastFinePaidTime.erase(key);
+        setBookFine(key, 0, currentDate, FineLedgerEntry::WAIVER);
+        invalidateFines();
+        changed();
+    }
+
+    // Reissue a borrowed book from currentDate, returns the new due date
+    int reissueLoan(const string& isbn, int currentDate) {
+        IsbnKey key = packIsbn(isbn);
+        int newDueDate = currentDate + (maxDays * 24 * 60 * 60);
+        auto it = borrowedBooks.find(key);
+        if (it != borrowedBooks.end()) {
+            dueIndex.remove(it->second, userID, key);
+            circulation.loanRenewed(userID, key, it->second, currentDate);
+        }
+        borrowedBooks[key] = newDueDate;
+        dueIndex.add(newDueDate, userID, key);
+        lastFinePaidTime[key] = currentDate;
+        setBookFine(key, 0, currentDate, FineLedgerEntry::WAIVER);
+        invalidateFines();
+        changed();
+        return newDueDate;
+    }
+
+    bool returnBook(const string& isbn, int currentDate) {
+        // Update fines before checking
+        updateFines(currentDate);
+        
+        auto it = borrowedBooks.find(packIsbn(isbn));
+        if (it == borrowedBooks.end()) {
+            cout << "Book not found in borrowed list.\n";
+            return false;
+        }
+
+        // Convert dates to time_t for proper comparison
+        time_t dueTime = it->second;
+        time_t currentTime = currentDate;
+        
+        // Calculate overdue days using difftime (which returns seconds)
+        double secondsOverdue = difftime(currentTime, dueTime);
+        int daysOverdue = static_cast<int>(secondsOverdue / (24 * 60 * 60));
+        
+        // Only show overdue message and calculate fine if actually overdue
+        if (daysOverdue > 0) {
+            Paise fine = daysOverdue * FINE_PER_DAY;
+            
+            // Convert dates to human-readable format
+            struct tm* dueTm = localtime(&dueTime);
+            struct tm* currentTm = localtime(&currentTime);
+            char dueStr[26], currentStr[26];
+            strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
+            strftime(currentStr, sizeof(currentStr), "%Y-%m-%d %H:%M:%S", currentTm);
+            
+            cout << "\n=== Book is Overdue ===\n";
+            cout << "Due Date: " << dueStr << "\n";
+            cout << "Current Date: " << currentStr << "\n";
+            cout << "Days Overdue: " << daysOverdue << "\n";
+            cout << "Fine Rate: 10 rupees per day\n";
+            cout << "Fine Amount: " << formatRupees(fine) << " rupees\n";
+            
+            cout << "\nYou must pay the fine before returning the book.\n";
+            cout << "Would you like to pay the fine now? (1 for yes, 0 for no): ";
+            int choice;
+            cin >> choice;
+            
+            if (choice == 1) {
+                cout << "Enter amount to pay (" << formatRupees(fine) << " rupees): ";
+                Paise amount = readRupees(cin);
+                if (!payBookFine(isbn, amount, currentDate)) {
+                    cout << "Return cancelled due to payment failure.\n";
+                    return false;
+                }
+            } else {
+                cout << "Return cancelled. Please pay the fine first.\n";
+                return false;
+            }
+        }
+
+        // If we get here, either the book is not overdue or the fine has been paid
+        addToHistory(isbn, currentDate);
+        removeLoan(isbn, currentDate);
+        books->setAvailability(packIsbn(isbn), true);
+        opLog.record("RETURN", {userID, isbn, to_string(currentDate)});
+        events.record(EventLog::INFO, "loan.returned", {{"user", userID}, {"isbn", isbn}});
+        cout << "\nBook returned successfully.\n";
+        cout << "Book status updated to: Available\n";
+        return true;
+    }
+
+    void updateFines(int currentDate) const {
+        if (isFaculty) return; // Faculty members don't get fines
+
+        // Nothing can have changed since the last computation
+        if (fineCacheValid && currentDate >= fineValidFrom && currentDate < fineValidUntil) return;
+
+        const long long day = 24 * 60 * 60;
+        long long validFrom = numeric_limits<long long>::min();
+        long long validUntil = numeric_limits<long long>::max();
+        
+        for (const auto& book : borrowedBooks) {
+            IsbnKey isbn = book.first;
+            int dueDate = book.second;
+            
+            // Convert dates to time_t for proper comparison
+            time_t dueTime = dueDate;
+            time_t currentTime = currentDate;
+            
+            // Calculate overdue days using difftime
+            double secondsOverdue = difftime(currentTime, dueTime);
+            int daysOverdue = static_cast<int>(secondsOverdue / (24 * 60 * 60));
+
+            // The fine for this book stays the same until the next whole overdue day
+            if (daysOverdue > 0) {
+                validFrom = max(validFrom, dueDate + daysOverdue * day);
+                validUntil = min(validUntil, dueDate + (daysOverdue + 1) * day);
+            } else {
+                setBookFine(isbn, 0, currentDate, FineLedgerEntry::WAIVER);
+                validUntil = min(validUntil, dueDate + day);
+            }
+            
+            if (daysOverdue > 0) {
+                // Calculate fine based on days overdue
+                Paise fine = daysOverdue * FINE_PER_DAY;
+                setBookFine(isbn, fine, currentDate, FineLedgerEntry::WAIVER);
+                
+                events.record(EventLog::DEBUG, "fine.updated",
+                              {{"user", userID}, {"isbn", unpackIsbn(isbn)}, {"due", dueTime},
+                               {"days_overdue", daysOverdue}, {"fine_paise", fine}});
+            }
+        }
+        
+        fineCacheValid = true;
+        fineValidFrom = validFrom;
+        fineValidUntil = validUntil;
+        
+        if (totalFine > 0) {
+            events.record(EventLog::DEBUG, "fine.total", {{"user", userID}, {"fine_paise", totalFine}});
+        }
+    }
+
+    void displayAccountDetails(int currentDate) const {
+        // Recalculate fines before displaying
+        updateFines(currentDate);
+        
+        cout << "\n=== Account Details ===\n";
+        cout << "User ID: " << userID << "\n";
+        cout << "User Type: " << (isFaculty ? "Faculty" : "Student") << "\n";
+        cout << "Maximum Books Allowed: " << maxBooks << "\n";
+        cout << "Maximum Days Allowed: " << maxDays << " days\n";
+        if (!isFaculty) {
+            cout << "Current Total Fine: " << formatRupees(totalFine) << " rupees\n";
+        }
+        
+        cout << "\n=== Currently Borrowed Books ===\n";
+        if (borrowedBooks.empty()) {
+            cout << "No books currently borrowed.\n";
+        } else {
+            for (const auto& book : borrowedBooks) {
+                Book details;
+                if (books->find(book.first, details)) {
+                    cout << "\nBook Details:\n";
+                    cout << "ISBN: " << unpackIsbn(book.first) << "\n";
+                    cout << "Title: " << details.getTitle() << "\n";
+                    cout << "Author: " << details.getAuthor() << "\n";
+                    
+                    // Convert due date to human-readable format
+                    time_t dueTime = book.second;
+                    struct tm* dueTm = localtime(&dueTime);
+                    char dueStr[26];
+                    strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
+                    cout << "Due Date: " << dueStr << "\n";
+                    
+                    // Calculate if overdue
+                    int secondsOverdue = currentDate - book.second;
+                    int daysOverdue = secondsOverdue / (24 * 60 * 60);
+                    if (daysOverdue > 0) {
+                        cout << "Status: OVERDUE by " << daysOverdue << " days\n";
+                        if (!isFaculty) {
+                            cout << "Fine Amount: " << formatRupees(daysOverdue * FINE_PER_DAY) << " rupees\n";
+                        }
+                    } else {
+                        cout << "Status: On time\n";
+                    }
+                    cout << "------------------------\n";
+                }
+            }
+        }
+        
+        cout << "\n=== Borrowing History ===\n";
+        if (borrowingHistory.empty()) {
+            cout << "No borrowing history.\n";
+        } else {
+            for (const auto& history : borrowingHistory) {
+                Book details;
+                if (books->find(packIsbn(history.first), details)) {
+                    cout << "\nBook Details:\n";
+                    cout << "ISBN: " << history.first << "\n";
+                    cout << "Title: " << details.getTitle() << "\n";
+                    cout << "Author: " << details.getAuthor() << "\n";
+                    
+                    // Convert return date to human-readable format
+                    time_t returnTime = history.second;
+                    struct tm* returnTm = localtime(&returnTime);
+                    char returnStr[26];
+                    strftime(returnStr, sizeof(returnStr), "%Y-%m-%d %H:%M:%S", returnTm);
+                    cout << "Return Date: " << returnStr << "\n";
+                    cout << "------------------------\n";
+                }
+            }
+        }
+    }
+
+    void saveToFile(ostream &outfile) const {
+        outfile << userID << "\n" 
+               << formatRupees(totalFine) << "\n" 
+               << (isFaculty ? "1" : "0") << "\n" 
+               << maxBooks << "\n" 
+               << maxDays << "\n";
+        
+        // Save borrowed books and their details
+        outfile << borrowedBooks.size() << "\n";
+        for (const auto &book : borrowedBooks) {
+            auto fine = bookFines.find(book.first);
+            outfile << unpackIsbn(book.first) << "\n"  // ISBN
+                   << book.second << "\n"  // Due date
+                   << (lastFinePaidTime.count(book.first) ? lastFinePaidTime.at(book.first) : book.second) << "\n"  // Last fine paid time
+                   << formatRupees(fine != bookFines.end() ? fine->second : 0) << "\n";  // Current fine
+        }
+        
+        // Save borrowing history
+        outfile << borrowingHistory.size() << "\n";
+        for (const auto &history : borrowingHistory) {
+            outfile << history.first << "\n"   // ISBN
+                   << history.second << "\n";   // Return date
+        }
+    }
+    
+    // Compact form: ISBNs are indices into the file's ISBN table, dates are
+    // zigzag varint deltas (due dates against the base epoch, fine-paid times
+    // against the due date, history against the previous entry) and money is
+    // whole paise instead of fixed-format doubles.
+    void saveToCompact(ostream &out, const map<string, unsigned>& isbnIndex, int baseEpoch) const {
+        writeCompactString(out, userID);
+        writeSignedVarint(out, totalFine);
+        out.put(isFaculty ? 1 : 0);
+        writeVarint(out, maxBooks);
+        writeVarint(out, maxDays);
+
+        writeVarint(out, borrowedBooks.size());
+        for (const auto &book : borrowedBooks) {
+            auto paid = lastFinePaidTime.find(book.first);
+            auto fine = bookFines.find(book.first);
+            writeVarint(out, isbnIndex.at(unpackIsbn(book.first)));
+            writeSignedVarint(out, (long long)book.second - baseEpoch);
+            writeSignedVarint(out, paid != lastFinePaidTime.end() ? (long long)paid->second - book.second : 0);
+            writeSignedVarint(out, fine != bookFines.end() ? fine->second : 0);
+        }
+
+        writeVarint(out, borrowingHistory.size());
+        long long previous = baseEpoch;
+        for (const auto &history : borrowingHistory) {
+            writeVarint(out, isbnIndex.at(history.first));
+            writeSignedVarint(out, history.second - previous);
+            previous = history.second;
+        }
+    }
+
+    void loadFromCompact(istream &in, const vector<string>& isbnTable, int baseEpoch, int currentDate) {
+        changed();
+        userID = readCompactString(in);
+        readSignedVarint(in);  // Stored total; recomputed from the book fines below
+        isFaculty = in.get() == 1;
+        maxBooks = readVarint(in);
+        maxDays = readVarint(in);
+
+        borrowedBooks.clear();
+        lastFinePaidTime.clear();
+        bookFines.clear();
+        invalidateFines();
+
+        unsigned long long numBorrowed = readVarint(in);
+        for (unsigned long long i = 0; i < numBorrowed && in; i++) {
+            const string& stored = isbnTable.at(readVarint(in));
+            int dueDate = baseEpoch + readSignedVarint(in);
+            int lastPaidTime = dueDate + readSignedVarint(in);
+            long long finePaise = readSignedVarint(in);
+            if (stored.empty()) continue;
+            IsbnKey isbn = packIsbn(stored);
+            borrowedBooks[isbn] = dueDate;
+            lastFinePaidTime[isbn] = lastPaidTime;
+            if (finePaise > 0) bookFines[isbn] = finePaise;
+        }
+        totalFine = 0;
+        for (const auto& fine : bookFines) {
+            totalFine += fine.second;
+        }
+        reconcileLedger(currentDate);
+        updateFines(currentDate);
+
+        borrowingHistory.clear();
+        unsigned long long numHistory = readVarint(in);
+        long long previous = baseEpoch;
+        for (unsigned long long i = 0; i < numHistory && in; i++) {
+            const string& isbn = isbnTable.at(readVarint(in));
+            previous += readSignedVarint(in);
+            if (!isbn.empty()) borrowingHistory.push_back({isbn, static_cast<int>(previous)});
+        }
+    }
+
+    void loadFromFile(istream &infile, int currentDate) {
+        changed();
+        string totalText;
+        infile >> userID >> totalText;  // Stored total; recomputed from the book fines below
+        
+        string facultyStr;
+        infile >> facultyStr;
+        isFaculty = (facultyStr == "1");
+        
+        infile >> maxBooks >> maxDays;
+        infile.ignore();
+
+        int numBorrowed;
+        infile >> numBorrowed;
+        infile.ignore();
+        
+        borrowedBooks.clear();
+        lastFinePaidTime.clear();
+        bookFines.clear();
+        invalidateFines();
+        
+        for (int i = 0; i < numBorrowed; i++) {
+            string isbn;
+            int dueDate, lastPaidTime;
+            string fineText;
+            Paise fine = 0;
+            getline(infile, isbn);
+            infile >> dueDate >> lastPaidTime >> fineText;
+            infile.ignore();
+            
+            IsbnKey key = loadIsbn(isbn, "accounts");
+            if (key == INVALID_ISBN) continue;
+            borrowedBooks[key] = dueDate;
+            lastFinePaidTime[key] = lastPaidTime;
+            if (parseRupees(fineText, fine) && fine > 0) bookFines[key] = fine;
+        }
+        totalFine = 0;
+        for (const auto& fine : bookFines) {
+            totalFine += fine.second;
+        }
+        reconcileLedger(currentDate);
+
+        // Recalculate fines after loading to ensure consistency
+        updateFines(currentDate);
+
+        int numHistory;
+        infile >> numHistory;
+        infile.ignore();
+        
+        borrowingHistory.clear();
+        for (int i = 0; i < numHistory; i++) {
+            string isbn;
+            int returnDate;
+            getline(infile, isbn);
+            infile >> returnDate;
+            infile.ignore();
+            if (loadIsbn(isbn, "accounts") == INVALID_ISBN) continue;
+            borrowingHistory.push_back({canonicalStoredIsbn(isbn), returnDate});
+        }
+    }
+};
+
+atomic<unsigned long long> Account::lastRevision(0);
+
+// Streaming popularity counters for the catalogue screen, in constant memory
+// whatever the catalogue size. Borrows are counted in count-min sketches:
+// one per day in a 7-day ring ("most borrowed this week") and one with
+// forward exponential decay ("trending", half-life of two days). A bounded
+// candidate set per view holds the heavy hitters, so queries are O(K).
+class TrendingTracker {
+private:
+    static const int DEPTH = 4;
+    static const int WIDTH = 1024;
+    static const int WINDOW_DAYS = 7;
+    static const size_t CANDIDATES = 32;  // Tracked heavy hitters per view
+    static const int DAY = 24 * 60 * 60;
+    static constexpr double HALF_LIFE = 2.0 * DAY;
+
+    unsigned dailyCounts[WINDOW_DAYS][DEPTH][WIDTH];
+    long long bucketDay[WINDOW_DAYS];  // Day number each ring bucket holds
+    double decayedCounts[DEPTH][WIDTH];
+    int landmark;                      // Forward-decay reference time
+    long long currentDay;
+    vector<pair<string, double>> weeklyCandidates;
+    vector<pair<string, double>> trendingCandidates;
+    bool dirty;
+
+    static unsigned long long mix(unsigned long long x) {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    void cells(const string& isbn, int (&column)[DEPTH]) const {
+        unsigned long long h = hash<string>()(isbn);
+        for (int row = 0; row < DEPTH; row++) {
+            column[row] = mix(h + row * 0x632BE59BD9B4E019ULL) % WIDTH;
+        }
+    }
+
+    double decayFactor(int from, int to) const {
+        return exp2(double(to - from) / HALF_LIFE);
+    }
+
+    // Keep the candidate set bounded: update in place or replace the weakest
+    static void offer(vector<pair<string, double>>& candidates, const string& isbn, double estimate) {
+        auto it = find_if(candidates.begin(), candidates.end(),
+                          [&](const pair<string, double>& c) { return c.first == isbn; });
+        if (it != candidates.end()) {
+            it->second = estimate;
+            return;
+        }
+        if (candidates.size() < CANDIDATES) {
+            candidates.push_back({isbn, estimate});
+            return;
+        }
+        auto weakest = min_element(candidates.begin(), candidates.end(),
+                                   [](const pair<string, double>& a, const pair<string, double>& b) {
+                                       return a.second < b.second;
+                                   });
+        if (estimate > weakest->second) *weakest = {isbn, estimate};
+    }
+
+    void refreshWeekly() {
+        for (auto& candidate : weeklyCandidates) candidate.second = weeklyEstimate(candidate.first);
+        weeklyCandidates.erase(remove_if(weeklyCandidates.begin(), weeklyCandidates.end(),
+                                         [](const pair<string, double>& c) { return c.second < 0.5; }),
+                               weeklyCandidates.end());
+    }
+
+    double weeklyEstimate(const string& isbn) const {
+        int column[DEPTH];
+        cells(isbn, column);
+        double total = 0;
+        for (int b = 0; b < WINDOW_DAYS; b++) {
+            if (bucketDay[b] <= currentDay - WINDOW_DAYS) continue;
+            unsigned smallest = numeric_limits<unsigned>::max();
+            for (int row = 0; row < DEPTH; row++) {
+                smallest = min(smallest, dailyCounts[b][row][column[row]]);
+            }
+            total += smallest;
+        }
+        return total;
+    }
+
+    // Decayed score as of the landmark; comparable across ISBNs
+    double decayedEstimate(const string& isbn) const {
+        int column[DEPTH];
+        cells(isbn, column);
+        double smallest = numeric_limits<double>::max();
+        for (int row = 0; row < DEPTH; row++) {
+            smallest = min(smallest, decayedCounts[row][column[row]]);
+        }
+        return smallest;
+    }
+
+    vector<pair<string, double>> top(vector<pair<string, double>> ranked, size_t k) const {
+        sort(ranked.begin(), ranked.end(), [](const pair<string, double>& a, const pair<string, double>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        while (!ranked.empty() && ranked.back().second < 0.5) ranked.pop_back();
+        if (ranked.size() > k) ranked.resize(k);
+        return ranked;
+    }
+
+public:
+    TrendingTracker() {
+        clear();
+    }
+
+    void clear() {
+        memset(dailyCounts, 0, sizeof(dailyCounts));
+        memset(decayedCounts, 0, sizeof(decayedCounts));
+        for (int b = 0; b < WINDOW_DAYS; b++) bucketDay[b] = numeric_limits<int>::min();
+        landmark = 0;
+        currentDay = 0;
+        weeklyCandidates.clear();
+        trendingCandidates.clear();
+        dirty = false;
+    }
+
+    // Move the clock forward, expiring ring buckets that left the window
+    void advance(int currentDate) {
+        long long today = currentDate / DAY;
+        if (today <= currentDay) return;
+        currentDay = today;
+        int b = today % WINDOW_DAYS;
+        if (bucketDay[b] != today) {
+            memset(dailyCounts[b], 0, sizeof(dailyCounts[b]));
+            bucketDay[b] = today;
+        }
+        // Stored weekly estimates go stale as days leave the window; refresh
+        // them so new titles compete against current counts, and free the
+        // slots of titles with nothing left in the window
+        refreshWeekly();
+        dirty = true;
+    }
+
+    void recordBorrow(const string& isbn, int currentDate) {
+        advance(currentDate);
+        if (landmark == 0) landmark = currentDate;
+
+        // Rescale the decayed sketch before the weights grow too large
+        if (currentDate - landmark > 40 * HALF_LIFE) {
+            double scale = 1.0 / decayFactor(landmark, currentDate);
+            for (auto& row : decayedCounts) {
+                for (double& cell : row) cell *= scale;
+            }
+            for (auto& candidate : trendingCandidates) candidate.second *= scale;
+            landmark = currentDate;
+        }
+
+        int column[DEPTH];
+        cells(isbn, column);
+        int b = currentDay % WINDOW_DAYS;
+        double weight = decayFactor(landmark, currentDate);
+        for (int row = 0; row < DEPTH; row++) {
+            dailyCounts[b][row][column[row]]++;
+            decayedCounts[row][column[row]] += weight;
+        }
+        offer(weeklyCandidates, isbn, weeklyEstimate(isbn));
+        offer(trendingCandidates, isbn, decayedEstimate(isbn));
+        dirty = true;
+    }
+
+    vector<pair<string, double>> mostBorrowedThisWeek(int currentDate, size_t k) {
+        advance(currentDate);
+        refreshWeekly();
+        return top(weeklyCandidates, k);
+    }
+
+    // Trending scores are decayed borrow counts as of currentDate
+    vector<pair<string, double>> trending(int currentDate, size_t k) const {
+        double scale = landmark ? 1.0 / decayFactor(landmark, currentDate) : 0;
+        vector<pair<string, double>> ranked;
+        for (const auto& candidate : trendingCandidates) {
+            ranked.push_back({candidate.first, decayedEstimate(candidate.first) * scale});
+        }
+        return top(ranked, k);
+    }
+
+    bool isDirty() const { return dirty; }
+    void markSaved() { dirty = false; }
+
+    void save(const string& filename) {
+        ofstream file(filename, ios::out | ios::binary);
+        if (!file) {
+            events.record(EventLog::ERROR, "save.open_failed", {{"file", filename}});
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(dailyCounts), sizeof(dailyCounts));
+        file.write(reinterpret_cast<const char*>(bucketDay), sizeof(bucketDay));
+        file.write(reinterpret_cast<const char*>(decayedCounts), sizeof(decayedCounts));
+        file.write(reinterpret_cast<const char*>(&landmark), sizeof(landmark));
+        file.write(reinterpret_cast<const char*>(&currentDay), sizeof(currentDay));
+        for (const auto* candidates : {&weeklyCandidates, &trendingCandidates}) {
+            writeVarint(file, candidates->size());
+            for (const auto& candidate : *candidates) {
+                writeCompactString(file, candidate.first);
+                file.write(reinterpret_cast<const char*>(&candidate.second), sizeof(double));
+            }
+        }
+        dirty = false;
+    }
+
+    void load(const string& filename) {
+        ifstream file(filename, ios::binary);
+        if (!file) return;
+        file.read(reinterpret_cast<char*>(dailyCounts), sizeof(dailyCounts));
+        file.read(reinterpret_cast<char*>(bucketDay), sizeof(bucketDay));
+        file.read(reinterpret_cast<char*>(decayedCounts), sizeof(decayedCounts));
+        file.read(reinterpret_cast<char*>(&landmark), sizeof(landmark));
+        file.read(reinterpret_cast<char*>(&currentDay), sizeof(currentDay));
+        for (auto* candidates : {&weeklyCandidates, &trendingCandidates}) {
+            candidates->clear();
+            unsigned long long count = readVarint(file);
+            for (unsigned long long i = 0; i < count && file && i < CANDIDATES; i++) {
+                string isbn = readCompactString(file);
+                double estimate;
+                file.read(reinterpret_cast<char*>(&estimate), sizeof(double));
+                candidates->push_back({isbn, estimate});
+            }
+        }
+        if (!file) {
+            events.record(EventLog::ERROR, "load.damaged", {{"file", filename}, {"action", "popularity counters reset"}});
+            clear();
+        }
+        dirty = false;
+    }
+};
+
+TrendingTracker trending;
+
+// Typo-tolerant lookup over book titles, authors and user names. Candidates
+// come from a trigram or bigram index (an entry must share enough grams with
+// the query to possibly be within the allowed number of edits; bigrams keep
+// short queries filtered) and are verified with Myers' bit-parallel edit
+// distance, matching the query against the best substring so that both typos
+// and partial names are found.
+class FuzzyIndex {
+public:
+    enum Kind { TITLE, AUTHOR, USER_NAME };
+
+    struct Match {
+        Kind kind;
+        string id;
+        string text;
+        int distance;
+    };
+
+private:
+    struct Entry {
+        Kind kind;
+        string id;
+        string text;
+        string folded;  // Lowercased, punctuation collapsed to single spaces
+        bool live;
+    };
+
+    vector<Entry> entries;
+    unordered_map<string, unsigned> byKey;                // kind + id -> entry
+    unordered_map<unsigned, vector<unsigned>> postings;   // trigram -> entries
+    unordered_map<unsigned, vector<unsigned>> pairPostings;  // bigram -> entries
+    vector<unsigned short> textLengths;                   // Entry text lengths, for ranking
+    vector<unsigned short> hitCounts;                     // Scratch space for search
+    size_t deadEntries;
+
+    static constexpr size_t MAX_RESULTS = 10;
+
+    static string keyFor(Kind kind, const string& id) {
+        return string(1, char('0' + kind)) + id;
+    }
+
+public:
+    // Shared with DuplicateFinder, which shingles records the same way
+    static string fold(const string& text) {
+        string folded;
+        for (unsigned char c : text) {
+            if (isalnum(c)) {
+                folded += tolower(c);
+            } else if (!folded.empty() && folded.back() != ' ') {
+                folded += ' ';
+            }
+        }
+        if (!folded.empty() && folded.back() == ' ') folded.pop_back();
+        return folded;
+    }
+
+    static vector<unsigned> trigrams(const string& folded) {
+        vector<unsigned> grams;
+        for (size_t i = 0; i + 3 <= folded.size(); i++) {
+            grams.push_back((unsigned char)folded[i] << 16 | (unsigned char)folded[i + 1] << 8 |
+                            (unsigned char)folded[i + 2]);
+        }
+        sort(grams.begin(), grams.end());
+        grams.erase(unique(grams.begin(), grams.end()), grams.end());
+        return grams;
+    }
+
+    static vector<unsigned> bigrams(const string& folded) {
+        vector<unsigned> grams;
+        for (size_t i = 0; i + 2 <= folded.size(); i++) {
+            grams.push_back((unsigned char)folded[i] << 8 | (unsigned char)folded[i + 1]);
+        }
+        sort(grams.begin(), grams.end());
+        grams.erase(unique(grams.begin(), grams.end()), grams.end());
+        return grams;
+    }
+
+private:
+    // Posting lists for one gram size. A substring within maxEdits of the
+    // pattern keeps all but q of the pattern's grams per edit, so a candidate
+    // must be in at least `needed` of the lists, and one missing g of them
+    // is at least ceil(g / q) edits away. Every list is read: skipping the
+    // common ones weakens that bound and costs more in verification than it
+    // saves. Returns false if this gram size cannot filter at all.
+    struct Filter {
+        vector<const vector<unsigned>*> lists;
+        int q;
+        int grams;
+        int needed;
+        size_t cost;  // Postings read
+    };
+
+    static bool planFilter(const vector<unsigned>& grams, int q, int maxEdits,
+                           const unordered_map<unsigned, vector<unsigned>>& index, Filter& filter) {
+        filter.lists.clear();
+        filter.q = q;
+        filter.grams = grams.size();
+        filter.needed = (int)grams.size() - q * maxEdits;
+        filter.cost = 0;
+        if (filter.needed < 1) return false;
+        for (unsigned gram : grams) {
+            auto it = index.find(gram);
+            if (it == index.end()) continue;  // No entry has it
+            filter.lists.push_back(&it->second);
+            filter.cost += it->second.size();
+        }
+        return true;
+    }
+
+    // Whichever of the trigram and bigram filters reads fewer postings
+    bool plan(const vector<unsigned>& triples, const vector<unsigned>& pairs, int maxEdits, Filter& filter) const {
+        Filter pairFilter;
+        bool byTriples = planFilter(triples, 3, maxEdits, postings, filter);
+        bool byPairs = planFilter(pairs, 2, maxEdits, pairPostings, pairFilter);
+        if (byPairs && (!byTriples || pairFilter.cost < filter.cost)) swap(filter, pairFilter);
+        return byTriples || byPairs;
+    }
+
+    // Ranking so far: distance and length gap of the MAX_RESULTS best matches
+    typedef priority_queue<pair<int, size_t>> Leaders;
+
+    // Verifies the filter's candidates in order of length gap (the second
+    // ranking key) and skips those that cannot reach the top MAX_RESULTS:
+    // an entry missing g of the grams is at least ceil(g / q) edits away.
+    // Short, common queries then stop after the nearest lengths instead of
+    // verifying everything that shares a gram with them.
+    void verify(const Filter& filter, const unsigned long long (&peq)[256], int m, int minEdits, int maxEdits,
+                vector<pair<int, unsigned>>& found, Leaders& leaders) {
+        if ((size_t)filter.needed > filter.lists.size()) return;
+        if (leaders.size() >= MAX_RESULTS && make_pair(minEdits, (size_t)0) > leaders.top()) return;
+        hitCounts.resize(entries.size());
+        vector<unsigned> touched;
+        for (const auto* list : filter.lists) {
+            for (unsigned index : *list) {
+                if (hitCounts[index]++ == 0) touched.push_back(index);
+            }
+        }
+
+        const size_t GAPS = 256;  // Larger gaps share the last bucket
+        vector<pair<unsigned, unsigned short>> candidates;  // Entry, hits
+        vector<unsigned char> gaps;
+        vector<size_t> bucketStart(GAPS + 1, 0);
+        for (unsigned index : touched) {
+            if (hitCounts[index] >= filter.needed) {
+                candidates.push_back({index, hitCounts[index]});
+                gaps.push_back(min(lengthGap(index, m), GAPS - 1));
+                bucketStart[gaps.back() + 1]++;
+            }
+            hitCounts[index] = 0;
+        }
+        for (size_t gap = 1; gap <= GAPS; gap++) bucketStart[gap] += bucketStart[gap - 1];
+        vector<pair<unsigned, unsigned short>> ordered(candidates.size());
+        vector<size_t> next(bucketStart.begin(), bucketStart.end() - 1);
+        for (size_t i = 0; i < candidates.size(); i++) ordered[next[gaps[i]]++] = candidates[i];
+
+        for (size_t gap = 0; gap < GAPS; gap++) {
+            pair<int, size_t> best(minEdits, gap);
+            if (leaders.size() >= MAX_RESULTS && best > leaders.top()) break;
+            for (size_t i = bucketStart[gap]; i < bucketStart[gap + 1]; i++) {
+                unsigned index = ordered[i].first;
+                int missing = filter.grams - ordered[i].second;
+                int bound = max(minEdits, (missing + filter.q - 1) / filter.q);
+                size_t entryGap = lengthGap(index, m);
+                if (leaders.size() >= MAX_RESULTS && make_pair(bound, entryGap) > leaders.top()) continue;
+                const Entry& entry = entries[index];
+                if (!entry.live) continue;
+                int distance = substringDistance(peq, m, entry.folded);
+                if (distance < minEdits || distance > maxEdits) continue;
+                found.push_back({distance, index});
+                leaders.push({distance, entryGap});
+                if (leaders.size() > MAX_RESULTS) leaders.pop();
+            }
+        }
+    }
+
+    // How far an entry's length is from the query's, the second ranking key
+    size_t lengthGap(unsigned index, int m) const {
+        size_t length = textLengths[index];
+        return length > (size_t)m ? length - m : m - length;
+    }
+
+    // Myers (1999) bit-vector algorithm: smallest edit distance between the
+    // pattern (at most 64 characters, encoded in peq) and any substring of text
+    static int substringDistance(const unsigned long long (&peq)[256], int m, const string& text) {
+        unsigned long long pv = ~0ULL, mv = 0;
+        unsigned long long high = 1ULL << (m - 1);
+        int score = m, best = m;
+        for (unsigned char c : text) {
+            unsigned long long eq = peq[c];
+            unsigned long long xv = eq | mv;
+            unsigned long long xh = (((eq & pv) + pv) ^ pv) | eq;
+            unsigned long long ph = mv | ~(xh | pv);
+            unsigned long long mh = pv & xh;
+            if (ph & high) score++;
+            else if (mh & high) score--;
+            ph <<= 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+            best = min(best, score);
+        }
+        return best;
+    }
+
+    void compact() {
+        vector<Entry> live;
+        for (auto& entry : entries) {
+            if (entry.live) live.push_back(move(entry));
+        }
+        clear();
+        for (const auto& entry : live) {
+            add(entry.kind, entry.id, entry.text);
+        }
+    }
+
+public:
+    FuzzyIndex() : deadEntries(0) {}
+
+    void add(Kind kind, const string& id, const string& text) {
+        remove(kind, id);
+        unsigned index = entries.size();
+        entries.push_back({kind, id, text, fold(text), true});
+        textLengths.push_back(min(text.size(), (size_t)numeric_limits<unsigned short>::max()));
+        byKey[keyFor(kind, id)] = index;
+        for (unsigned gram : trigrams(entries.back().folded)) {
+            postings[gram].push_back(index);
+        }
+        for (unsigned gram : bigrams(entries.back().folded)) {
+            pairPostings[gram].push_back(index);
+        }
+    }
+
+    void remove(Kind kind, const string& id) {
+        auto it = byKey.find(keyFor(kind, id));
+        if (it == byKey.end()) return;
+        entries[it->second].live = false;  // Postings are dropped at the next compaction
+        byKey.erase(it);
+        if (++deadEntries > 1000 && deadEntries > entries.size() / 2) compact();
+    }
+
+    void clear() {
+        entries.clear();
+        byKey.clear();
+        postings.clear();
+        pairPostings.clear();
+        textLengths.clear();
+        hitCounts.clear();
+        deadEntries = 0;
+    }
+
+    vector<Match> search(const string& query) {
+        vector<Match> matches;
+        string pattern = fold(query).substr(0, 64);
+        int m = pattern.size();
+        if (m < 2) return matches;  // A single character cannot be filtered
+        // Queries of up to three characters must match exactly: with one
+        // edit they would match nearly every entry
+        int maxEdits = m < 4 ? 0 : min(3, max(1, m / 4));
+
+        // Repetitive queries ("aaaa") may have too few distinct grams to
+        // filter for that many edits; fewer are allowed rather than
+        // verifying every entry
+        vector<unsigned> triples = trigrams(pattern), pairs = bigrams(pattern);
+        Filter exact, filter;
+        plan(triples, pairs, 0, exact);
+        while (maxEdits > 0 && !plan(triples, pairs, maxEdits, filter)) maxEdits--;
+
+        unsigned long long peq[256] = {0};
+        for (int i = 0; i < m; i++) {
+            peq[(unsigned char)pattern[i]] |= 1ULL << i;
+        }
+
+        // Exact matches first (an entry must have every gram), then the
+        // others; exact ones are not counted twice
+        vector<pair<int, unsigned>> found;  // Distance, entry
+        Leaders leaders;
+        verify(exact, peq, m, 0, 0, found, leaders);
+        if (maxEdits > 0) verify(filter, peq, m, 1, maxEdits, found, leaders);
+
+        // Rank by entry index and copy out only the matches that are shown
+        size_t shown = min(found.size(), MAX_RESULTS);
+        partial_sort(found.begin(), found.begin() + shown, found.end(),
+                     [&](const pair<int, unsigned>& a, const pair<int, unsigned>& b) {
+            if (a.first != b.first) return a.first < b.first;
+            size_t gapA = lengthGap(a.second, m), gapB = lengthGap(b.second, m);
+            if (gapA != gapB) return gapA < gapB;
+            return entries[a.second].text < entries[b.second].text;
+        });
+        for (size_t i = 0; i < shown; i++) {
+            const Entry& entry = entries[found[i].second];
+            matches.push_back({entry.kind, entry.id, entry.text, found[i].first});
+        }
+        return matches;
+    }
+};
+
+FuzzyIndex fuzzyIndex;
+bool fuzzyIndexReady = false;  // A paged catalogue is indexed on its first search
+
+class User {
+protected:
+    string id;
+    string name;
+    string password;
+    Account &account;
+
+public:
+    User(string userId, string userName, string pwd, bool isFaculty = false) 
+        : id(userId), name(userName), password(pwd), account(accounts[userId]) {
+        // Create a new account only if one doesn't exist
+        if (accounts.find(userId) == accounts.end()) {
+            accounts[userId] = Account(userId, isFaculty);
+        } else {
+            // Update existing account's faculty status
+            accounts[userId].isFaculty = isFaculty;
+            accounts[userId].maxBooks = isFaculty ? 5 : 3;
+            accounts[userId].maxDays = isFaculty ? 30 : 15;
+        }
+        // Update the account ID to match the user ID
+        accounts[userId].userID = userId;
+        accounts[userId].changed();
+        usersRevision++;
+    }
+
+    virtual ~User() { usersRevision++; }
+
+    Account& getAccount() { return account; }
+    string getID() const { return id; }
+    string getName() const { return name; }
+    string getPassword() const { return password; }  // Added getter for password
+
+    virtual bool borrowBook(const string& isbn, int currentDate) = 0;
+    virtual bool returnBook(const string& isbn, int currentDate) = 0;
+    virtual void displayMenu() = 0;
+
+    // Whether this user may borrow at all right now (fines, long-overdue books)
+    virtual bool mayBorrow(int currentDate) = 0;
+
+    // A stack of books checked out at once. The checks run once over the
+    // whole stack and either every book is lent or none is; the loans go to
+    // operations.log together and the menu saves once for the lot.
+    bool borrowBooks(const vector<string>& isbns, int currentDate) {
+        account.updateFines(currentDate);
+        if (!mayBorrow(currentDate)) return false;
+        if ((int)(account.getBorrowedBooks().size() + isbns.size()) > account.getMaxBooks()) {
+            cout << "\nThese " << isbns.size() << " books would exceed the limit of " << account.getMaxBooks() << " books.\n";
+            cout << "Currently borrowed: " << account.getBorrowedBooks().size() << " books\n";
+            return false;
+        }
+
+        vector<pair<string, Book>> stack;
+        unordered_set<IsbnKey> seen;
+        for (const auto& isbn : isbns) {
+            IsbnKey key = packIsbn(isbn);
+            Book book;
+            if (!seen.insert(key).second) {
+                cout << isbn << ": listed twice.\n";
+            } else if (!books->find(key, book)) {
+                cout << isbn << ": book not found.\n";
+            } else if (!book.isAvailable()) {
+                cout << isbn << ": book is not available.\n";
+            } else {
+                stack.push_back({isbn, book});
+            }
+        }
+        if (stack.size() != isbns.size()) {
+            cout << "No books were borrowed.\n";
+            return false;
+        }
+
+        int dueDate = currentDate + (account.getMaxDays() * 24 * 60 * 60);
+        vector<pair<string, vector<string>>> operations;
+        for (const auto& item : stack) {
+            account.addLoan(item.first, dueDate);
+            books->setAvailability(packIsbn(item.first), false);
+            operations.push_back({"BORROW", {id, item.first, to_string(dueDate)}});
+            events.record(EventLog::INFO, "loan.borrowed", {{"user", id}, {"isbn", item.first}, {"due", dueDate}});
+            trending.recordBorrow(item.first, currentDate);
+        }
+        opLog.recordAll(operations);
+
+        time_t dueTime = dueDate;
+        struct tm* dueTm = localtime(&dueTime);
+        char dueStr[26];
+        strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
+        cout << "\n" << stack.size() << " books borrowed successfully!\n";
+        for (const auto& item : stack) {
+            cout << item.first << " - " << item.second.getTitle() << "\n";
+        }
+        cout << "Due date: " << dueStr << "\n";
+        cout << "Books borrowed: " << account.getBorrowedBooks().size() << " of " << account.getMaxBooks() << "\n";
+        return true;
+    }
+
+    // A stack of books returned at once, all or none. A student pays the
+    // fines of the overdue books in the stack in one payment first.
+    bool returnBooks(const vector<string>& isbns, int currentDate) {
+        account.updateFines(currentDate);
+        unordered_set<IsbnKey> seen;
+        bool valid = true;
+        for (const auto& isbn : isbns) {
+            IsbnKey key = packIsbn(isbn);
+            if (!seen.insert(key).second) {
+                cout << isbn << ": listed twice.\n";
+                valid = false;
+            } else if (!account.getBorrowedBooks().count(key)) {
+                cout << isbn << ": not in your borrowed list.\n";
+                valid = false;
+            }
+        }
+        if (!valid || !payStackFines(isbns, currentDate)) {
+            cout << "No books were returned.\n";
+            return false;
+        }
+
+        vector<pair<string, vector<string>>> operations;
+        for (const auto& isbn : isbns) {
+            account.addToHistory(isbn, currentDate);
+            account.removeLoan(isbn, currentDate);
+            books->setAvailability(packIsbn(isbn), true);
+            operations.push_back({"RETURN", {id, isbn, to_string(currentDate)}});
+            events.record(EventLog::INFO, "loan.returned", {{"user", id}, {"isbn", isbn}});
+        }
+        opLog.recordAll(operations);
+        trending.advance(currentDate);
+        cout << "\n" << isbns.size() << " books returned successfully.\n";
+        return true;
+    }
+
+private:
+    bool payStackFines(const vector<string>& isbns, int currentDate) {
+        if (account.isFacultyMember()) return true;
+        Paise total = 0;
+        vector<pair<string, Paise>> fined;
+        for (const auto& isbn : isbns) {
+            Paise fine = account.getBookFine(isbn);
+            if (fine > 0) {
+                fined.push_back({isbn, fine});
+                total += fine;
+            }
+        }
+        if (fined.empty()) return true;
+
+        cout << "\n=== Overdue Books ===\n";
+        for (const auto& book : fined) {
+            cout << book.first << ": " << formatRupees(book.second) << " rupees\n";
+        }
+        cout << "Total fine: " << formatRupees(total) << " rupees\n";
+        cout << "\nYou must pay the fines before returning these books.\n";
+        cout << "Would you like to pay the fines now? (1 for yes, 0 for no): ";
+        int choice;
+        cin >> choice;
+        if (choice != 1) return false;
+        cout << "Enter amount to pay (" << formatRupees(total) << " rupees): ";
+        Paise amount = readRupees(cin);
+        if (amount != total) {
+            cout << "\nPayment REJECTED!\n";
+            cout << "Please pay the exact amount of " << formatRupees(total) << " rupees.\n";
+            return false;
+        }
+        for (const auto& book : fined) {
+            account.payBookFine(book.first, book.second, currentDate);
+        }
+        return true;
+    }
+};
+
+class Student : public User {
+public:
+    Student(string id, string name, string pwd) : User(id, name, pwd, false) {}
+
+    bool mayBorrow(int /*currentDate*/) override {
+        if (account.getTotalFine() > 0) {
+            cout << "\nCannot borrow books due to unpaid fines.\n";
+            cout << "Current total fine: " << formatRupees(account.getTotalFine()) << " rupees\n";
+            cout << "Please pay your fines before borrowing more books.\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool borrowBook(const string& isbn, int currentDate) override {
+        // Update fines before checking
+        account.updateFines(currentDate);
+        
+        // Check current fine
+        if (!mayBorrow(currentDate)) return false;
+
+        if (account.getBorrowedBooks().size() >= account.getMaxBooks()) {
+            cout << "\nMaximum number of books already borrowed.\n";
+            cout << "Student limit: " << account.getMaxBooks() << " books\n";
+            cout << "Currently borrowed: " << account.getBorrowedBooks().size() << " books\n";
+            return false;
+        }
+
+        Book book;
+        if (!books->find(packIsbn(isbn), book) || !book.isAvailable()) {
+            cout << "Book not available for borrowing.\n";
+            return false;
+        }
+
+        // Set due date in seconds (using actual days)
+        int dueDate = currentDate + (account.getMaxDays() * 24 * 60 * 60);
+        account.addLoan(isbn, dueDate);
+        books->setAvailability(packIsbn(isbn), false);
+        opLog.record("BORROW", {id, isbn, to_string(dueDate)});
+        events.record(EventLog::INFO, "loan.borrowed", {{"user", id}, {"isbn", isbn}, {"due", dueDate}});
+        
+        // Convert due date to human-readable format
+        time_t dueTime = dueDate;
+        struct tm* dueTm = localtime(&dueTime);
+        char dueStr[26];
+        strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
+
+        cout << "\nBook borrowed successfully!\n";
+        cout << "Due date: " << dueStr << "\n";
+        cout << "Borrowing period: " << account.getMaxDays() << " days\n";
+        cout << "Fine rate: 10 rupees per day if overdue\n";
+        trending.recordBorrow(isbn, currentDate);
+        displayRecommendations(isbn);
+        return true;
+    }
+
+    bool returnBook(const string& isbn, int currentDate) override {
+        // Update fines before checking
+        account.updateFines(currentDate);
+        
+        auto it = account.getBorrowedBooks().find(packIsbn(isbn));
+        if (it == account.getBorrowedBooks().end()) {
+            cout << "Book not found in borrowed list.\n";
+            return false;
         }
 
         // Convert dates to time_t for proper comparison
@@ -251,7 +4172,7 @@ public:
         
         // Only show overdue message and calculate fine if actually overdue
         if (daysOverdue > 0) {
-            double fine = daysOverdue * 10.0;  // 10 rupees per day
+            Paise fine = daysOverdue * FINE_PER_DAY;
             
             // Convert dates to human-readable format
             struct tm* dueTm = localtime(&dueTime);
@@ -265,7 +4186,7 @@ public:
             cout << "Current Date: " << currentStr << "\n";
             cout << "Days Overdue: " << daysOverdue << "\n";
             cout << "Fine Rate: 10 rupees per day\n";
-            cout << "Fine Amount: " << fine << " rupees\n";
+            cout << "Fine Amount: " << formatRupees(fine) << " rupees\n";
             
             cout << "\nYou must pay the fine before returning the book.\n";
             cout << "Would you like to pay the fine now? (1 for yes, 0 for no): ";
@@ -273,614 +4194,2615 @@ public:
             cin >> choice;
             
             if (choice == 1) {
-                cout << "Enter amount to pay (" << fine << " rupees): ";
-                double amount;
-                cin >> amount;
-                if (!payBookFine(isbn, amount, currentDate)) {
+                cout << "Enter amount to pay (" << formatRupees(fine) << " rupees): ";
+                Paise amount = readRupees(cin);
+                if (!account.payBookFine(isbn, amount, currentDate)) {
                     cout << "Return cancelled due to payment failure.\n";
                     return false;
                 }
             } else {
-                cout << "Return cancelled. Please pay the fine first.\n";
-                return false;
+                cout << "Return cancelled. Please pay the fine first.\n";
+                return false;
+            }
+        }
+
+        // If we get here, either the book is not overdue or the fine has been paid
+        account.addToHistory(isbn, currentDate);
+        account.removeLoan(isbn, currentDate);
+        books->setAvailability(packIsbn(isbn), true);
+        opLog.record("RETURN", {id, isbn, to_string(currentDate)});
+        events.record(EventLog::INFO, "loan.returned", {{"user", id}, {"isbn", isbn}});
+        trending.advance(currentDate);
+        cout << "\nBook returned successfully.\n";
+        cout << "Book status updated to: Available\n";
+        return true;
+    }
+
+    void displayMenu() override {
+        cout << "\n\n=== Student Menu ===\n";
+        cout << "1. View Available Books\n";
+        cout << "2. Borrow a Book (Max " << account.getMaxBooks() << " books, " << account.getMaxDays() << " days)\n";
+        cout << "3. Return a Book\n";
+        cout << "4. View Borrowed Books\n";
+        cout << "5. View Fine (Current: " << formatRupees(account.getTotalFine()) << " rupees)\n";
+        cout << "6. Pay Fine\n";
+        cout << "7. View Account Details\n";
+        cout << "8. Exit\n\n";
+    }
+};
+
+class Faculty : public User {
+public:
+    Faculty(string id, string name, string pwd) : User(id, name, pwd, true) {}
+
+    bool mayBorrow(int currentDate) override {
+        for (const auto& borrowed : account.getBorrowedBooks()) {
+            int secondsOverdue = currentDate - borrowed.second;
+            int daysOverdue = secondsOverdue / (24 * 60 * 60);  // Convert seconds to actual days
+            if (daysOverdue > 60) {
+                cout << "Cannot borrow: You have a book overdue by more than 60 days.\n";
+                cout << "Please return all overdue books first.\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool borrowBook(const string& isbn, int currentDate) override {
+        // Check if book exists and is available
+        Book book;
+        if (!books->find(packIsbn(isbn), book)) {
+            cout << "Book not found.\n";
+            return false;
+        }
+        if (!book.isAvailable()) {
+            cout << "Book is not available.\n";
+            return false;
+        }
+
+        // Check if user has reached maximum books
+        if (account.getBorrowedBooks().size() >= account.getMaxBooks()) {
+            cout << "\nMaximum number of books already borrowed.\n";
+            cout << "Faculty limit: " << account.getMaxBooks() << " books\n";
+            cout << "Currently borrowed: " << account.getBorrowedBooks().size() << " books\n";
+            return false;
+        }
+
+        // Check for any book overdue by more than 60 days
+        if (!mayBorrow(currentDate)) return false;
+
+        // Borrow the book
+        int dueDate = currentDate + (account.getMaxDays() * 24 * 60 * 60);  // 30 days for faculty
+        account.addLoan(isbn, dueDate);
+        books->setAvailability(packIsbn(isbn), false);
+        opLog.record("BORROW", {id, isbn, to_string(dueDate)});
+        events.record(EventLog::INFO, "loan.borrowed", {{"user", id}, {"isbn", isbn}, {"due", dueDate}});
+        
+        // Convert due date to human-readable format
+        time_t dueTime = dueDate;
+        struct tm* dueTm = localtime(&dueTime);
+        char dueStr[26];
+        strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
+
+        cout << "\nBook borrowed successfully!\n";
+        cout << "Due date: " << dueStr << "\n";
+        cout << "Maximum borrowing period: " << account.getMaxDays() << " days\n";
+        cout << "Books borrowed: " << account.getBorrowedBooks().size() << " of " << account.getMaxBooks() << "\n";
+        trending.recordBorrow(isbn, currentDate);
+        displayRecommendations(isbn);
+        return true;
+    }
+
+    bool returnBook(const string& isbn, int currentDate) override {
+        auto it = account.getBorrowedBooks().find(packIsbn(isbn));
+        if (it == account.getBorrowedBooks().end()) {
+            cout << "Book not found in borrowed list.\n";
+            return false;
+        }
+
+        // Calculate days overdue
+        int secondsOverdue = currentDate - it->second;
+        int daysOverdue = secondsOverdue / (24 * 60 * 60);  // Convert seconds to actual days
+        
+        if (daysOverdue > 0) {
+            cout << "\n=== Book is Overdue ===\n";
+            cout << "Due Date: " << it->second << "\n";
+            cout << "Current Date: " << currentDate << "\n";
+            cout << "Days Overdue: " << daysOverdue << "\n";
+            cout << "Note: Faculty members do not incur fines for overdue books.\n";
+        }
+
+        account.addToHistory(isbn, currentDate);
+        account.removeLoan(isbn, currentDate);
+        books->setAvailability(packIsbn(isbn), true);
+        opLog.record("RETURN", {id, isbn, to_string(currentDate)});
+        events.record(EventLog::INFO, "loan.returned", {{"user", id}, {"isbn", isbn}});
+        trending.advance(currentDate);
+        cout << "\nBook returned successfully.\n";
+        cout << "Book status updated to: Available\n";
+        return true;
+    }
+
+    void displayMenu() override {
+        cout << "\n=== Faculty Menu ===\n";
+        cout << "1. View Available Books\n";
+        cout << "2. Borrow a Book (Max " << account.getMaxBooks() << " books, " << account.getMaxDays() << " days)\n";
+        cout << "3. Return a Book\n";
+        cout << "4. View Borrowed Books\n";
+        cout << "5. View Borrowing History\n";
+        cout << "6. View Account Details\n";
+        cout << "7. Exit\n";
+    }
+};
+
+class Librarian : public User {
+public:
+    Librarian(string id, string name, string pwd) : User(id, name, pwd, false) {}
+
+    bool mayBorrow(int /*currentDate*/) override {
+        cout << "Librarians cannot borrow books.\n";
+        return false;
+    }
+
+    bool borrowBook(const string& isbn, int currentDate) override {
+        cout << "Librarians cannot borrow books.\n";
+        return false;
+    }
+
+    bool returnBook(const string& isbn, int currentDate) override {
+        cout << "Librarians cannot return books.\n";
+        return false;
+    }
+
+    void addUser(string id, string name, string password, bool isFaculty) {
+        if (users.find(id) != users.end()) {
+            cout << "Error: User ID already exists!\n";
+            return;
+        }
+
+        User* newUser;
+        if (isFaculty) {
+            newUser = new Faculty(id, name, password);
+        } else {
+            newUser = new Student(id, name, password);
+        }
+        users[id] = newUser;
+        fuzzyIndex.add(FuzzyIndex::USER_NAME, id, name);
+        opLog.record("ADD_USER", {id, name, password, isFaculty ? "1" : "0"});
+        cout << "User added successfully!\n";
+    }
+    
+    void addBook(string isbn, string title, string author, string publisher, int year) {
+        // New books need a real ISBN; legacy IDs only come from old data files
+        isbn = normalizeIsbn(isbn);
+        if (isbn.empty()) {
+            cout << "Invalid ISBN! Enter a 10 or 13 digit ISBN with a correct check digit.\n";
+            return;
+        }
+        IsbnKey key = packIsbn(isbn);
+        if (!books->contains(key)) {
+            books->store(key, Book(title, author, publisher, year, isbn, true));
+            fuzzyIndex.add(FuzzyIndex::TITLE, isbn, title);
+            fuzzyIndex.add(FuzzyIndex::AUTHOR, isbn, author);
+            opLog.record("ADD_BOOK", {isbn, title, author, publisher, to_string(year)});
+            cout << "Book added successfully!\n";
+        } else {
+            cout << "Book already exists!\n";
+        }
+    }
+
+    void removeUser(string userId) {
+        if (users.find(userId) != users.end()) {
+            delete users[userId];
+            users.erase(userId);
+            dueIndex.removeAll(userId, accounts[userId].getBorrowedBooks());
+            recommender.removePatron(accounts[userId].getBorrowingHistory());
+            accounts.erase(userId);
+            markAccountChanged(userId);
+            fineLedger.removeAccount(userId);
+            fuzzyIndex.remove(FuzzyIndex::USER_NAME, userId);
+            opLog.record("REMOVE_USER", {userId});
+            cout << "User removed successfully!\n";
+        } else {
+            cout << "User not found!\n";
+        }
+    }
+    
+    void removeBook(string isbn) {
+        IsbnKey key = packIsbn(isbn);
+        if (books->erase(key)) {
+            isbn = unpackIsbn(key);
+            fuzzyIndex.remove(FuzzyIndex::TITLE, isbn);
+            fuzzyIndex.remove(FuzzyIndex::AUTHOR, isbn);
+            opLog.record("REMOVE_BOOK", {isbn});
+            cout << "Book removed successfully!\n";
+        } else {
+            cout << "Book not found!\n";
+        }
+    }
+
+    void updateBook(string isbn, string newTitle, string newAuthor, string newPublisher, int newYear) {
+        IsbnKey key = packIsbn(isbn);
+        Book book;
+        if (books->find(key, book)) {
+            isbn = unpackIsbn(key);
+            Book updated(newTitle, newAuthor, newPublisher, newYear, isbn, book.isAvailable());
+            updated.setReserved(book.isReserved());
+            books->store(key, updated);
+            fuzzyIndex.add(FuzzyIndex::TITLE, isbn, newTitle);
+            fuzzyIndex.add(FuzzyIndex::AUTHOR, isbn, newAuthor);
+            opLog.record("UPDATE_BOOK", {isbn, newTitle, newAuthor, newPublisher, to_string(newYear)});
+            cout << "Book updated successfully!\n";
+        } else {
+            cout << "Book not found!\n";
+        }
+    }
+
+    void displayMenu() override {
+        cout << "\nLibrarian Menu:\n"
+             << "1. Add User\n"
+             << "2. Remove User\n"
+             << "3. Add Book\n"
+             << "4. Remove Book\n"
+             << "5. Update Book\n"
+             << "6. View All Books\n"
+             << "7. View All Users\n"
+             << "8. Exit\n"
+             << "10. Restore Data to a Point in Time\n"
+             << "11. Search Sister Branches\n"
+             << "12. Request Inter-Branch Transfer\n"
+             << "13. View Incoming Transfer Requests\n"
+             << "14. Outstanding Fines Report\n"
+             << "15. Fuzzy Search (titles, authors, user names)\n"
+             << "16. Generate Due-Soon Reminders\n"
+             << "17. Export Circulation Data for Analysis\n"
+             << "18. Semester Rollover (roster file)\n"
+             << "19. Check Data Consistency\n"
+             << "20. Refresh Catalogue from books.txt\n"
+             << "21. Circulation Statistics\n"
+             << "22. Find Duplicate Books\n";
+    }
+};
+
+// Multi-branch federation. Every branch library runs its own copy of the
+// system in its own directory, which holds that branch's shard of books.txt
+// and accounts.txt. branches.txt lists this branch's name and its sister
+// branches; availability lookups read the sister branches' published
+// books.txt in parallel, skip branches that do not answer within the timeout
+// and merge the results. Transfer requests are appended to the target
+// branch's transfers.txt.
+class BranchFederation {
+private:
+    struct Branch {
+        string name;
+        string directory;
+    };
+
+    // A sister branch's catalogue, re-parsed only when its books.txt changes
+    struct BranchCatalogue {
+        filesystem::file_time_type modified;
+        map<IsbnKey, Book> books;
+    };
+
+    // Shared with the lookup workers, which can outlive a search that timed out
+    struct CatalogueCache {
+        mutex m;
+        map<string, shared_ptr<const BranchCatalogue>> catalogues;  // Catalogue file path -> catalogue
+    };
+
+    // The latest lookup thread for one branch
+    struct Worker {
+        thread t;
+        shared_ptr<atomic<bool>> finished;
+    };
+
+    string localName;
+    vector<Branch> branches;
+    shared_ptr<CatalogueCache> cache = make_shared<CatalogueCache>();
+    map<string, Worker> workers;  // Branch directory -> its latest lookup
+
+    static constexpr int LOOKUP_TIMEOUT_MS = 2000;
+
+    static shared_ptr<const BranchCatalogue> loadCatalogue(CatalogueCache& cache, const Branch& branch) {
+        // A branch with compressed storage loads books.lmz rather than books.txt
+        string path = branch.directory + "/books.lmz";
+        error_code ec;
+        auto modified = filesystem::last_write_time(path, ec);
+        if (ec) {
+            path = branch.directory + "/books.txt";
+            modified = filesystem::last_write_time(path, ec);
+            if (ec) return nullptr;
+        }
+
+        {
+            lock_guard<mutex> lock(cache.m);
+            auto it = cache.catalogues.find(path);
+            if (it != cache.catalogues.end() && it->second->modified == modified) {
+                return it->second;
+            }
+        }
+
+        unique_ptr<istream> stream;
+        if (path.compare(path.size() - 4, 4, ".lmz") == 0) {
+            stream.reset(new SnapshotReader(path));
+        } else {
+            stream.reset(new ifstream(path));
+        }
+        istream& file = *stream;
+        if (!file) return nullptr;
+        auto catalogue = make_shared<BranchCatalogue>();
+        catalogue->modified = modified;
+        int numBooks;
+        file >> numBooks;
+        file.ignore();
+        for (int i = 0; i < numBooks && file; i++) {
+            Book book;
+            book.loadFromFile(file);
+            IsbnKey key = packStoredIsbn(book.getISBN());
+            if (key == INVALID_ISBN) continue;
+            book.setISBN(unpackIsbn(key));
+            catalogue->books[key] = book;
+        }
+
+        lock_guard<mutex> lock(cache.m);
+        cache.catalogues[path] = catalogue;
+        return catalogue;
+    }
+
+    static string toLower(string text) {
+        transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return tolower(c); });
+        return text;
+    }
+
+public:
+    struct Holding {
+        string branch;
+        string isbn;
+        string title;
+        bool available;
+    };
+
+    // A lookup still reading a branch is waited for, so none outlives the program
+    ~BranchFederation() {
+        for (auto& worker : workers) {
+            if (worker.second.t.joinable()) worker.second.t.join();
+        }
+    }
+
+    bool loadConfig(const string& filename = "branches.txt") {
+        ifstream file(filename);
+        if (!file) return false;
+        int numBranches;
+        getline(file, localName);
+        file >> numBranches;
+        file.ignore();
+        branches.clear();
+        for (int i = 0; i < numBranches; i++) {
+            Branch branch;
+            getline(file, branch.name);
+            getline(file, branch.directory);
+            branches.push_back(branch);
+        }
+        cout << "Branch " << localName << ": " << branches.size() << " sister branches configured.\n";
+        return true;
+    }
+
+    bool isConfigured() const { return !branches.empty(); }
+
+    // Holdings in one branch whose ISBN equals the query or whose title contains it
+    static vector<Holding> searchBranch(CatalogueCache& cache, const Branch& branch, const string& query) {
+        vector<Holding> holdings;
+        auto catalogue = loadCatalogue(cache, branch);
+        if (!catalogue) return holdings;
+
+        auto exact = catalogue->books.find(packIsbn(query));
+        if (exact != catalogue->books.end()) {
+            holdings.push_back({branch.name, unpackIsbn(exact->first), exact->second.getTitle(), exact->second.isAvailable()});
+            return holdings;
+        }
+        string needle = toLower(query);
+        for (const auto& p : catalogue->books) {
+            if (toLower(p.second.getTitle()).find(needle) != string::npos) {
+                holdings.push_back({branch.name, unpackIsbn(p.first), p.second.getTitle(), p.second.isAvailable()});
+            }
+        }
+        return holdings;
+    }
+
+    // Fan the lookup out to every sister branch in parallel and merge the answers
+    vector<Holding> search(const string& query, vector<string>& unreachable) {
+        struct Pending {
+            mutex m;
+            condition_variable done;
+            size_t remaining;
+            vector<vector<Holding>> results;
+            vector<bool> answered;
+        };
+        auto pending = make_shared<Pending>();
+        pending->remaining = branches.size();
+        pending->results.resize(branches.size());
+        pending->answered.assign(branches.size(), false);
+
+        // A slow branch must not hold up the desk past the timeout, so the
+        // search does not wait for its worker. The workers only share the
+        // cache and the results, never this object. A branch whose previous
+        // lookup is still running gets no second thread and counts as
+        // unreachable, so a hung branch holds at most one thread.
+        for (size_t i = 0; i < branches.size(); i++) {
+            Worker& worker = workers[branches[i].directory];
+            if (worker.t.joinable()) {
+                if (!worker.finished->load()) {
+                    lock_guard<mutex> lock(pending->m);
+                    pending->remaining--;
+                    continue;
+                }
+                worker.t.join();
+            }
+            worker.finished = make_shared<atomic<bool>>(false);
+            worker.t = thread([cache = cache, pending, i, branch = branches[i], query, finished = worker.finished]() {
+                vector<Holding> holdings = searchBranch(*cache, branch, query);
+                {
+                    lock_guard<mutex> lock(pending->m);
+                    pending->results[i] = move(holdings);
+                    pending->answered[i] = true;
+                    pending->remaining--;
+                    pending->done.notify_all();
+                }
+                finished->store(true);
+            });
+        }
+
+        vector<Holding> merged;
+        unique_lock<mutex> lock(pending->m);
+        pending->done.wait_for(lock, chrono::milliseconds(LOOKUP_TIMEOUT_MS),
+                               [&]() { return pending->remaining == 0; });
+        for (size_t i = 0; i < branches.size(); i++) {
+            if (!pending->answered[i]) {
+                unreachable.push_back(branches[i].name);
+                continue;
+            }
+            merged.insert(merged.end(), pending->results[i].begin(), pending->results[i].end());
+        }
+        return merged;
+    }
+
+    void displaySearch(const string& query) {
+        vector<string> unreachable;
+        vector<Holding> holdings = search(query, unreachable);
+
+        cout << "\n=== Holdings at Sister Branches ===\n";
+        if (holdings.empty()) {
+            cout << "No matching books found at sister branches.\n";
+        }
+        for (const auto& holding : holdings) {
+            cout << "Branch: " << holding.branch << " | ISBN: " << holding.isbn
+                 << " | Title: " << holding.title
+                 << " | Status: " << (holding.available ? "Available" : "Borrowed") << "\n";
+        }
+        for (const auto& name : unreachable) {
+            cout << "Branch " << name << " did not respond in time.\n";
+        }
+    }
+
+    bool requestTransfer(const string& branchName, const string& isbn, const string& requestedBy) {
+        auto it = find_if(branches.begin(), branches.end(),
+                          [&](const Branch& b) { return b.name == branchName; });
+        if (it == branches.end()) {
+            cout << "Unknown branch: " << branchName << "\n";
+            return false;
+        }
+
+        auto catalogue = loadCatalogue(*cache, *it);
+        auto bookIt = catalogue ? catalogue->books.find(packIsbn(isbn)) : map<IsbnKey, Book>::const_iterator();
+        if (!catalogue || bookIt == catalogue->books.end()) {
+            cout << "Book not found at branch " << branchName << ".\n";
+            return false;
+        }
+        if (!bookIt->second.isAvailable()) {
+            cout << "Book is currently borrowed at branch " << branchName << ".\n";
+            return false;
+        }
+
+        ofstream file(it->directory + "/transfers.txt", ios::app);
+        if (!file) {
+            cerr << "Error: Unable to open transfers.txt of branch " << branchName << "!\n";
+            return false;
+        }
+        file << getCurrentDate() << "\t" << localName << "\t" << unpackIsbn(bookIt->first) << "\t" << requestedBy << "\n";
+        cout << "Transfer of \"" << bookIt->second.getTitle() << "\" requested from branch " << branchName << ".\n";
+        return true;
+    }
+
+    void displayIncomingTransfers() const {
+        ifstream file("transfers.txt");
+        cout << "\n=== Incoming Transfer Requests ===\n";
+        string line;
+        int count = 0;
+        while (getline(file, line)) {
+            istringstream fields(line);
+            string time, fromBranch, isbn, requestedBy;
+            getline(fields, time, '\t');
+            getline(fields, fromBranch, '\t');
+            getline(fields, isbn, '\t');
+            getline(fields, requestedBy, '\t');
+
+            time_t requestTime = atoll(time.c_str());
+            struct tm* requestTm = localtime(&requestTime);
+            char requestStr[26];
+            strftime(requestStr, sizeof(requestStr), "%Y-%m-%d %H:%M:%S", requestTm);
+
+            Book details;
+            bool known = books->find(packStoredIsbn(isbn), details);
+            cout << "From branch: " << fromBranch << " | ISBN: " << isbn
+                 << " | Title: " << (known ? details.getTitle() : "(unknown)")
+                 << " | Requested by: " << requestedBy << " | On: " << requestStr << "\n";
+            count++;
+        }
+        if (count == 0) {
+            cout << "No transfer requests.\n";
+        }
+    }
+};
+
+BranchFederation federation;
+
+// One row of users.txt, copied out of the polymorphic User objects
+struct UserRecord {
+    string id;
+    string name;
+    string password;
+    int role;  // 0 student, 1 faculty, 2 librarian
+};
+
+vector<UserRecord> snapshotUsers() {
+    vector<UserRecord> records;
+    records.reserve(users.size());
+    for (const auto& p : users) {
+        records.push_back({p.first, p.second->getName(), p.second->getPassword(),
+                           dynamic_cast<Librarian*>(p.second) ? 2 :
+                           dynamic_cast<Faculty*>(p.second) ? 1 : 0});
+    }
+    return records;
+}
+
+// The live accounts for a new version, sharing previous's copy of every
+// account that has not changed since that copy was taken
+AccountSnapshot snapshotAccounts(const AccountSnapshot& previous) {
+    AccountSnapshot snapshot;
+    for (const auto& p : accounts) {
+        const shared_ptr<const Account>* old = previous.find(p.first);
+        if (old && (*old)->getRevision() == p.second.getRevision()) {
+            snapshot.append(p.first, *old);
+        } else {
+            snapshot.append(p.first, make_shared<const Account>(p.second));
+        }
+    }
+    return snapshot;
+}
+
+// previous with the accounts changed since it was taken brought up to date
+AccountSnapshot updateAccounts(const AccountSnapshot& previous) {
+    if (allAccountsChanged.exchange(false)) {
+        lock_guard<mutex> lock(changedAccountsMutex);
+        changedAccounts.clear();
+        return snapshotAccounts(previous);
+    }
+    unordered_set<string> changed;
+    {
+        lock_guard<mutex> lock(changedAccountsMutex);
+        changed.swap(changedAccounts);
+    }
+    AccountSnapshot snapshot = previous;
+    for (const string& id : changed) {
+        auto live = accounts.find(id);
+        if (live == accounts.end()) {
+            snapshot.erase(id);
+            continue;
+        }
+        shared_ptr<const Account>& copy = snapshot[id];
+        if (!copy || copy->getRevision() != live->second.getRevision()) {
+            copy = make_shared<const Account>(live->second);
+        }
+    }
+    // An account changed without being marked would show as a missing or
+    // extra entry; take everything again rather than publish a wrong version
+    if (snapshot.size() != accounts.size()) return snapshotAccounts(previous);
+    return snapshot;
+}
+
+void saveAccounts(const AccountSnapshot& source, bool compact);
+void saveUsers(const vector<UserRecord>& records);
+void saveLedger(const FineLedger& ledger);
+void saveCirculation(const CirculationStats& stats);
+
+// Multi-version view of the shared state. A commit publishes an immutable
+// copy of books, accounts, users and the fine ledger as a new version. The
+// copy is cheap: accounts, ledgers and circulation totals are kept in
+// chunks shared with the previous version, the changed accounts are known
+// (see markAccountChanged), and the user list and the bulk of the catalogue
+// are shared too, so a commit copies only what changed since the previous
+// version. Readers pin the current epoch and keep reading the version they
+// found, however long they take, while circulation goes on publishing newer ones.
+// A replaced version is retired with the epoch it was current in and freed
+// once every pinned reader has moved past that epoch (epoch-based
+// reclamation), so readers never lock and writers never wait for readers.
+struct DataVersion {
+    unsigned long long epoch = 0;
+    AccountSnapshot accounts;
+    shared_ptr<const BookStorage> books = make_shared<MemoryBookStorage>();
+    shared_ptr<const vector<UserRecord>> users = make_shared<const vector<UserRecord>>();
+    unsigned long long usersRevision = 0;  // usersRevision when users was taken
+    FineLedger ledger;
+    bool compact = false;
+    CirculationStats circulation;
+};
+
+class VersionStore {
+private:
+    static const int MAX_READERS = 64;
+
+    atomic<unsigned long long> globalEpoch;
+    atomic<unsigned long long> pinnedEpochs[MAX_READERS];  // 0 = slot free
+    atomic<const DataVersion*> current;
+    mutex retireMutex;
+    vector<pair<unsigned long long, const DataVersion*>> retired;  // Retire epoch, version
+
+    int pin() {
+        while (true) {
+            for (int slot = 0; slot < MAX_READERS; slot++) {
+                unsigned long long expected = 0;
+                if (pinnedEpochs[slot].compare_exchange_strong(expected, globalEpoch.load())) {
+                    return slot;
+                }
+            }
+            this_thread::yield();  // More concurrent readers than slots
+        }
+    }
+
+    void unpin(int slot) {
+        pinnedEpochs[slot].store(0);
+        reclaim();
+    }
+
+    // Free retired versions no pinned reader can still be looking at
+    void reclaim() {
+        lock_guard<mutex> lock(retireMutex);
+        if (retired.empty()) return;
+        unsigned long long oldestPinned = numeric_limits<unsigned long long>::max();
+        for (const auto& epoch : pinnedEpochs) {
+            unsigned long long pinned = epoch.load();
+            if (pinned != 0) oldestPinned = min(oldestPinned, pinned);
+        }
+        auto stillVisible = partition(retired.begin(), retired.end(),
+                                      [&](const pair<unsigned long long, const DataVersion*>& r) {
+                                          return r.first >= oldestPinned;
+                                      });
+        for (auto it = stillVisible; it != retired.end(); ++it) {
+            delete it->second;
+        }
+        retired.erase(stillVisible, retired.end());
+    }
+
+public:
+    // A pinned read of one version; the version stays alive until destruction
+    class ReadGuard {
+    private:
+        VersionStore* store;
+        int slot;
+        const DataVersion* version;
+
+    public:
+        ReadGuard(VersionStore* s) : store(s), slot(s->pin()), version(s->current.load()) {}
+        ~ReadGuard() { store->unpin(slot); }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        const DataVersion* operator->() const { return version; }
+        const DataVersion& operator*() const { return *version; }
+    };
+
+    VersionStore() : globalEpoch(1), current(new DataVersion) {
+        for (auto& epoch : pinnedEpochs) epoch.store(0);
+    }
+
+    ~VersionStore() {
+        for (const auto& r : retired) delete r.second;
+        delete current.load();
+    }
+
+    ReadGuard read() { return ReadGuard(this); }
+
+    unsigned long long currentEpoch() const { return current.load()->epoch; }
+
+    // Make version the one new readers see; returns its epoch
+    unsigned long long publish(DataVersion* version) {
+        lock_guard<mutex> lock(retireMutex);
+        unsigned long long epoch = globalEpoch.load();
+        version->epoch = epoch;
+        const DataVersion* previous = current.exchange(version);
+        retired.push_back({globalEpoch.fetch_add(1), previous});
+        return epoch;
+    }
+
+    // Snapshot the live containers into a new version and publish it
+    unsigned long long commit() {
+        DataVersion* version = new DataVersion;
+        {
+            ReadGuard previous(this);
+            version->accounts = updateAccounts(previous->accounts);
+            version->users = previous->usersRevision == usersRevision
+                                 ? previous->users
+                                 : make_shared<const vector<UserRecord>>(snapshotUsers());
+        }
+        version->usersRevision = usersRevision;
+        version->books = books->snapshot();
+        version->ledger = fineLedger;
+        version->circulation = circulation;
+        version->compact = compactStorage;
+        unsigned long long epoch = publish(version);
+        reclaim();
+        return epoch;
+    }
+};
+
+VersionStore versions;
+
+// Writes the data files on a background thread so that a patron never waits
+// on the disk. Every save commits a new version (see VersionStore) and wakes
+// the writer, which pins the newest version and writes that; saves made while
+// a write is pending are folded into it, so a burst of operations costs one
+// write. A version is written at most SAVE_DELAY_MS after it was committed,
+// and flush() (called on exit) waits until everything committed is on disk.
+// Every change is also in operations.log before the save is requested.
+class PersistenceWorker {
+private:
+    static constexpr int SAVE_DELAY_MS = 200;
+
+    mutex m;
+    condition_variable wake;     // A version is pending, a flush or shutdown
+    condition_variable written;  // A version reached the disk
+    unique_ptr<TrendingTracker> pendingTrending;  // Only when it changed
+    unsigned long long requested;
+    unsigned long long completed;
+    bool flushing;
+    bool stopping;
+    thread writer;
+
+    void run() {
+        unique_lock<mutex> lock(m);
+        while (true) {
+            wake.wait(lock, [this]() { return completed < requested || stopping; });
+            if (completed == requested) break;
+
+            // Let further saves coalesce into this write, up to the delay bound
+            wake.wait_for(lock, chrono::milliseconds(SAVE_DELAY_MS),
+                          [this]() { return flushing || stopping; });
+            unique_ptr<TrendingTracker> trendingCopy = move(pendingTrending);
+            lock.unlock();
+
+            unsigned long long epoch;
+            {
+                auto version = versions.read();
+                epoch = version->epoch;
+                write(*version, trendingCopy.get());
+            }
+
+            lock.lock();
+            completed = max(completed, epoch);
+            if (completed >= requested) flushing = false;
+            written.notify_all();
+        }
+    }
+
+    static void write(const DataVersion& version, TrendingTracker* trendingCopy) {
+        try {
+            saveAccounts(version.accounts, version.compact);
+            version.books->save();
+            saveUsers(*version.users);
+            saveLedger(version.ledger);
+            saveCirculation(version.circulation);
+            if (trendingCopy) trendingCopy->save("trending.dat");
+        } catch (const exception& e) {
+            events.record(EventLog::ERROR, "save.failed", {{"reason", e.what()}});
+        }
+    }
+
+public:
+    PersistenceWorker() : requested(0), completed(0), flushing(false), stopping(false) {}
+
+    ~PersistenceWorker() {
+        stop();
+    }
+
+    // Commit the current state for the writer; returns without touching the disk
+    void requestSave() {
+        unique_ptr<TrendingTracker> trendingCopy;
+        if (trending.isDirty()) {
+            trendingCopy = make_unique<TrendingTracker>(trending);
+            trending.markSaved();
+        }
+        unsigned long long epoch = versions.commit();
+
+        lock_guard<mutex> lock(m);
+        if (stopping) return;
+        if (trendingCopy) pendingTrending = move(trendingCopy);
+        requested = epoch;
+        if (!writer.joinable()) writer = thread(&PersistenceWorker::run, this);
+        wake.notify_all();
+    }
+
+    // Block until every committed save has been written
+    void flush() {
+        unique_lock<mutex> lock(m);
+        if (completed >= requested) return;
+        flushing = true;
+        wake.notify_all();
+        unsigned long long target = requested;
+        written.wait(lock, [&]() { return completed >= target; });
+    }
+
+    void stop() {
+        {
+            lock_guard<mutex> lock(m);
+            stopping = true;
+            wake.notify_all();
+        }
+        if (writer.joinable()) writer.join();
+    }
+};
+
+PersistenceWorker persistence;
+
+string jsonEscape(const string& text) {
+    bool plain = none_of(text.begin(), text.end(), [](char c) {
+        return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+    });
+    if (plain) return text;
+
+    string escaped;
+    for (char c : text) {
+        switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char code[8];
+                    snprintf(code, sizeof(code), "\\u%04x", c);
+                    escaped += code;
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+// Nightly due-soon reminders. Loans due in the next windowHours come from a
+// range scan of the due date index; patrons are split into shards by ID,
+// and each shard renders its reminders (one JSON line per patron) into its
+// own file on a separate thread. Titles and names come from the current
+// version (see VersionStore). The files are written to a staging directory
+// and replace the day's earlier files only once all are written, so a
+// second run on the same day never leaves reminders from the first behind.
+// Returns the number of patrons reminded.
+size_t generateDueReminders(int now, int windowHours, const string& spoolDirectory) {
+    long long until = min<long long>(now + (long long)windowHours * 60 * 60, numeric_limits<int>::max());
+    vector<DueDateIndex::Loan> due = dueIndex.range(now, (int)until);
+
+    error_code ec;
+    filesystem::create_directories(spoolDirectory, ec);
+    if (ec) {
+        cerr << "Error: Unable to create " << spoolDirectory << ": " << ec.message() << "\n";
+        return 0;
+    }
+
+    time_t nowTime = now;
+    char stamp[16];
+    strftime(stamp, sizeof(stamp), "%Y%m%d", localtime(&nowTime));
+    string prefix = string("reminders-") + stamp + "-";
+    string staging = spoolDirectory + "/." + prefix + "staging";
+    filesystem::remove_all(staging, ec);  // Left by an interrupted run
+    filesystem::create_directories(staging, ec);
+    if (ec) {
+        cerr << "Error: Unable to create " << staging << ": " << ec.message() << "\n";
+        return 0;
+    }
+
+    size_t shardCount = max(1u, thread::hardware_concurrency());
+    shardCount = due.empty() ? 0 : min(shardCount, due.size() / 1000 + 1);  // Small batches are not worth the threads
+    vector<vector<const DueDateIndex::Loan*>> shards(shardCount);
+    for (const auto& loan : due) {
+        shards[hash<string>()(loan.userId) % shardCount].push_back(&loan);
+    }
+
+    auto version = versions.read();
+    vector<size_t> reminded(shardCount, 0);
+    atomic<bool> failed(false);
+    mutex timeMutex;
+    vector<thread> workers;
+    for (size_t shard = 0; shard < shardCount; shard++) {
+        workers.emplace_back([&, shard]() {
+            // Group the shard's loans by patron, each patron's still in due date order
+            map<string, vector<const DueDateIndex::Loan*>> byPatron;
+            for (const auto* loan : shards[shard]) {
+                byPatron[loan->userId].push_back(loan);
+            }
+
+            const auto& records = *version->users;
+            unordered_map<int, string> dueText;  // Formatting dates is slow; loans share due minutes
+            ostringstream out;
+            for (const auto& patron : byPatron) {
+                auto record = lower_bound(records.begin(), records.end(), patron.first,
+                                          [](const UserRecord& r, const string& id) { return r.id < id; });
+                string name = (record != records.end() && record->id == patron.first) ? record->name : patron.first;
+
+                ostringstream message, loans;
+                message << "Dear " << name << ", the following "
+                        << (patron.second.size() == 1 ? "book is" : "books are") << " due within "
+                        << windowHours << " hours:";
+                for (size_t i = 0; i < patron.second.size(); i++) {
+                    const auto* loan = patron.second[i];
+                    Book details;
+                    string title = version->books->find(loan->isbn, details) ? details.getTitle() : unpackIsbn(loan->isbn);
+                    string& dueStr = dueText[loan->dueDate / 60];
+                    if (dueStr.empty()) {
+                        lock_guard<mutex> lock(timeMutex);  // localtime shares one buffer
+                        time_t dueTime = loan->dueDate;
+                        char buffer[26];
+                        strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M", localtime(&dueTime));
+                        dueStr = buffer;
+                    }
+
+                    message << (i ? "; " : " ") << title << " (due " << dueStr << ")";
+                    loans << (i ? "," : "") << "{\"isbn\":\"" << unpackIsbn(loan->isbn)
+                          << "\",\"title\":\"" << jsonEscape(title)
+                          << "\",\"due\":" << loan->dueDate << "}";
+                }
+                message << ". Please return or reissue them on time to avoid fines.";
+
+                out << "{\"user\":\"" << jsonEscape(patron.first) << "\",\"name\":\"" << jsonEscape(name)
+                    << "\",\"message\":\"" << jsonEscape(message.str()) << "\",\"loans\":[" << loans.str() << "]}\n";
+            }
+
+            string path = staging + "/" + prefix + to_string(shard) + ".jsonl";
+            ofstream file(path, ios::out);
+            file << out.str();
+            file.close();
+            if (!file) {
+                cerr << "Error: Unable to write " << path << "!\n";
+                failed = true;
+                return;
+            }
+            reminded[shard] = byPatron.size();
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (failed) {
+        filesystem::remove_all(staging, ec);
+        return 0;  // The day's earlier files, if any, stay as they were
+    }
+
+    // Replace the day's earlier files (whatever their shard count) with these
+    vector<filesystem::path> earlier;
+    for (const auto& entry : filesystem::directory_iterator(spoolDirectory, ec)) {
+        string name = entry.path().filename().string();
+        if (name.compare(0, prefix.size(), prefix) == 0) earlier.push_back(entry.path());
+    }
+    for (const auto& path : earlier) {
+        filesystem::remove(path, ec);
+    }
+    for (size_t shard = 0; shard < shardCount; shard++) {
+        string name = prefix + to_string(shard) + ".jsonl";
+        filesystem::rename(staging + "/" + name, spoolDirectory + "/" + name, ec);
+        if (ec) cerr << "Error: Unable to move " << name << " into " << spoolDirectory << ": " << ec.message() << "\n";
+    }
+    filesystem::remove_all(staging, ec);
+
+    size_t total = 0;
+    for (size_t count : reminded) total += count;
+    return total;
+}
+
+// Columnar export of circulation data for analysis: one row per history
+// entry (kind H, time = return date) and per current loan (kind L, time =
+// due date), grouped by account. Each column goes to its own file as a
+// sequence of segments, one per SEGMENT_ACCOUNTS accounts:
+//   user.col  dictionary of user IDs + run lengths (rows are grouped by user)
+//   kind.col  run lengths of H/L
+//   isbn.col  dictionary of ISBNs in the segment + one index per row
+//   time.col  first time, then zigzag deltas between consecutive rows
+// All numbers are varints; every segment is prefixed by its byte length so
+// a reader can skip it. Segments are encoded in parallel from a pinned
+// version, a bounded batch at a time, and written in account order.
+class ColumnarExporter {
+private:
+    static constexpr size_t SEGMENT_ACCOUNTS = 4096;
+    static constexpr const char* COLUMNS[4] = {"user", "kind", "isbn", "time"};
+
+    struct Segment {
+        string columns[4];
+        size_t rows;
+        size_t accounts;
+    };
+
+    static void encodeSegment(const vector<const Account*>& accounts, size_t begin, size_t end, Segment& segment) {
+        ostringstream user, kind, isbn, time;
+        vector<pair<char, unsigned long long>> kindRuns;
+        unordered_map<string, unsigned> isbnIndex;
+        vector<const string*> isbnDictionary;
+        vector<unsigned> isbnColumn;
+        vector<unsigned long long> userRuns;
+        long long previousTime = 0;
+        bool firstTime = true;
+        segment.rows = 0;
+        segment.accounts = end - begin;
+
+        auto addRow = [&](char rowKind, const string& rowIsbn, long long rowTime) {
+            if (kindRuns.empty() || kindRuns.back().first != rowKind) kindRuns.push_back({rowKind, 0});
+            kindRuns.back().second++;
+            auto inserted = isbnIndex.emplace(rowIsbn, isbnDictionary.size());
+            if (inserted.second) isbnDictionary.push_back(&inserted.first->first);
+            isbnColumn.push_back(inserted.first->second);
+            writeSignedVarint(time, firstTime ? rowTime : rowTime - previousTime);
+            previousTime = rowTime;
+            firstTime = false;
+            segment.rows++;
+        };
+
+        writeVarint(user, end - begin);
+        for (size_t i = begin; i < end; i++) {
+            const Account& account = *accounts[i];
+            writeCompactString(user, account.getUserID());
+            size_t rowsBefore = segment.rows;
+            for (const auto& history : account.getBorrowingHistory()) {
+                addRow('H', history.first, history.second);
+            }
+            for (const auto& loan : account.getBorrowedBooks()) {
+                addRow('L', unpackIsbn(loan.first), loan.second);
+            }
+            userRuns.push_back(segment.rows - rowsBefore);
+        }
+        for (unsigned long long run : userRuns) {
+            writeVarint(user, run);
+        }
+
+        writeVarint(kind, kindRuns.size());
+        for (const auto& run : kindRuns) {
+            kind.put(run.first);
+            writeVarint(kind, run.second);
+        }
+
+        writeVarint(isbn, isbnDictionary.size());
+        for (const string* entry : isbnDictionary) {
+            writeCompactString(isbn, *entry);
+        }
+        for (unsigned index : isbnColumn) {
+            writeVarint(isbn, index);
+        }
+
+        segment.columns[0] = user.str();
+        segment.columns[1] = kind.str();
+        segment.columns[2] = isbn.str();
+        segment.columns[3] = time.str();
+    }
+
+public:
+    // Returns the number of rows exported, or -1 if the files could not be written
+    static long long exportTo(const string& directory) {
+        error_code ec;
+        filesystem::create_directories(directory, ec);
+        if (ec) {
+            cerr << "Error: Unable to create " << directory << ": " << ec.message() << "\n";
+            return -1;
+        }
+
+        ofstream files[4];
+        for (int c = 0; c < 4; c++) {
+            files[c].open(directory + "/" + COLUMNS[c] + ".col", ios::out | ios::binary);
+            if (!files[c]) {
+                cerr << "Error: Unable to create/open " << directory << "/" << COLUMNS[c] << ".col for writing!\n";
+                return -1;
+            }
+            files[c].write("LMSC", 4);
+            files[c].put(1);
+        }
+
+        auto version = versions.read();
+        vector<const Account*> accounts;
+        accounts.reserve(version->accounts.size());
+        version->accounts.forEach([&](const string&, const shared_ptr<const Account>& account) {
+            accounts.push_back(account.get());
+        });
+
+        // Encode a batch of segments in parallel, write them in order, repeat:
+        // memory stays bounded by one batch whatever the history size
+        size_t workers = max(1u, thread::hardware_concurrency());
+        size_t segmentCount = (accounts.size() + SEGMENT_ACCOUNTS - 1) / SEGMENT_ACCOUNTS;
+        vector<pair<size_t, size_t>> manifest;  // Rows, accounts per segment
+        long long totalRows = 0;
+        for (size_t first = 0; first < segmentCount; first += workers) {
+            size_t batch = min(workers, segmentCount - first);
+            vector<Segment> segments(batch);
+            vector<thread> threads;
+            for (size_t i = 0; i < batch; i++) {
+                size_t begin = (first + i) * SEGMENT_ACCOUNTS;
+                size_t end = min(accounts.size(), begin + SEGMENT_ACCOUNTS);
+                threads.emplace_back(encodeSegment, cref(accounts), begin, end, ref(segments[i]));
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+            for (const auto& segment : segments) {
+                for (int c = 0; c < 4; c++) {
+                    writeVarint(files[c], segment.columns[c].size());
+                    files[c].write(segment.columns[c].data(), segment.columns[c].size());
+                }
+                manifest.push_back({segment.rows, segment.accounts});
+                totalRows += segment.rows;
+            }
+        }
+
+        ofstream manifestFile(directory + "/manifest.txt", ios::out);
+        manifestFile << "rows " << totalRows << "\n"
+                     << "accounts " << accounts.size() << "\n"
+                     << "segments " << manifest.size() << "\n";
+        for (const auto& entry : manifest) {
+            manifestFile << entry.first << " " << entry.second << "\n";
+        }
+        for (auto& file : files) {
+            file.close();
+            if (!file) return -1;
+        }
+        return totalRows;
+    }
+};
+
+// Semester rollover: brings the patrons in line with a roster file in one
+// batch. Each roster line is "id,name,password,role" with role student or
+// faculty (names may contain commas; blank lines, # comments and an "id,..."
+// header are skipped). Patrons on the roster are created or updated;
+// students and faculty missing from it are expired, except those still
+// holding books or owing fines, who are kept and reported. Librarians are
+// never touched. The roster is parsed and matched against the users in
+// parallel, the changes are applied in one pass and logged with a single
+// flush, and the caller saves once.
+class SemesterRollover {
+public:
+    struct Flagged {
+        string id;
+        string name;
+        size_t loans;
+        Paise fines;
+    };
+
+    struct Report {
+        size_t created = 0;
+        size_t updated = 0;
+        size_t unchanged = 0;
+        size_t expired = 0;
+        vector<Flagged> flagged;
+        vector<pair<size_t, string>> errors;  // Roster line, problem
+    };
+
+private:
+    enum Action { SKIP, CREATE, UPDATE, UNCHANGED };
+
+    struct Entry {
+        string id, name, password;
+        bool faculty;
+        Action action;
+    };
+
+    // Run work(begin, end) over [0, count) on up to one thread per core
+    static void runSharded(size_t count, const function<void(size_t, size_t)>& work) {
+        size_t shardCount = max(1u, thread::hardware_concurrency());
+        shardCount = min(shardCount, count / 1000 + 1);  // Small batches are not worth the threads
+        size_t shardSize = (count + shardCount - 1) / shardCount;
+        vector<thread> workers;
+        for (size_t begin = 0; begin < count; begin += shardSize) {
+            workers.emplace_back(work, begin, min(count, begin + shardSize));
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    static string trim(const string& text) {
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == string::npos) return "";
+        return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+    }
+
+    // Returns an error message, or "" if the line is valid or has nothing on it
+    static string parseLine(const string& line, Entry& entry) {
+        entry.action = SKIP;
+        string text = trim(line);
+        if (text.empty() || text[0] == '#') return "";
+        size_t firstComma = text.find(',');
+        size_t lastComma = text.rfind(',');
+        size_t passwordComma = lastComma == string::npos || lastComma == 0 ? string::npos : text.rfind(',', lastComma - 1);
+        if (firstComma == string::npos || passwordComma == string::npos || passwordComma <= firstComma) {
+            return "expected id,name,password,role";
+        }
+        entry.id = trim(text.substr(0, firstComma));
+        entry.name = trim(text.substr(firstComma + 1, passwordComma - firstComma - 1));
+        entry.password = trim(text.substr(passwordComma + 1, lastComma - passwordComma - 1));
+        string role = trim(text.substr(lastComma + 1));
+        transform(role.begin(), role.end(), role.begin(), [](unsigned char c) { return tolower(c); });
+
+        if (entry.id == "id") return "";  // Header line
+        if (entry.id.empty() || entry.id.find_first_of(" \t") != string::npos) return "invalid user ID";
+        if (entry.name.empty()) return "missing name";
+        if (entry.password.empty()) return "missing password";
+        if (role != "student" && role != "faculty") return "role must be student or faculty";
+        entry.faculty = role == "faculty";
+        entry.action = CREATE;
+        return "";
+    }
+
+public:
+    static bool run(const string& rosterPath, Report& report) {
+        ifstream file(rosterPath);
+        if (!file) {
+            cerr << "Error: Unable to open roster " << rosterPath << "!\n";
+            return false;
+        }
+        vector<string> lines;
+        string line;
+        while (getline(file, line)) {
+            lines.push_back(line);
+        }
+
+        vector<Entry> entries(lines.size());
+        vector<string> lineErrors(lines.size());
+        runSharded(lines.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                lineErrors[i] = parseLine(lines[i], entries[i]);
+            }
+        });
+
+        // A patron listed twice keeps the first line
+        unordered_map<string, size_t> onRoster;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (!lineErrors[i].empty()) {
+                report.errors.push_back({i + 1, lineErrors[i]});
+                continue;
+            }
+            if (entries[i].action == SKIP) continue;
+            auto inserted = onRoster.emplace(entries[i].id, i);
+            if (!inserted.second) {
+                report.errors.push_back({i + 1, entries[i].id + " already listed on line " +
+                                                   to_string(inserted.first->second + 1)});
+                entries[i].action = SKIP;
+            }
+        }
+
+        // Decide what happens to every roster entry and every current patron;
+        // users, accounts and the ledger are only read until the batch is applied
+        vector<pair<const string*, User*>> patrons;
+        for (const auto& p : users) {
+            if (!dynamic_cast<Librarian*>(p.second)) patrons.push_back({&p.first, p.second});
+        }
+        vector<char> keepPatron(patrons.size(), 0);  // 0 expire, 1 on roster, 2 flagged
+        mutex reportMutex;
+        runSharded(entries.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                Entry& entry = entries[i];
+                if (entry.action == SKIP) continue;
+                auto it = users.find(entry.id);
+                if (it == users.end()) continue;
+                if (dynamic_cast<Librarian*>(it->second)) {
+                    lock_guard<mutex> lock(reportMutex);
+                    report.errors.push_back({i + 1, entry.id + " is a librarian"});
+                    entry.action = SKIP;
+                    continue;
+                }
+                bool sameRole = (dynamic_cast<Faculty*>(it->second) != nullptr) == entry.faculty;
+                entry.action = sameRole && it->second->getName() == entry.name &&
+                               it->second->getPassword() == entry.password ? UNCHANGED : UPDATE;
+            }
+        });
+        runSharded(patrons.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const string& id = *patrons[i].first;
+                if (onRoster.count(id)) {
+                    keepPatron[i] = 1;
+                    continue;
+                }
+                const Account& account = patrons[i].second->getAccount();
+                Paise fines = max(account.getTotalFine(), fineLedger.balance(id));
+                if (!account.getBorrowedBooks().empty() || fines > 0) {
+                    keepPatron[i] = 2;
+                    lock_guard<mutex> lock(reportMutex);
+                    report.flagged.push_back({id, patrons[i].second->getName(),
+                                              account.getBorrowedBooks().size(), fines});
+                }
+            }
+        });
+        sort(report.errors.begin(), report.errors.end());
+        sort(report.flagged.begin(), report.flagged.end(),
+             [](const Flagged& a, const Flagged& b) { return a.id < b.id; });
+
+        // Apply the batch
+        vector<pair<string, vector<string>>> operations;
+        for (const auto& entry : entries) {
+            if (entry.action == SKIP) continue;
+            if (entry.action == UNCHANGED) {
+                report.unchanged++;
+                continue;
+            }
+            if (entry.action == UPDATE) {
+                delete users[entry.id];  // The account stays; the new user takes it over
+                report.updated++;
+            } else {
+                report.created++;
             }
+            if (entry.faculty) users[entry.id] = new Faculty(entry.id, entry.name, entry.password);
+            else users[entry.id] = new Student(entry.id, entry.name, entry.password);
+            fuzzyIndex.add(FuzzyIndex::USER_NAME, entry.id, entry.name);
+            operations.push_back({entry.action == UPDATE ? "UPDATE_USER" : "ADD_USER",
+                                  {entry.id, entry.name, entry.password, entry.faculty ? "1" : "0"}});
         }
-
-        // If we get here, either the book is not overdue or the fine has been paid
-        addToHistory(isbn, currentDate);
-        borrowedBooks.erase(it);
-        books[isbn].setAvailability(true);
-        cout << "\nBook returned successfully.\n";
-        cout << "Book status updated to: Available\n";
+        for (size_t i = 0; i < patrons.size(); i++) {
+            if (keepPatron[i]) continue;
+            string id = *patrons[i].first;
+            delete patrons[i].second;
+            users.erase(id);
+            dueIndex.removeAll(id, accounts[id].getBorrowedBooks());
+            recommender.removePatron(accounts[id].getBorrowingHistory());
+            accounts.erase(id);
+            markAccountChanged(id);
+            fineLedger.removeAccount(id);
+            fuzzyIndex.remove(FuzzyIndex::USER_NAME, id);
+            operations.push_back({"REMOVE_USER", {id}});
+            report.expired++;
+        }
+        opLog.recordAll(operations);
         return true;
     }
 
-    void updateFines(int currentDate) const {
-        if (isFaculty) return; // Faculty members don't get fines
-
-        double newTotalFine = 0;
-        
-        for (const auto& book : borrowedBooks) {
-            const string& isbn = book.first;
-            int dueDate = book.second;
-            
-            // Convert dates to time_t for proper comparison
-            time_t dueTime = dueDate;
-            time_t currentTime = currentDate;
-            
-            // Calculate overdue days using difftime
-            double secondsOverdue = difftime(currentTime, dueTime);
-            int daysOverdue = static_cast<int>(secondsOverdue / (24 * 60 * 60));
-            
-            if (daysOverdue > 0) {
-                // Calculate fine based on days overdue
-                double fine = daysOverdue * 10.0;  // 10 rupees per day
-                bookFines[isbn] = fine;
-                newTotalFine += fine;
-                
-                // Convert dates to human-readable format
-                struct tm* dueTm = localtime(&dueTime);
-                struct tm* currentTm = localtime(&currentTime);
-                char dueStr[26], currentStr[26];
-                strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
-                strftime(currentStr, sizeof(currentStr), "%Y-%m-%d %H:%M:%S", currentTm);
-
-                cout << "\n=== Fine Update for Book " << isbn << " ===\n";
-                auto bookIt = books.find(isbn);
-                if (bookIt != books.end()) {
-                    cout << "Title: " << bookIt->second.getTitle() << "\n";
-                }
-                cout << "Due Date: " << dueStr << "\n";
-                cout << "Current Date: " << currentStr << "\n";
-                cout << "Days Overdue: " << daysOverdue << "\n";
-                cout << "Fine Rate: 10 rupees per day\n";
-                cout << "Current Fine: " << fine << " rupees\n";
+    static void print(const Report& report) {
+        cout << "\n=== Semester Rollover ===\n"
+             << "Created: " << report.created << "\n"
+             << "Updated: " << report.updated << "\n"
+             << "Unchanged: " << report.unchanged << "\n"
+             << "Expired: " << report.expired << "\n";
+        if (!report.flagged.empty()) {
+            cout << "\nNot expired, still holding books or owing fines (" << report.flagged.size() << "):\n";
+            for (const auto& patron : report.flagged) {
+                cout << "ID: " << patron.id << ", Name: " << patron.name
+                     << ", Books on loan: " << patron.loans
+                     << ", Fines: " << formatRupees(patron.fines) << " rupees\n";
             }
         }
-        
-        // Update total fine with new calculations
-        totalFine = newTotalFine;
-        
-        if (totalFine > 0) {
-            cout << "\nTotal Fine Amount: " << totalFine << " rupees\n";
+        if (!report.errors.empty()) {
+            cout << "\nRoster lines skipped (" << report.errors.size() << "):\n";
+            for (const auto& error : report.errors) {
+                cout << "line " << error.first << ": " << error.second << "\n";
+            }
         }
     }
+};
 
-    void displayAccountDetails(int currentDate) const {
-        // Recalculate fines before displaying
-        updateFines(currentDate);
-        
-        cout << "\n=== Account Details ===\n";
-        cout << "User ID: " << userID << "\n";
-        cout << "User Type: " << (isFaculty ? "Faculty" : "Student") << "\n";
-        cout << "Maximum Books Allowed: " << maxBooks << "\n";
-        cout << "Maximum Days Allowed: " << maxDays << " days\n";
-        if (!isFaculty) {
-            cout << "Current Total Fine: " << totalFine << " rupees\n";
+// fsck for the library data: cross-checks the catalogue, the accounts and
+// the users, which are saved to separate files and can drift apart (a user
+// removed with books still on loan, a book removed while borrowed, files
+// restored from different times). Loans and history entries are gathered
+// from all accounts in parallel and partitioned by ISBN into shards, each
+// shard builds its own hash table, and one pass over the catalogue probes
+// them, so every book and account is visited once. With repair on, what
+// can be fixed safely is fixed; the rest is only reported.
+class ConsistencyChecker {
+public:
+    struct Category {
+        string title;
+        size_t count = 0;
+        size_t repaired = 0;
+        vector<string> samples = {};  // The first SAMPLES problems found
+
+        // describe() is only called for the problems kept as samples
+        template <typename Describe>
+        void add(Describe describe) {
+            if (samples.size() < SAMPLES) samples.push_back(describe());
+            count++;
         }
-        
-        cout << "\n=== Currently Borrowed Books ===\n";
-        if (borrowedBooks.empty()) {
-            cout << "No books currently borrowed.\n";
-        } else {
-            for (const auto& book : borrowedBooks) {
-                auto bookIt = books.find(book.first);
-                if (bookIt != books.end()) {
-                    cout << "\nBook Details:\n";
-                    cout << "ISBN: " << book.first << "\n";
-                    cout << "Title: " << bookIt->second.getTitle() << "\n";
-                    cout << "Author: " << bookIt->second.getAuthor() << "\n";
-                    
-                    // Convert due date to human-readable format
-                    time_t dueTime = book.second;
-                    struct tm* dueTm = localtime(&dueTime);
-                    char dueStr[26];
-                    strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
-                    cout << "Due Date: " << dueStr << "\n";
-                    
-                    // Calculate if overdue
-                    int secondsOverdue = currentDate - book.second;
-                    int daysOverdue = secondsOverdue / (24 * 60 * 60);
-                    if (daysOverdue > 0) {
-                        cout << "Status: OVERDUE by " << daysOverdue << " days\n";
-                        if (!isFaculty) {
-                            cout << "Fine Amount: " << (daysOverdue * 10.0) << " rupees\n";
-                        }
-                    } else {
-                        cout << "Status: On time\n";
-                    }
-                    cout << "------------------------\n";
+    };
+
+    struct Report {
+        size_t books = 0;
+        size_t accounts = 0;
+        size_t loans = 0;
+        size_t historyEntries = 0;
+        Category availability{"Books whose availability disagrees with the loans"};
+        Category sharedLoans{"Books on loan to more than one account"};
+        Category danglingLoans{"Loans of books not in the catalogue"};
+        Category deletedHistory{"Books not in the catalogue but still in borrowing histories"};
+        Category orphanAccounts{"Accounts without a user"};
+    };
+
+    static constexpr size_t SAMPLES = 10;
+
+private:
+    struct LoanRef {
+        IsbnKey key;
+        unsigned account;
+    };
+
+    // Everything the accounts say about one ISBN
+    struct IsbnUse {
+        vector<unsigned> borrowers;
+        size_t historyEntries = 0;
+        bool inCatalogue = false;
+    };
+
+    static size_t shardOf(IsbnKey key, size_t shardCount) {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) % shardCount;
+    }
+
+    // Run work(worker) on every worker in [0, count) in its own thread
+    static void runEach(size_t count, const function<void(size_t)>& work) {
+        vector<thread> threads;
+        for (size_t i = 0; i < count; i++) {
+            threads.emplace_back(work, i);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+public:
+    static Report check(bool repair) {
+        Report report;
+        vector<pair<const string*, Account*>> accountList;
+        accountList.reserve(accounts.size());
+        for (auto& p : accounts) {
+            accountList.push_back({&p.first, &p.second});
+        }
+        report.accounts = accountList.size();
+
+        size_t shardCount = max(1u, thread::hardware_concurrency());
+        shardCount = min(shardCount, accountList.size() / 1000 + 1);  // Small libraries are not worth the threads
+        size_t sliceSize = (accountList.size() + shardCount - 1) / shardCount;
+
+        // Each worker partitions the loans and history of its slice of accounts by shard
+        vector<vector<vector<LoanRef>>> loansOut(shardCount, vector<vector<LoanRef>>(shardCount));
+        vector<vector<unordered_map<IsbnKey, size_t>>> historyOut(shardCount, vector<unordered_map<IsbnKey, size_t>>(shardCount));
+        vector<vector<unsigned>> orphans(shardCount);
+        vector<size_t> loanCounts(shardCount, 0), historyCounts(shardCount, 0);
+        runEach(shardCount, [&](size_t worker) {
+            size_t end = min(accountList.size(), (worker + 1) * sliceSize);
+            for (size_t i = worker * sliceSize; i < end; i++) {
+                const Account& account = *accountList[i].second;
+                if (users.find(*accountList[i].first) == users.end()) orphans[worker].push_back(i);
+                for (const auto& loan : account.getBorrowedBooks()) {
+                    loansOut[worker][shardOf(loan.first, shardCount)].push_back({loan.first, static_cast<unsigned>(i)});
                 }
+                for (const auto& entry : account.getBorrowingHistory()) {
+                    IsbnKey key = packIsbn(entry.first);
+                    historyOut[worker][shardOf(key, shardCount)][key]++;
+                }
+                loanCounts[worker] += account.getBorrowedBooks().size();
+                historyCounts[worker] += account.getBorrowingHistory().size();
             }
+        });
+        for (size_t worker = 0; worker < shardCount; worker++) {
+            report.loans += loanCounts[worker];
+            report.historyEntries += historyCounts[worker];
         }
-        
-        cout << "\n=== Borrowing History ===\n";
-        if (borrowingHistory.empty()) {
-            cout << "No borrowing history.\n";
-        } else {
-            for (const auto& history : borrowingHistory) {
-                auto bookIt = books.find(history.first);
-                if (bookIt != books.end()) {
-                    cout << "\nBook Details:\n";
-                    cout << "ISBN: " << history.first << "\n";
-                    cout << "Title: " << bookIt->second.getTitle() << "\n";
-                    cout << "Author: " << bookIt->second.getAuthor() << "\n";
-                    
-                    // Convert return date to human-readable format
-                    time_t returnTime = history.second;
-                    struct tm* returnTm = localtime(&returnTime);
-                    char returnStr[26];
-                    strftime(returnStr, sizeof(returnStr), "%Y-%m-%d %H:%M:%S", returnTm);
-                    cout << "Return Date: " << returnStr << "\n";
-                    cout << "------------------------\n";
+
+        // Build side of the join: one hash table per shard, built in parallel
+        vector<unordered_map<IsbnKey, IsbnUse>> tables(shardCount);
+        runEach(shardCount, [&](size_t shard) {
+            auto& table = tables[shard];
+            for (size_t worker = 0; worker < shardCount; worker++) {
+                for (const auto& loan : loansOut[worker][shard]) {
+                    table[loan.key].borrowers.push_back(loan.account);
+                }
+                for (const auto& entry : historyOut[worker][shard]) {
+                    table[entry.first].historyEntries += entry.second;
+                }
+                vector<LoanRef>().swap(loansOut[worker][shard]);
+                unordered_map<IsbnKey, size_t>().swap(historyOut[worker][shard]);
+            }
+        });
+
+        // Probe side: one pass over the catalogue
+        vector<IsbnKey> markAvailable, markBorrowed;
+        books->forEach([&](IsbnKey key, const Book& book) {
+            report.books++;
+            auto& table = tables[shardOf(key, shardCount)];
+            auto it = table.find(key);
+            bool onLoan = false;
+            if (it != table.end()) {
+                it->second.inCatalogue = true;
+                onLoan = !it->second.borrowers.empty();
+            }
+            if (book.isAvailable() && onLoan) {
+                report.availability.add([&]() {
+                    return unpackIsbn(key) + " is marked available but is on loan to " +
+                           *accountList[it->second.borrowers[0]].first;
+                });
+                markBorrowed.push_back(key);
+            } else if (!book.isAvailable() && !onLoan) {
+                report.availability.add([&]() { return unpackIsbn(key) + " is marked borrowed but nobody has it"; });
+                markAvailable.push_back(key);
+            }
+        });
+
+        // What the catalogue did not answer for, shard by shard
+        vector<Report> partial(shardCount);
+        vector<vector<IsbnKey>> goneByShard(shardCount);
+        runEach(shardCount, [&](size_t shard) {
+            for (const auto& entry : tables[shard]) {
+                const IsbnUse& use = entry.second;
+                if (use.borrowers.size() > 1) {
+                    partial[shard].sharedLoans.add([&]() {
+                        string holders;
+                        for (unsigned account : use.borrowers) {
+                            holders += (holders.empty() ? "" : ", ") + *accountList[account].first;
+                        }
+                        return unpackIsbn(entry.first) + " is on loan to " + holders;
+                    });
+                }
+                if (use.inCatalogue) continue;
+                for (unsigned account : use.borrowers) {
+                    partial[shard].danglingLoans.add([&]() {
+                        return unpackIsbn(entry.first) + " on loan to " + *accountList[account].first;
+                    });
+                }
+                if (use.historyEntries > 0) {
+                    partial[shard].deletedHistory.add([&]() {
+                        return unpackIsbn(entry.first) + " (" + to_string(use.historyEntries) + " history entries)";
+                    });
+                    goneByShard[shard].push_back(entry.first);
                 }
             }
+        });
+        auto merge = [](Category& into, const Category& from) {
+            into.count += from.count;
+            for (const auto& sample : from.samples) {
+                if (into.samples.size() < SAMPLES) into.samples.push_back(sample);
+            }
+        };
+        unordered_set<IsbnKey> gone;
+        for (size_t shard = 0; shard < shardCount; shard++) {
+            merge(report.sharedLoans, partial[shard].sharedLoans);
+            merge(report.danglingLoans, partial[shard].danglingLoans);
+            merge(report.deletedHistory, partial[shard].deletedHistory);
+            gone.insert(goneByShard[shard].begin(), goneByShard[shard].end());
+        }
+        vector<unsigned> orphanAccounts;
+        for (const auto& found : orphans) {
+            orphanAccounts.insert(orphanAccounts.end(), found.begin(), found.end());
+        }
+        for (unsigned account : orphanAccounts) {
+            const Account& orphan = *accountList[account].second;
+            report.orphanAccounts.add([&]() {
+                return *accountList[account].first + " (" + to_string(orphan.getBorrowedBooks().size()) +
+                       " books on loan, fines " + formatRupees(orphan.getTotalFine()) + " rupees)";
+            });
+        }
+
+        if (!repair) return report;
+
+        // Availability follows the loans
+        for (IsbnKey key : markAvailable) {
+            if (books->setAvailability(key, true)) report.availability.repaired++;
+        }
+        for (IsbnKey key : markBorrowed) {
+            if (books->setAvailability(key, false)) report.availability.repaired++;
+        }
+
+        // History of books that no longer exist, each account pruning its own
+        if (!gone.empty()) {
+            runEach(shardCount, [&](size_t worker) {
+                size_t end = min(accountList.size(), (worker + 1) * sliceSize);
+                for (size_t i = worker * sliceSize; i < end; i++) {
+                    accountList[i].second->removeHistoryOf(gone);
+                }
+            });
+            recommender.removeBooks(gone);
+            report.deletedHistory.repaired = gone.size();
+        }
+
+        // Orphan accounts that owe nothing and hold nothing are dropped; the
+        // rest keep their loans and fines on record until they are settled
+        for (unsigned account : orphanAccounts) {
+            string id = *accountList[account].first;
+            const Account& orphan = *accountList[account].second;
+            if (!orphan.getBorrowedBooks().empty() || orphan.getTotalFine() > 0 || fineLedger.balance(id) > 0) continue;
+            recommender.removePatron(orphan.getBorrowingHistory());
+            accounts.erase(id);
+            markAccountChanged(id);
+            fineLedger.removeAccount(id);
+            report.orphanAccounts.repaired++;
         }
+
+        // Repairs are not operations; restores and replicas start again from
+        // the checkpoint taken here, which the REPAIR marker points them to
+        opLog.record("REPAIR", {});
+        opLog.writeCheckpoint();
+        return report;
     }
 
-    void saveToFile(ofstream &outfile) const {
-        outfile << userID << "\n" 
-               << fixed << totalFine << "\n" 
-               << (isFaculty ? "1" : "0") << "\n" 
-               << maxBooks << "\n" 
-               << maxDays << "\n";
-        
-        // Save borrowed books and their details
-        outfile << borrowedBooks.size() << "\n";
-        for (const auto &book : borrowedBooks) {
-            outfile << book.first << "\n"  // ISBN
-                   << book.second << "\n"  // Due date
-                   << (lastFinePaidTime.count(book.first) ? lastFinePaidTime.at(book.first) : book.second) << "\n"  // Last fine paid time
-                   << (bookFines.count(book.first) ? bookFines.at(book.first) : 0.0) << "\n";  // Current fine
+    static void print(const Report& report) {
+        cout << "\n=== Consistency Check ===\n"
+             << "Checked " << report.books << " books, " << report.accounts << " accounts, "
+             << report.loans << " loans and " << report.historyEntries << " history entries.\n";
+        const Category* categories[] = {&report.availability, &report.sharedLoans, &report.danglingLoans,
+                                        &report.deletedHistory, &report.orphanAccounts};
+        size_t problems = 0;
+        for (const Category* category : categories) {
+            problems += category->count;
+            if (category->count == 0) continue;
+            cout << "\n" << category->title << ": " << category->count;
+            if (category->repaired > 0) cout << " (" << category->repaired << " repaired)";
+            cout << "\n";
+            for (const auto& sample : category->samples) {
+                cout << "- " << sample << "\n";
+            }
+            if (category->count > category->samples.size()) {
+                cout << "- ... and " << category->count - category->samples.size() << " more\n";
+            }
         }
-        
-        // Save borrowing history
-        outfile << borrowingHistory.size() << "\n";
-        for (const auto &history : borrowingHistory) {
-            outfile << history.first << "\n"   // ISBN
-                   << history.second << "\n";   // Return date
+        if (problems == 0) cout << "No problems found.\n";
+    }
+};
+
+// Near-duplicate catalogue records: the same book entered under several
+// ISBNs with slightly different title, author or publisher text. Each
+// record becomes a set of shingles (the character trigrams of each field,
+// tagged with the field), and a MinHash signature of SIGNATURE_SIZE values
+// summarises the set; two signatures agree in any one position with
+// probability equal to the Jaccard similarity of the two sets. Signatures
+// are computed in parallel slices of the catalogue. They are then cut into
+// BANDS bands of ROWS values, and records whose band matches exactly share a
+// bucket and become candidates (locality-sensitive hashing), so records are
+// only ever compared with the few that are likely to be similar. Candidates
+// whose signatures roughly agree are scored by the exact similarity of their
+// shingles, pairs at or above THRESHOLD are joined into clusters, and each
+// cluster keeps its most borrowed record and proposes merging the others
+// into it. Nothing is changed; the proposals are for a librarian to review.
+class DuplicateFinder {
+public:
+    struct Proposal {
+        IsbnKey keep, merge;
+        double similarity;  // Of merge to keep, at least THRESHOLD
+    };
+
+    // A record in a group that is similar to another member (via) but not
+    // to the record kept; it gets no merge proposal of its own
+    struct Related {
+        IsbnKey keep, record, via;
+        double similarity;  // Of record to via
+    };
+
+    struct Report {
+        size_t records = 0;
+        size_t candidates = 0;  // Pairs sharing a bucket, once per band they share
+        size_t compared = 0;    // Candidates scored exactly
+        size_t clusters = 0;
+        vector<Proposal> proposals;  // Most similar first
+        vector<Related> related;
+        double elapsedMs = 0;
+    };
+
+    static constexpr double THRESHOLD = 0.7;
+    static constexpr size_t SAMPLES = 10;
+
+private:
+    static constexpr int ROWS = 4;   // 16-bit values, so a band is one 64-bit key
+    static constexpr int BANDS = 16;
+    static constexpr int SIGNATURE_SIZE = ROWS * BANDS;
+    static constexpr double ESTIMATE_MARGIN = 0.15;  // Signatures estimate similarity to about +-0.06
+    static constexpr size_t BUCKET_WINDOW = 32;      // A record is paired with this many bucket neighbours
+
+    typedef array<uint16_t, SIGNATURE_SIZE> Signature;
+
+    static vector<unsigned> shingles(const Book& book) {
+        vector<unsigned> all;
+        const string fields[] = {book.getTitle(), book.getAuthor(), book.getPublisher()};
+        for (unsigned field = 0; field < 3; field++) {
+            for (unsigned gram : FuzzyIndex::trigrams(FuzzyIndex::fold(fields[field]))) {
+                all.push_back((field + 1) << 24 | gram);
+            }
         }
+        sort(all.begin(), all.end());
+        return all;
     }
-    
-    void loadFromFile(ifstream &infile, int currentDate) {
-        infile >> userID >> totalFine;
-        
-        string facultyStr;
-        infile >> facultyStr;
-        isFaculty = (facultyStr == "1");
-        
-        infile >> maxBooks >> maxDays;
-        infile.ignore();
 
-        int numBorrowed;
-        infile >> numBorrowed;
-        infile.ignore();
-        
-        borrowedBooks.clear();
-        lastFinePaidTime.clear();
-        bookFines.clear();
-        
-        for (int i = 0; i < numBorrowed; i++) {
-            string isbn;
-            int dueDate, lastPaidTime;
-            double fine;
-            getline(infile, isbn);
-            infile >> dueDate >> lastPaidTime >> fine;
-            infile.ignore();
-            
-            borrowedBooks[isbn] = dueDate;
-            lastFinePaidTime[isbn] = lastPaidTime;
-            if (fine > 0) bookFines[isbn] = fine;
+    // One multiply-shift hash per position; its minimum over the shingles
+    // is kept to 16 bits, which changes the agreement rate by 1 in 65536
+    static Signature sign(const vector<unsigned>& set) {
+        static const auto multipliers = []() {
+            array<pair<uint64_t, uint64_t>, SIGNATURE_SIZE> m;
+            mt19937_64 seeds(0x4C4D5348);
+            for (auto& p : m) {
+                p = {seeds() | 1, seeds()};
+            }
+            return m;
+        }();
+        Signature signature;
+        for (int i = 0; i < SIGNATURE_SIZE; i++) {
+            uint64_t lowest = UINT64_MAX;
+            for (unsigned shingle : set) {
+                lowest = min(lowest, multipliers[i].first * (shingle + 1) + multipliers[i].second);
+            }
+            signature[i] = static_cast<uint16_t>(lowest >> 48);
         }
+        return signature;
+    }
 
-        // Recalculate fines after loading to ensure consistency
-        updateFines(currentDate);
+    static double jaccard(const vector<unsigned>& a, const vector<unsigned>& b) {
+        size_t shared = 0, i = 0, j = 0;
+        while (i < a.size() && j < b.size()) {
+            if (a[i] < b[j]) i++;
+            else if (b[j] < a[i]) j++;
+            else {
+                shared++;
+                i++;
+                j++;
+            }
+        }
+        size_t total = a.size() + b.size() - shared;
+        return total ? double(shared) / total : 0;
+    }
 
-        int numHistory;
-        infile >> numHistory;
-        infile.ignore();
-        
-        borrowingHistory.clear();
-        for (int i = 0; i < numHistory; i++) {
-            string isbn;
-            int returnDate;
-            getline(infile, isbn);
-            infile >> returnDate;
-            infile.ignore();
-            borrowingHistory.push_back({isbn, returnDate});
+    static size_t find(vector<size_t>& parent, size_t i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
         }
+        return i;
     }
-};
 
-class User {
-protected:
-    string id;
-    string name;
-    string password;
-    Account &account;
+    // Run work(worker) on every worker in [0, count) in its own thread
+    static void runEach(size_t count, const function<void(size_t)>& work) {
+        vector<thread> threads;
+        for (size_t i = 0; i < count; i++) {
+            threads.emplace_back(work, i);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
 
 public:
-    User(string userId, string userName, string pwd, bool isFaculty = false) 
-        : id(userId), name(userName), password(pwd), account(accounts[userId]) {
-        // Create a new account only if one doesn't exist
-        if (accounts.find(userId) == accounts.end()) {
-            accounts[userId] = Account(userId, isFaculty);
-        } else {
-            // Update existing account's faculty status
-            accounts[userId].isFaculty = isFaculty;
-            accounts[userId].maxBooks = isFaculty ? 5 : 3;
-            accounts[userId].maxDays = isFaculty ? 30 : 15;
+    static Report run(const DataVersion& version) {
+        auto start = chrono::steady_clock::now();
+        Report report;
+        const BookStorage& catalogue = *version.books;
+        vector<IsbnKey> keys;
+        keys.reserve(catalogue.size());
+        catalogue.forEach([&](IsbnKey key, const Book&) { keys.push_back(key); });
+        report.records = keys.size();
+
+        size_t workers = max(1u, thread::hardware_concurrency());
+        workers = min(workers, keys.size() / 10000 + 1);  // Small catalogues are not worth the threads
+        auto shinglesOf = [&](size_t record) {
+            Book book;
+            catalogue.find(keys[record], book);
+            return shingles(book);
+        };
+
+        // Signatures, one slice of the catalogue per worker
+        vector<Signature> signatures(keys.size());
+        vector<char> empty(keys.size(), 0);
+        size_t sliceSize = (keys.size() + workers - 1) / workers;
+        runEach(workers, [&](size_t worker) {
+            size_t end = min(keys.size(), (worker + 1) * sliceSize);
+            for (size_t i = worker * sliceSize; i < end; i++) {
+                vector<unsigned> set = shinglesOf(i);
+                empty[i] = set.empty();
+                signatures[i] = sign(set);
+            }
+        });
+
+        // Buckets, a share of the bands per worker. Candidates whose
+        // signatures clearly disagree are dropped before any exact scoring.
+        vector<vector<uint64_t>> found(workers);
+        vector<size_t> bucketPairs(workers, 0);
+        runEach(workers, [&](size_t worker) {
+            vector<pair<uint64_t, uint32_t>> bucket(keys.size());
+            for (int band = worker; band < BANDS; band += workers) {
+                for (size_t i = 0; i < keys.size(); i++) {
+                    uint64_t value = 0;
+                    for (int row = 0; row < ROWS; row++) {
+                        value = value << 16 | signatures[i][band * ROWS + row];
+                    }
+                    bucket[i] = {value, static_cast<uint32_t>(i)};
+                }
+                sort(bucket.begin(), bucket.end());
+                for (size_t i = 0; i < bucket.size(); i++) {
+                    if (empty[bucket[i].second]) continue;
+                    for (size_t j = i + 1; j < bucket.size() && j <= i + BUCKET_WINDOW && bucket[j].first == bucket[i].first; j++) {
+                        uint32_t a = bucket[i].second, b = bucket[j].second;
+                        bucketPairs[worker]++;
+                        int agree = 0;
+                        for (int k = 0; k < SIGNATURE_SIZE; k++) {
+                            agree += signatures[a][k] == signatures[b][k];
+                        }
+                        if (double(agree) / SIGNATURE_SIZE >= THRESHOLD - ESTIMATE_MARGIN) {
+                            found[worker].push_back(uint64_t(min(a, b)) << 32 | max(a, b));
+                        }
+                    }
+                }
+            }
+        });
+        vector<uint64_t> candidates;
+        for (size_t worker = 0; worker < workers; worker++) {
+            candidates.insert(candidates.end(), found[worker].begin(), found[worker].end());
+            report.candidates += bucketPairs[worker];
+            vector<uint64_t>().swap(found[worker]);
+        }
+        sort(candidates.begin(), candidates.end());
+        candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+        report.compared = candidates.size();
+
+        // Exact scores, in parallel slices of the candidates
+        vector<vector<pair<uint64_t, double>>> matched(workers);
+        sliceSize = (candidates.size() + workers - 1) / workers;
+        runEach(workers, [&](size_t worker) {
+            size_t end = min(candidates.size(), (worker + 1) * sliceSize);
+            for (size_t i = worker * sliceSize; i < end; i++) {
+                double similarity = jaccard(shinglesOf(candidates[i] >> 32), shinglesOf(candidates[i] & 0xFFFFFFFF));
+                if (similarity >= THRESHOLD) matched[worker].push_back({candidates[i], similarity});
+            }
+        });
+
+        // Clusters; the most borrowed record of each is kept
+        vector<size_t> parent(keys.size());
+        for (size_t i = 0; i < parent.size(); i++) parent[i] = i;
+        for (const auto& slice : matched) {
+            for (const auto& pair : slice) {
+                parent[find(parent, pair.first >> 32)] = find(parent, pair.first & 0xFFFFFFFF);
+            }
+        }
+        map<size_t, vector<size_t>> clusters;
+        unordered_map<size_t, pair<size_t, double>> closest;  // Each matched record's most similar match
+        for (const auto& slice : matched) {
+            for (const auto& pair : slice) {
+                size_t a = pair.first >> 32, b = pair.first & 0xFFFFFFFF;
+                clusters[find(parent, a)];
+                for (auto side : {make_pair(a, b), make_pair(b, a)}) {
+                    auto it = closest.find(side.first);
+                    if (it == closest.end() || pair.second > it->second.second) closest[side.first] = {side.second, pair.second};
+                }
+            }
+        }
+        for (size_t i = 0; i < keys.size(); i++) {
+            auto cluster = clusters.find(find(parent, i));
+            if (cluster != clusters.end()) cluster->second.push_back(i);
+        }
+        auto borrows = [&](size_t record) {
+            const CirculationTotals* totals = version.circulation.forTitle(keys[record]);
+            return totals ? totals->borrows : 0;
+        };
+        for (const auto& cluster : clusters) {
+            size_t keep = cluster.second[0];
+            for (size_t record : cluster.second) {
+                if (borrows(record) > borrows(keep)) keep = record;
+            }
+            vector<unsigned> kept = shinglesOf(keep);
+            // Matching is transitive within a group, similarity is not: only
+            // records similar enough to the one kept are proposed for merging
+            for (size_t record : cluster.second) {
+                if (record == keep) continue;
+                double similarity = jaccard(kept, shinglesOf(record));
+                if (similarity >= THRESHOLD) {
+                    report.proposals.push_back({keys[keep], keys[record], similarity});
+                } else {
+                    const auto& via = closest[record];
+                    report.related.push_back({keys[keep], keys[record], keys[via.first], via.second});
+                }
+            }
+        }
+        report.clusters = clusters.size();
+        sort(report.proposals.begin(), report.proposals.end(), [](const Proposal& a, const Proposal& b) {
+            return a.similarity != b.similarity ? a.similarity > b.similarity : a.merge < b.merge;
+        });
+        report.elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    // One JSON object per proposal
+    static bool write(const Report& report, const DataVersion& version, const string& path) {
+        ofstream file(path, ios::out);
+        if (!file) {
+            cerr << "Error: Unable to create/open " << path << " for writing!\n";
+            return false;
+        }
+        for (const auto& proposal : report.proposals) {
+            Book keep, merge;
+            version.books->find(proposal.keep, keep);
+            version.books->find(proposal.merge, merge);
+            file << "{\"keep\":\"" << unpackIsbn(proposal.keep) << "\",\"keepTitle\":\"" << jsonEscape(keep.getTitle())
+                 << "\",\"merge\":\"" << unpackIsbn(proposal.merge) << "\",\"mergeTitle\":\"" << jsonEscape(merge.getTitle())
+                 << "\",\"similarity\":" << round(proposal.similarity * 1000) / 1000 << "}\n";
+        }
+        for (const auto& related : report.related) {
+            file << "{\"keep\":\"" << unpackIsbn(related.keep) << "\",\"related\":\"" << unpackIsbn(related.record)
+                 << "\",\"via\":\"" << unpackIsbn(related.via)
+                 << "\",\"similarity\":" << round(related.similarity * 1000) / 1000 << "}\n";
+        }
+        return true;
+    }
+
+    static void print(const Report& report, const DataVersion& version) {
+        cout << "\n=== Duplicate Books ===\n"
+             << "Checked " << report.records << " books in " << round(report.elapsedMs) << " ms ("
+             << report.candidates << " bucket matches, " << report.compared << " pairs compared).\n";
+        if (report.proposals.empty()) {
+            cout << "No duplicates found.\n";
+            return;
+        }
+        cout << report.proposals.size() << " merge proposals in " << report.clusters << " groups:\n";
+        auto describe = [&](IsbnKey key) {
+            Book book;
+            if (!version.books->find(key, book)) return unpackIsbn(key);
+            return unpackIsbn(key) + " " + book.getTitle() + " / " + book.getAuthor() + " / " +
+                   book.getPublisher() + " (" + to_string(book.getYear()) + ")";
+        };
+        for (size_t i = 0; i < report.proposals.size() && i < SAMPLES; i++) {
+            const Proposal& proposal = report.proposals[i];
+            cout << "\n" << round(proposal.similarity * 100) << "% similar\n"
+                 << "  merge " << describe(proposal.merge) << "\n"
+                 << "  into  " << describe(proposal.keep) << "\n";
+        }
+        if (report.proposals.size() > SAMPLES) {
+            cout << "\n... and " << report.proposals.size() - SAMPLES << " more\n";
+        }
+        if (report.related.empty()) return;
+
+        cout << "\nSimilar to a book in a group but not to the one kept, so not proposed: " << report.related.size() << "\n";
+        for (size_t i = 0; i < report.related.size() && i < SAMPLES; i++) {
+            const Related& related = report.related[i];
+            cout << "- " << describe(related.record) << "\n  related via " << unpackIsbn(related.via) << " ("
+                 << round(related.similarity * 100) << "% similar), group kept as " << unpackIsbn(related.keep) << "\n";
+        }
+        if (report.related.size() > SAMPLES) {
+            cout << "- ... and " << report.related.size() - SAMPLES << " more\n";
         }
-        // Update the account ID to match the user ID
-        accounts[userId].userID = userId;
     }
+};
 
-    virtual ~User() {}
+// Read replica: library_systemexe --replica serves catalogue and account
+// queries from a second process so that read traffic does not compete with
+// checkouts. It loads the newest checkpoint (the one full snapshot that says
+// where in operations.log it ends) and then follows the log, applying each
+// committed operation as the primary appended it. The log is checked every
+// POLL_MS and each batch is published as a new version (see VersionStore),
+// so queries read a consistent state that is at most about POLL_MS behind
+// the primary. A RESTORE or REPAIR record replaces the data wholesale, so the
+// replica reloads from the checkpoint written after it. The replica never
+// writes any data file.
+class ReadReplica {
+private:
+    static constexpr int POLL_MS = 200;
 
-    Account& getAccount() { return account; }
-    string getID() const { return id; }
-    string getName() const { return name; }
-    string getPassword() const { return password; }  // Added getter for password
+    long long appliedSeq;
+    long long offset;       // Log position read up to
+    string partial;         // A record whose end the primary has not written yet
+    atomic<long long> resyncSeq;  // Waiting for the checkpoint after this marker, 0 if not
+    atomic<long long> publishedSeq;
+    atomic<int> lastRecordTime;
+    atomic<long long> lastPoll;  // Seconds since the epoch
 
-    virtual bool borrowBook(const string& isbn, int currentDate) = 0;
-    virtual bool returnBook(const string& isbn, int currentDate) = 0;
-    virtual void displayMenu() = 0;
-};
+    mutex stopMutex;
+    condition_variable wake;
+    bool stopping;
+    thread follower;
 
-class Student : public User {
-public:
-    Student(string id, string name, string pwd) : User(id, name, pwd, false) {}
+    bool resync(long long minSeq) {
+        long long seq, logOffset;
+        if (!opLog.loadLatestCheckpoint(minSeq, seq, logOffset)) return false;
+        appliedSeq = seq;
+        offset = logOffset;
+        partial.clear();
+        resyncSeq = 0;
+        return true;
+    }
 
-    bool borrowBook(const string& isbn, int currentDate) override {
-        // Update fines before checking
-        account.updateFines(currentDate);
-        
-        // Check current fine
-        if (account.getTotalFine() > 0) {
-            cout << "\nCannot borrow books due to unpaid fines.\n";
-            cout << "Current total fine: " << account.getTotalFine() << " rupees\n";
-            cout << "Please pay your fines before borrowing more books.\n";
-            return false;
+    // Apply whatever the primary has appended; true if the data changed
+    bool poll() {
+        bool changed = false;
+        if (resyncSeq > 0) {
+            if (!resync(resyncSeq.load())) return false;
+            changed = true;
         }
 
-        if (account.getBorrowedBooks().size() >= account.getMaxBooks()) {
-            cout << "\nMaximum number of books already borrowed.\n";
-            cout << "Student limit: " << account.getMaxBooks() << " books\n";
-            cout << "Currently borrowed: " << account.getBorrowedBooks().size() << " books\n";
-            return false;
+        ifstream log(opLog.getLogFile(), ios::in | ios::binary);
+        if (!log) return changed;
+        log.seekg(0, ios::end);
+        long long size = log.tellg();
+        if (size < offset) {
+            // The log was replaced under us; start over from its checkpoints
+            return resync(0) || changed;
         }
+        if (size == offset) return changed;
 
-        auto it = books.find(isbn);
-        if (it == books.end() || !it->second.isAvailable()) {
-            cout << "Book not available for borrowing.\n";
-            return false;
+        string chunk(size - offset, '\0');
+        log.seekg(offset);
+        log.read(&chunk[0], chunk.size());
+        chunk.resize(log.gcount());
+        offset += chunk.size();
+        partial += chunk;
+
+        size_t start = 0, end;
+        while ((end = partial.find('\n', start)) != string::npos) {
+            vector<string> fields = splitFields(partial.substr(start, end - start));
+            start = end + 1;
+            if (fields.size() < 3) continue;
+            try {
+                long long seq = stoll(fields[0]);
+                if (seq <= appliedSeq) continue;
+                if (fields[2] == "RESTORE" || fields[2] == "REPAIR") {
+                    resyncSeq = seq;
+                    if (!resync(seq)) partial.clear();  // Retried on the next poll
+                    return true;
+                }
+                opLog.applyOperation(fields);
+                appliedSeq = seq;
+                lastRecordTime = stoi(fields[1]);
+                changed = true;
+            } catch (const exception& e) {
+                events.record(EventLog::WARN, "replica.skipped_record", {{"reason", e.what()}});
+            }
         }
+        partial.erase(0, start);
+        return changed;
+    }
 
-        // Set due date in seconds (using actual days)
-        int dueDate = currentDate + (account.getMaxDays() * 24 * 60 * 60);
-        account.getBorrowedBooks()[isbn] = dueDate;
-        it->second.setAvailability(false);
-        
-        // Convert due date to human-readable format
-        time_t dueTime = dueDate;
-        struct tm* dueTm = localtime(&dueTime);
-        char dueStr[26];
-        strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
+    void run() {
+        unique_lock<mutex> lock(stopMutex);
+        while (!stopping) {
+            wake.wait_for(lock, chrono::milliseconds(POLL_MS));
+            lock.unlock();
+            if (poll()) publish();
+            lastPoll = time(nullptr);
+            lock.lock();
+        }
+    }
 
-        cout << "\nBook borrowed successfully!\n";
-        cout << "Due date: " << dueStr << "\n";
-        cout << "Borrowing period: " << account.getMaxDays() << " days\n";
-        cout << "Fine rate: 10 rupees per day if overdue\n";
-        return true;
+    void publish() {
+        versions.commit();
+        publishedSeq = appliedSeq;
     }
 
-    bool returnBook(const string& isbn, int currentDate) override {
-        // Update fines before checking
-        account.updateFines(currentDate);
-        
-        auto it = account.getBorrowedBooks().find(isbn);
-        if (it == account.getBorrowedBooks().end()) {
-            cout << "Book not found in borrowed list.\n";
-            return false;
+    static string formatTime(int seconds) {
+        time_t value = seconds;
+        char text[26];
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", localtime(&value));
+        return text;
+    }
+
+    void listAvailableBooks() const {
+        auto version = versions.read();
+        cout << "\nAvailable Books (as of operation " << publishedSeq << "):\n";
+        size_t shown = 0;
+        version->books->forEach([&](IsbnKey key, const Book& book) {
+            if (!book.isAvailable()) return;
+            cout << unpackIsbn(key) << " | " << book.getTitle() << " | " << book.getAuthor() << "\n";
+            shown++;
+        });
+        if (shown == 0) cout << "No books are available.\n";
+    }
+
+    void lookUpBook(const string& isbn) const {
+        auto version = versions.read();
+        Book book;
+        if (!version->books->find(packIsbn(isbn), book)) {
+            cout << "Book not found.\n";
+            return;
         }
+        book.display();
+    }
 
-        // Convert dates to time_t for proper comparison
-        time_t dueTime = it->second;
-        time_t currentTime = currentDate;
-        
-        // Calculate overdue days using difftime (which returns seconds)
-        double secondsOverdue = difftime(currentTime, dueTime);
-        int daysOverdue = static_cast<int>(secondsOverdue / (24 * 60 * 60));
-        
-        // Only show overdue message and calculate fine if actually overdue
-        if (daysOverdue > 0) {
-            double fine = daysOverdue * 10.0;  // 10 rupees per day
-            
-            // Convert dates to human-readable format
-            struct tm* dueTm = localtime(&dueTime);
-            struct tm* currentTm = localtime(&currentTime);
-            char dueStr[26], currentStr[26];
-            strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
-            strftime(currentStr, sizeof(currentStr), "%Y-%m-%d %H:%M:%S", currentTm);
-            
-            cout << "\n=== Book is Overdue ===\n";
-            cout << "Due Date: " << dueStr << "\n";
-            cout << "Current Date: " << currentStr << "\n";
-            cout << "Days Overdue: " << daysOverdue << "\n";
-            cout << "Fine Rate: 10 rupees per day\n";
-            cout << "Fine Amount: " << fine << " rupees\n";
-            
-            cout << "\nYou must pay the fine before returning the book.\n";
-            cout << "Would you like to pay the fine now? (1 for yes, 0 for no): ";
-            int choice;
-            cin >> choice;
-            
-            if (choice == 1) {
-                cout << "Enter amount to pay (" << fine << " rupees): ";
-                double amount;
-                cin >> amount;
-                if (!account.payBookFine(isbn, amount, currentDate)) {
-                    cout << "Return cancelled due to payment failure.\n";
-                    return false;
-                }
-            } else {
-                cout << "Return cancelled. Please pay the fine first.\n";
-                return false;
-            }
+    void showAccount(const string& id) const {
+        auto version = versions.read();
+        const shared_ptr<const Account>* account = version->accounts.find(id);
+        if (!account) {
+            cout << "Account not found.\n";
+            return;
+        }
+        const Account& details = **account;
+        for (const auto& user : *version->users) {
+            if (user.id == id) cout << "\nName: " << user.name << "\n";
         }
+        cout << "User ID: " << id << "\n";
+        cout << "User Type: " << (details.isFacultyMember() ? "Faculty" : "Student") << "\n";
 
-        // If we get here, either the book is not overdue or the fine has been paid
-        account.addToHistory(isbn, currentDate);
-        account.getBorrowedBooks().erase(it);
-        books[isbn].setAvailability(true);
-        cout << "\nBook returned successfully.\n";
-        cout << "Book status updated to: Available\n";
-        return true;
+        // Fines follow the 10 rupees per overdue day rule up to now
+        int now = getCurrentDate();
+        Paise fine = 0;
+        cout << "\n=== Currently Borrowed Books ===\n";
+        if (details.getBorrowedBooks().empty()) cout << "No books currently borrowed.\n";
+        for (const auto& loan : details.getBorrowedBooks()) {
+            Book book;
+            bool known = version->books->find(loan.first, book);
+            cout << unpackIsbn(loan.first) << " | " << (known ? book.getTitle() : "(removed)")
+                 << " | due " << formatTime(loan.second) << "\n";
+            int daysOverdue = (now - loan.second) / (24 * 60 * 60);
+            if (daysOverdue > 0 && !details.isFacultyMember()) fine += daysOverdue * FINE_PER_DAY;
+        }
+        if (!details.isFacultyMember()) cout << "Current Total Fine: " << formatRupees(fine) << " rupees\n";
+        cout << "Books returned: " << details.getBorrowingHistory().size() << "\n";
     }
 
-    void displayMenu() override {
-        cout << "\n\n=== Student Menu ===\n";
-        cout << "1. View Available Books\n";
-        cout << "2. Borrow a Book (Max " << account.getMaxBooks() << " books, " << account.getMaxDays() << " days)\n";
-        cout << "3. Return a Book\n";
-        cout << "4. View Borrowed Books\n";
-        cout << "5. View Fine (Current: " << account.getTotalFine() << " rupees)\n";
-        cout << "6. Pay Fine\n";
-        cout << "7. View Account Details\n";
-        cout << "8. Exit\n\n";
+    void showStatus() const {
+        cout << "\n=== Replica Status ===\n";
+        cout << "Applied operations up to: " << publishedSeq << "\n";
+        if (lastRecordTime > 0) cout << "Last change made on the primary: " << formatTime(lastRecordTime) << "\n";
+        cout << "Log last checked: " << (time(nullptr) - lastPoll) << " s ago (every "
+             << POLL_MS << " ms)\n";
+        if (resyncSeq > 0) cout << "Waiting for the primary's checkpoint after operation " << resyncSeq << "\n";
     }
-};
 
-class Faculty : public User {
 public:
-    Faculty(string id, string name, string pwd) : User(id, name, pwd, true) {}
+    ReadReplica()
+        : appliedSeq(0), offset(0), resyncSeq(0), publishedSeq(0), lastRecordTime(0),
+          lastPoll(time(nullptr)), stopping(false) {}
 
-    bool borrowBook(const string& isbn, int currentDate) override {
-        // Check if book exists and is available
-        auto it = books.find(isbn);
-        if (it == books.end()) {
-            cout << "Book not found.\n";
-            return false;
-        }
-        if (!it->second.isAvailable()) {
-            cout << "Book is not available.\n";
-            return false;
+    ~ReadReplica() {
+        if (follower.joinable()) {
+            {
+                lock_guard<mutex> lock(stopMutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            follower.join();
         }
+    }
 
-        // Check if user has reached maximum books
-        if (account.getBorrowedBooks().size() >= account.getMaxBooks()) {
-            cout << "\nMaximum number of books already borrowed.\n";
-            cout << "Faculty limit: " << account.getMaxBooks() << " books\n";
-            cout << "Currently borrowed: " << account.getBorrowedBooks().size() << " books\n";
+    ReadReplica(const ReadReplica&) = delete;
+    ReadReplica& operator=(const ReadReplica&) = delete;
+
+    // Load the newest checkpoint and catch up with the log before serving
+    bool start() {
+        if (!resync(0)) {
+            cerr << "Error: No checkpoint found. Start the primary in this directory first.\n";
             return false;
         }
+        poll();
+        publish();
+        lastPoll = time(nullptr);
+        follower = thread(&ReadReplica::run, this);
+        return true;
+    }
 
-        // Check for any book overdue by more than 60 days
-        for (const auto& borrowed : account.getBorrowedBooks()) {
-            int secondsOverdue = currentDate - borrowed.second;
-            int daysOverdue = secondsOverdue / (24 * 60 * 60);  // Convert seconds to actual days
-            if (daysOverdue > 60) {
-                cout << "Cannot borrow: You have a book overdue by more than 60 days.\n";
-                cout << "Please return all overdue books first.\n";
-                return false;
+    void serve() {
+        while (true) {
+            cout << "\n=== Read Replica ===\n"
+                 << "1. View Available Books\n"
+                 << "2. Look Up a Book\n"
+                 << "3. View Account\n"
+                 << "4. Replica Status\n"
+                 << "5. Exit\n"
+                 << "Enter your choice: ";
+            int choice;
+            if (!(cin >> choice)) return;
+
+            string input;
+            switch (choice) {
+                case 1:
+                    listAvailableBooks();
+                    break;
+                case 2:
+                    cout << "Enter ISBN: ";
+                    cin >> input;
+                    lookUpBook(canonicalIsbn(input));
+                    break;
+                case 3:
+                    cout << "Enter user ID: ";
+                    cin >> input;
+                    showAccount(input);
+                    break;
+                case 4:
+                    showStatus();
+                    break;
+                case 5:
+                    return;
+                default:
+                    cout << "Invalid choice!\n";
             }
         }
+    }
+};
 
-        // Borrow the book
-        int dueDate = currentDate + (account.getMaxDays() * 24 * 60 * 60);  // 30 days for faculty
-        account.getBorrowedBooks()[isbn] = dueDate;
-        it->second.setAvailability(false);
-        
-        // Convert due date to human-readable format
-        time_t dueTime = dueDate;
-        struct tm* dueTm = localtime(&dueTime);
-        char dueStr[26];
-        strftime(dueStr, sizeof(dueStr), "%Y-%m-%d %H:%M:%S", dueTm);
+// Hot catalogue refresh: picks up a books.txt changed by another program
+// (an acquisitions export, an edit by hand) without restarting. SIGHUP or
+// librarian option 20 asks for a refresh. The file is cut into segments that
+// end after any record whose ISBN hashes to a multiple of SEGMENT_RECORDS, so
+// boundaries depend on content and an inserted book changes one segment
+// rather than shifting every one after it. The background thread compares
+// the segments' checksums with those of the last books.txt the catalogue was
+// read from or saved as, parses only the segments that differ and keeps the
+// result pending; the main loop applies it between two commands, so every
+// query after that sees all of the refresh and none sees part of it.
+// Availability stays as the loans say, books on loan are not removed, and
+// every change is recorded in operations.log like a librarian's.
+class CatalogueRefresher {
+public:
+    struct Report {
+        size_t segments = 0, changedSegments = 0;
+        size_t added = 0, updated = 0, removed = 0, keptOnLoan = 0;
+        double parseMs = 0;
+    };
 
-        cout << "\nBook borrowed successfully!\n";
-        cout << "Due date: " << dueStr << "\n";
-        cout << "Maximum borrowing period: " << account.getMaxDays() << " days\n";
-        cout << "Books borrowed: " << account.getBorrowedBooks().size() << " of " << account.getMaxBooks() << "\n";
+private:
+    static constexpr unsigned SEGMENT_RECORDS = 128;  // Average records per segment
+    static constexpr int POLL_MS = 200;
+
+    struct Segment {
+        unsigned long long checksum;
+        size_t begin, end;  // Byte range in the file
+        vector<IsbnKey> keys;
+    };
+
+    struct Baseline {
+        bool known = false;
+        filesystem::file_time_type modified;
+        uintmax_t size = 0;
+        vector<Segment> segments;
+    };
+
+    struct Delta {
+        Baseline file;
+        vector<pair<IsbnKey, Book>> upserts;
+        vector<IsbnKey> removals;
+        Report report;
+    };
+
+    mutable mutex m;
+    Baseline baseline;
+    unique_ptr<Delta> pending;
+    mutex prepareMutex;  // The background thread and option 20 take turns
+
+    mutex stopMutex;
+    condition_variable wake;
+    bool stopping;
+    bool requested;
+    thread worker;
+
+    static unsigned long long fnv1a(const char* data, size_t size, unsigned long long hash = 14695981039346656037ULL) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Cut books.txt text (a count line, then six lines per book) into segments
+    static vector<Segment> segment(const string& text) {
+        vector<Segment> segments;
+        size_t pos = text.find('\n');
+        if (pos == string::npos) return segments;
+        pos++;
+        Segment current{fnv1a(nullptr, 0), pos, pos, {}};
+        while (pos < text.size()) {
+            size_t recordStart = pos;
+            size_t isbnEnd = text.find('\n', pos);
+            if (isbnEnd == string::npos) isbnEnd = text.size();
+            string isbn = text.substr(pos, isbnEnd - pos);
+            for (int line = 0; line < 6 && pos < text.size(); line++) {
+                size_t end = text.find('\n', pos);
+                pos = end == string::npos ? text.size() : end + 1;
+            }
+            current.checksum = fnv1a(text.data() + recordStart, pos - recordStart, current.checksum);
+            current.end = pos;
+            IsbnKey key = packStoredIsbn(isbn);
+            if (key != INVALID_ISBN) current.keys.push_back(key);
+            if (fnv1a(isbn.data(), isbn.size()) % SEGMENT_RECORDS == 0 || pos >= text.size()) {
+                segments.push_back(move(current));
+                current = Segment{fnv1a(nullptr, 0), pos, pos, {}};
+            }
+        }
+        return segments;
+    }
+
+    static bool readFile(string& text, filesystem::file_time_type& modified, uintmax_t& size) {
+        error_code ec;
+        modified = filesystem::last_write_time("books.txt", ec);
+        if (ec) return false;
+        ifstream file("books.txt", ios::in | ios::binary);
+        if (!file) return false;
+        text.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        size = text.size();
         return true;
     }
 
-    bool returnBook(const string& isbn, int currentDate) override {
-        auto it = account.getBorrowedBooks().find(isbn);
-        if (it == account.getBorrowedBooks().end()) {
-            cout << "Book not found in borrowed list.\n";
+    // Parse what changed since the baseline; false if books.txt is unchanged
+    bool prepare() {
+        lock_guard<mutex> turn(prepareMutex);
+        Baseline previous;
+        {
+            lock_guard<mutex> lock(m);
+            previous = baseline;
+        }
+        auto start = chrono::steady_clock::now();
+        auto delta = make_unique<Delta>();
+        string text;
+        if (!readFile(text, delta->file.modified, delta->file.size)) return false;
+        if (previous.known && previous.modified == delta->file.modified && previous.size == delta->file.size) {
             return false;
         }
+        delta->file.known = true;
+        delta->file.segments = segment(text);
 
-        // Calculate days overdue
-        int secondsOverdue = currentDate - it->second;
-        int daysOverdue = secondsOverdue / (24 * 60 * 60);  // Convert seconds to actual days
-        
-        if (daysOverdue > 0) {
-            cout << "\n=== Book is Overdue ===\n";
-            cout << "Due Date: " << it->second << "\n";
-            cout << "Current Date: " << currentDate << "\n";
-            cout << "Days Overdue: " << daysOverdue << "\n";
-            cout << "Note: Faculty members do not incur fines for overdue books.\n";
+        unordered_set<unsigned long long> before, after;
+        for (const auto& old : previous.segments) before.insert(old.checksum);
+        unordered_set<IsbnKey> present;
+        for (const auto& current : delta->file.segments) {
+            after.insert(current.checksum);
+            if (before.count(current.checksum)) continue;
+            delta->report.changedSegments++;
+            istringstream in(text.substr(current.begin, current.end - current.begin));
+            while (in.peek() != EOF) {
+                Book book;
+                book.loadFromFile(in);
+                if (!in && !in.eof()) break;
+                IsbnKey key = loadIsbn(book.getISBN(), "books.txt");
+                if (key == INVALID_ISBN) continue;
+                book.setISBN(unpackIsbn(key));
+                delta->upserts.push_back({key, book});
+                present.insert(key);
+            }
         }
+        for (const auto& old : previous.segments) {
+            if (after.count(old.checksum)) continue;
+            for (IsbnKey key : old.keys) {
+                if (!present.count(key)) delta->removals.push_back(key);
+            }
+        }
+        delta->report.segments = delta->file.segments.size();
+        delta->report.parseMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
-        account.addToHistory(isbn, currentDate);
-        account.getBorrowedBooks().erase(it);
-        books[isbn].setAvailability(true);
-        cout << "\nBook returned successfully.\n";
-        cout << "Book status updated to: Available\n";
+        lock_guard<mutex> lock(m);
+        pending = move(delta);
         return true;
     }
 
-    void displayMenu() override {
-        cout << "\n=== Faculty Menu ===\n";
-        cout << "1. View Available Books\n";
-        cout << "2. Borrow a Book (Max " << account.getMaxBooks() << " books, " << account.getMaxDays() << " days)\n";
-        cout << "3. Return a Book\n";
-        cout << "4. View Borrowed Books\n";
-        cout << "5. View Borrowing History\n";
-        cout << "6. View Account Details\n";
-        cout << "7. Exit\n";
+    void run() {
+        unique_lock<mutex> lock(stopMutex);
+        while (!stopping) {
+            wake.wait_for(lock, chrono::milliseconds(POLL_MS));
+            if (stopping) break;
+            bool refresh = requested || takeSignal();
+            requested = false;
+            if (!refresh) continue;
+            lock.unlock();
+            prepare();
+            lock.lock();
+        }
     }
-};
 
-class Librarian : public User {
+    static bool takeSignal();
+
 public:
-    Librarian(string id, string name, string pwd) : User(id, name, pwd, false) {}
+    CatalogueRefresher() : stopping(false), requested(false) {}
 
-    bool borrowBook(const string& isbn, int currentDate) override {
-        cout << "Librarians cannot borrow books.\n";
-        return false;
+    ~CatalogueRefresher() {
+        if (worker.joinable()) {
+            {
+                lock_guard<mutex> lock(stopMutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            worker.join();
+        }
     }
 
-    bool returnBook(const string& isbn, int currentDate) override {
-        cout << "Librarians cannot return books.\n";
-        return false;
-    }
+    CatalogueRefresher(const CatalogueRefresher&) = delete;
+    CatalogueRefresher& operator=(const CatalogueRefresher&) = delete;
 
-    void addUser(string id, string name, string password, bool isFaculty) {
-        if (users.find(id) != users.end()) {
-            cout << "Error: User ID already exists!\n";
-            return;
-        }
+    void start() { worker = thread(&CatalogueRefresher::run, this); }
 
-        User* newUser;
-        if (isFaculty) {
-            newUser = new Faculty(id, name, password);
-        } else {
-            newUser = new Student(id, name, password);
-        }
-        users[id] = newUser;
-        cout << "User added successfully!\n";
-    }
-    
-    void addBook(string isbn, string title, string author, string publisher, int year) {
-        if (books.find(isbn) == books.end()) {
-            books[isbn] = Book(title, author, publisher, year, isbn, true);
-            cout << "Book added successfully!\n";
-        } else {
-            cout << "Book already exists!\n";
-        }
+    // books.txt now holds text: after loading it and after every save
+    void rebase(const string& text) {
+        Baseline next;
+        next.segments = segment(text);
+        error_code ec;
+        next.modified = filesystem::last_write_time("books.txt", ec);
+        next.size = text.size();
+        next.known = !ec;
+        lock_guard<mutex> lock(m);
+        baseline = move(next);
     }
 
-    void removeUser(string userId) {
-        if (users.find(userId) != users.end()) {
-            delete users[userId];
-            users.erase(userId);
-            accounts.erase(userId);
-            cout << "User removed successfully!\n";
-        } else {
-            cout << "User not found!\n";
-        }
+    // Option 20: prepare now rather than waiting for the background thread
+    bool refreshNow(Report& report) {
+        prepare();
+        return applyPending(report);
     }
-    
-    void removeBook(string isbn) {
-        if (books.find(isbn) != books.end()) {
-            books.erase(isbn);
-            cout << "Book removed successfully!\n";
-        } else {
-            cout << "Book not found!\n";
+
+    // Called by the main loop between commands; true if a refresh was applied,
+    // which the caller then saves like any other change
+    bool applyPending(Report& report) {
+        unique_ptr<Delta> delta;
+        {
+            lock_guard<mutex> lock(m);
+            if (!pending) return false;
+            delta = move(pending);
         }
-    }
+        report = delta->report;
 
-    void updateBook(string isbn, string newTitle, string newAuthor, string newPublisher, int newYear) {
-        if (books.find(isbn) != books.end()) {
-            books[isbn] = Book(newTitle, newAuthor, newPublisher, newYear, isbn, books[isbn].isAvailable());
-            books[isbn].setReserved(books[isbn].isReserved());
-            cout << "Book updated successfully!\n";
-        } else {
-            cout << "Book not found!\n";
+        vector<pair<string, vector<string>>> operations;
+        for (auto& upsert : delta->upserts) {
+            const Book& book = upsert.second;
+            string isbn = book.getISBN();
+            Book existing;
+            if (books->find(upsert.first, existing)) {
+                if (existing.getTitle() == book.getTitle() && existing.getAuthorID() == book.getAuthorID() &&
+                    existing.getPublisherID() == book.getPublisherID() && existing.getYear() == book.getYear()) {
+                    continue;
+                }
+                // The loans decide availability, not the file
+                Book updated = book;
+                updated.setAvailability(existing.isAvailable());
+                updated.setReserved(existing.isReserved());
+                books->store(upsert.first, updated);
+                operations.push_back({"UPDATE_BOOK", {isbn, book.getTitle(), book.getAuthor(), book.getPublisher(),
+                                                      to_string(book.getYear())}});
+                report.updated++;
+            } else {
+                Book added = book;
+                added.setAvailability(true);
+                added.setReserved(false);
+                books->store(upsert.first, added);
+                operations.push_back({"ADD_BOOK", {isbn, book.getTitle(), book.getAuthor(), book.getPublisher(),
+                                                   to_string(book.getYear())}});
+                report.added++;
+            }
+            fuzzyIndex.add(FuzzyIndex::TITLE, isbn, book.getTitle());
+            fuzzyIndex.add(FuzzyIndex::AUTHOR, isbn, book.getAuthor());
+        }
+        for (IsbnKey key : delta->removals) {
+            Book existing;
+            if (!books->find(key, existing)) continue;
+            string isbn = unpackIsbn(key);
+            if (!existing.isAvailable()) {
+                events.record(EventLog::WARN, "catalogue.kept_on_loan", {{"isbn", isbn}});
+                report.keptOnLoan++;
+                continue;
+            }
+            books->erase(key);
+            fuzzyIndex.remove(FuzzyIndex::TITLE, isbn);
+            fuzzyIndex.remove(FuzzyIndex::AUTHOR, isbn);
+            operations.push_back({"REMOVE_BOOK", {isbn}});
+            report.removed++;
         }
+        opLog.recordAll(operations);
+        {
+            lock_guard<mutex> lock(m);
+            baseline = move(delta->file);
+        }
+        events.record(EventLog::INFO, "catalogue.refreshed",
+                      {{"segments", report.segments}, {"changed_segments", report.changedSegments},
+                       {"added", report.added}, {"updated", report.updated}, {"removed", report.removed},
+                       {"kept_on_loan", report.keptOnLoan}, {"parse_us", llround(report.parseMs * 1000)}});
+        return true;
     }
 
-    void displayMenu() override {
-        cout << "\nLibrarian Menu:\n"
-             << "1. Add User\n"
-             << "2. Remove User\n"
-             << "3. Add Book\n"
-             << "4. Remove Book\n"
-             << "5. Update Book\n"
-             << "6. View All Books\n"
-             << "7. View All Users\n"
-             << "8. Exit\n";
+    static void print(const Report& report) {
+        cout << "\n=== Catalogue Refresh ===\n"
+             << "Segments: " << report.segments << " (" << report.changedSegments << " changed, parsed in "
+             << report.parseMs << " ms)\n"
+             << "Books added: " << report.added << "\n"
+             << "Books updated: " << report.updated << "\n"
+             << "Books removed: " << report.removed << "\n";
+        if (report.keptOnLoan > 0) {
+            cout << "Books kept because they are on loan: " << report.keptOnLoan << "\n";
+        }
     }
 };
 
+CatalogueRefresher catalogueRefresh;
+
+// SIGHUP asks for a catalogue refresh; the handler only sets this flag
+volatile sig_atomic_t catalogueRefreshSignalled = 0;
+
+void requestCatalogueRefresh(int) {
+    catalogueRefreshSignalled = 1;
+}
+
+bool CatalogueRefresher::takeSignal() {
+    if (!catalogueRefreshSignalled) return false;
+    catalogueRefreshSignalled = 0;
+    return true;
+}
+
 class Library {
 public:
+    // Listings read a pinned version (see VersionStore), not the live maps
     void displayBooks() const {
-        cout << "\nLibrary Books:\n";
-        for (const auto& p : books) {
-            p.second.display();
+        int currentDate = getCurrentDate();
+        auto version = versions.read();
+        const auto& books = version->books;
+        auto weekly = trending.mostBorrowedThisWeek(currentDate, 5);
+        if (!weekly.empty()) {
+            cout << "\n=== Most Borrowed This Week ===\n";
+            for (const auto& entry : weekly) {
+                Book details;
+                bool known = books->find(packIsbn(entry.first), details);
+                cout << (known ? details.getTitle() : entry.first)
+                     << " (ISBN: " << entry.first << ") - " << llround(entry.second) << " borrows\n";
+            }
+        }
+        auto hot = trending.trending(currentDate, 5);
+        if (!hot.empty()) {
+            cout << "\n=== Trending Titles ===\n";
+            for (const auto& entry : hot) {
+                Book details;
+                bool known = books->find(packIsbn(entry.first), details);
+                cout << (known ? details.getTitle() : entry.first)
+                     << " (ISBN: " << entry.first << ")\n";
+            }
         }
+
+        cout << "\nLibrary Books:\n";
+        books->forEach([](IsbnKey, const Book& book) {
+            book.display();
+        });
     }
 
     void displayUsers() const {
+        auto version = versions.read();
         cout << "\nLibrary Users:\n";
-        for (const auto& p : users) {
-            cout << "ID: " << p.second->getID() 
-                 << ", Name: " << p.second->getName() 
-                 << ", Type: " << (dynamic_cast<Librarian*>(p.second) ? "Librarian" :
-                                 dynamic_cast<Faculty*>(p.second) ? "Faculty" : "Student")
+        for (const auto& record : *version->users) {
+            cout << "ID: " << record.id
+                 << ", Name: " << record.name
+                 << ", Type: " << (record.role == 2 ? "Librarian" :
+                                 record.role == 1 ? "Faculty" : "Student")
                  << "\n";
         }
     }
 
+    // Queues the save for the background writer (see PersistenceWorker)
     void saveAllData() {
-        cout << "Saving all data...\n";
-        try {
-            saveAccounts();
-            saveBooks();
-            saveUsers();
-            cout << "All data saved successfully.\n";
-        } catch (const exception& e) {
-            cerr << "Error saving data: " << e.what() << "\n";
-        }
+        persistence.requestSave();
     }
 
     void loadAllData() {
-        cout << "Loading all data...\n";
+        events.record(EventLog::INFO, "load.started");
+        allAccountsChanged = true;
+        unusableBookIds = 0;
         try {
+            loadLedger();
+            trending.load("trending.dat");
             loadAccounts();
+            loadCirculation();
             loadBooks();
             loadUsers();
-            cout << "All data loaded successfully.\n";
+            rebuildRecommendations();
+            rebuildFuzzyIndex();
+            rebuildDueIndex();
+            events.record(EventLog::INFO, "load.finished");
         } catch (const exception& e) {
-            cerr << "Error loading data: " << e.what() << "\n";
+            events.record(EventLog::ERROR, "load.failed", {{"reason", e.what()}});
+        }
+        if (unusableBookIds > 0) {
+            cout << "Warning: " << unusableBookIds << " book IDs in the data files are neither ISBNs nor legacy IDs"
+                 << " and their records were not loaded (see load.unusable_id in events.log).\n";
         }
     }
 
     void initializeDefaultData() {
         // Add default books (at least 10)
-        books["1"] = Book("Design Patterns", "Erich Gamma", "Addison-Wesley", 1994, "1");
-        books["2"] = Book("Clean Code", "Robert Martin", "Prentice Hall", 2008, "2");
-        books["3"] = Book("Introduction to Algorithms", "Thomas Cormen", "MIT Press", 2009, "3");
-        books["4"] = Book("Code Complete", "Steve McConnell", "Microsoft Press", 2004, "4");
-        books["5"] = Book("Refactoring", "Martin Fowler", "Addison-Wesley", 1999, "5");
-        books["6"] = Book("Head First Java", "Kathy Sierra", "O'Reilly", 2005, "6");
-        books["7"] = Book("The Pragmatic Programmer", "Andrew Hunt", "Addison-Wesley", 1999, "7");
-        books["8"] = Book("Effective C++", "Scott Meyers", "Addison-Wesley", 2005, "8");
-        books["9"] = Book("Programming Pearls", "Jon Bentley", "Addison-Wesley", 1999, "9");
-        books["10"] = Book("The Art of Computer Programming", "Donald Knuth", "Addison-Wesley", 1968, "10");
+        books->store(packIsbn("1"), Book("Design Patterns", "Erich Gamma", "Addison-Wesley", 1994, "1"));
+        books->store(packIsbn("2"), Book("Clean Code", "Robert Martin", "Prentice Hall", 2008, "2"));
+        books->store(packIsbn("3"), Book("Introduction to Algorithms", "Thomas Cormen", "MIT Press", 2009, "3"));
+        books->store(packIsbn("4"), Book("Code Complete", "Steve McConnell", "Microsoft Press", 2004, "4"));
+        books->store(packIsbn("5"), Book("Refactoring", "Martin Fowler", "Addison-Wesley", 1999, "5"));
+        books->store(packIsbn("6"), Book("Head First Java", "Kathy Sierra", "O'Reilly", 2005, "6"));
+        books->store(packIsbn("7"), Book("The Pragmatic Programmer", "Andrew Hunt", "Addison-Wesley", 1999, "7"));
+        books->store(packIsbn("8"), Book("Effective C++", "Scott Meyers", "Addison-Wesley", 2005, "8"));
+        books->store(packIsbn("9"), Book("Programming Pearls", "Jon Bentley", "Addison-Wesley", 1999, "9"));
+        books->store(packIsbn("10"), Book("The Art of Computer Programming", "Donald Knuth", "Addison-Wesley", 1968, "10"));
 
         // Add default users
         // 1 Librarian
@@ -905,126 +6827,906 @@ public:
         cout << "- 5 students (IDs: 201-205, password: student123)\n";
     }
 
+};
+
+// Deterministic stress harness: drives Student/Faculty borrow and return
+// traffic through the simulated clock (simulatedDate) and checks after every
+// simulated day that book availability matches the borrowed sets and that
+// student fines follow the 10 rupees per overdue day rule. Runs in a scratch
+// directory with the operation log open; at the end it restores the middle
+// day from the log and saves/reloads the final state in every storage mode,
+// comparing each result against the live state.
+class SimulationHarness {
 private:
-    void saveUsers() {
-        ofstream file("users.txt", ios::out);  // Open in write mode, create if doesn't exist
-        if (!file) {
-            cerr << "Error: Unable to create/open users.txt for writing!\n";
-            return;
+    int numUsers;
+    int numBooks;
+    int numDays;
+    mt19937 rng;
+    vector<string> userIds;
+    vector<string> isbns;
+    long long operations;
+    long long divergences;
+
+    static const int START_DATE = 1735689600;  // 2025-01-01 00:00:00 UTC
+    static const int DAY = 24 * 60 * 60;
+
+    bool chance(double p) {
+        return uniform_real_distribution<double>(0.0, 1.0)(rng) < p;
+    }
+
+    void setup() {
+        clearAllData();
+        for (int i = 0; i < numBooks; i++) {
+            // ISBN-13s 978000000000x, 978000000001x, ... with valid check digits
+            string digits = to_string(i);
+            string isbn = "978" + string(9 - digits.size(), '0') + digits + "0";
+            while (!isValidIsbn(isbn)) isbn.back()++;
+            books->store(packIsbn(isbn), Book("Title " + to_string(i), "Author " + to_string(i % 97),
+                                              "Publisher " + to_string(i % 13), 1950 + i % 70, isbn, true));
+            isbns.push_back(isbn);
         }
-        file << users.size() << "\n";
-        for (const auto& p : users) {
-            file << p.first << "\n" << p.second->getName() << "\n"
-                 << p.second->getPassword() << "\n"
-                 << (dynamic_cast<Librarian*>(p.second) ? 2 :
-                     dynamic_cast<Faculty*>(p.second) ? 1 : 0) << "\n";
+        for (int i = 0; i < numUsers; i++) {
+            string id = "U" + to_string(i);
+            // Roughly one in five patrons is faculty
+            if (i % 5 == 0) users[id] = new Faculty(id, "Faculty " + to_string(i), "sim");
+            else users[id] = new Student(id, "Student " + to_string(i), "sim");
+            userIds.push_back(id);
         }
-        file.close();
     }
 
-    void loadUsers() {
-        ifstream file("users.txt");
+    void simulateUser(User* user, int currentDate) {
+        Account& account = user->getAccount();
+        const auto& borrowed = account.getBorrowedBooks();
+        bool isStudent = !account.isFacultyMember();
+
+        // Students settle their whole fine now and then
+        if (isStudent && chance(0.3)) {
+            account.updateFines(currentDate);
+            if (account.getTotalFine() > 0) {
+                account.payFine(account.getTotalFine(), currentDate);
+                operations++;
+            }
+        }
+
+        // Now and then the whole stack goes back, or two books come out together
+        if (borrowed.size() > 1 && chance(0.05)) {
+            vector<string> stack;
+            for (const auto& loan : borrowed) stack.push_back(unpackIsbn(loan.first));
+            if (isStudent) {
+                account.updateFines(currentDate);
+                for (const auto& isbn : stack) {
+                    Paise fine = account.getBookFine(isbn);
+                    if (fine > 0) {
+                        account.payBookFine(isbn, fine, currentDate);
+                        operations++;
+                    }
+                }
+            }
+            user->returnBooks(stack, currentDate);
+            operations++;
+        } else if (chance(0.05)) {
+            vector<string> stack;
+            for (int i = 0; i < 2; i++) {
+                stack.push_back(isbns[uniform_int_distribution<int>(0, numBooks - 1)(rng)]);
+            }
+            user->borrowBooks(stack, currentDate);
+            operations++;
+        } else if (!borrowed.empty() && chance(0.35)) {
+            auto it = borrowed.begin();
+            advance(it, uniform_int_distribution<int>(0, borrowed.size() - 1)(rng));
+            string isbn = unpackIsbn(it->first);
+            // Overdue students pay the book fine first so the return does not prompt
+            if (isStudent) {
+                account.updateFines(currentDate);
+                Paise fine = account.getBookFine(isbn);
+                if (fine > 0) {
+                    account.payBookFine(isbn, fine, currentDate);
+                    operations++;
+                }
+            }
+            user->returnBook(isbn, currentDate);
+            operations++;
+        } else {
+            string isbn = isbns[uniform_int_distribution<int>(0, numBooks - 1)(rng)];
+            user->borrowBook(isbn, currentDate);
+            operations++;
+        }
+    }
+
+    void report(int currentDate, const string& message) {
+        divergences++;
+        if (divergences <= 20) {
+            cerr << "Divergence at " << currentDate << ": " << message << "\n";
+        }
+    }
+
+    void checkInvariants(int currentDate) {
+        // Every borrowed ISBN has exactly one borrower and is marked unavailable
+        map<IsbnKey, string> borrower;
+        for (auto& p : accounts) {
+            for (const auto& loan : p.second.getBorrowedBooks()) {
+                if (borrower.count(loan.first)) {
+                    report(currentDate, "book " + unpackIsbn(loan.first) + " borrowed by both " +
+                           borrower[loan.first] + " and " + p.first);
+                }
+                borrower[loan.first] = p.first;
+            }
+        }
+        // The due date index holds exactly the loans in the accounts
+        size_t totalLoans = 0;
+        for (const auto& p : accounts) {
+            for (const auto& loan : p.second.getBorrowedBooks()) {
+                totalLoans++;
+                if (!dueIndex.contains(loan.second, p.first, loan.first)) {
+                    report(currentDate, "loan of " + unpackIsbn(loan.first) + " by " + p.first +
+                           " missing from the due date index");
+                }
+            }
+        }
+        if (dueIndex.size() != totalLoans) {
+            report(currentDate, "due date index has " + to_string(dueIndex.size()) +
+                   " loans, accounts have " + to_string(totalLoans));
+        }
+
+        // Circulation statistics count every loan as borrowed and not yet returned
+        long long openByRole[2] = {0, 0};
+        for (const auto& p : accounts) {
+            openByRole[p.second.isFacultyMember()] += p.second.getBorrowedBooks().size();
+        }
+        for (int faculty = 0; faculty < 2; faculty++) {
+            const CirculationTotals& totals = circulation.forRole(faculty);
+            if (totals.borrows - totals.returns != openByRole[faculty]) {
+                report(currentDate, string(faculty ? "faculty" : "student") + " statistics have " +
+                       to_string(totals.borrows - totals.returns) + " open loans, accounts have " +
+                       to_string(openByRole[faculty]));
+            }
+        }
+
+        books->forEach([&](IsbnKey key, const Book& book) {
+            bool onLoan = borrower.count(key) > 0;
+            if (book.isAvailable() == onLoan) {
+                report(currentDate, "book " + unpackIsbn(key) + " is " +
+                       (book.isAvailable() ? "available" : "unavailable") +
+                       " but " + (onLoan ? "on loan" : "not on loan"));
+            }
+        });
+
+        // Student fines are 10 rupees per full day overdue on each loan, and
+        // the fine ledger agrees with them
+        Paise totalFines = 0;
+        for (auto& p : accounts) {
+            Account& account = p.second;
+            if (account.isFacultyMember()) continue;
+            Paise expected = 0;
+            for (const auto& loan : account.getBorrowedBooks()) {
+                int daysOverdue = (currentDate - loan.second) / DAY;
+                if (daysOverdue > 0) expected += daysOverdue * FINE_PER_DAY;
+            }
+            account.updateFines(currentDate);
+            if (account.getTotalFine() != expected) {
+                report(currentDate, "account " + p.first + " fine " + formatRupees(account.getTotalFine()) +
+                       " expected " + formatRupees(expected));
+            }
+            if (fineLedger.balance(p.first) != account.getTotalFine()) {
+                report(currentDate, "account " + p.first + " ledger balance " +
+                       formatRupees(fineLedger.balance(p.first)) + " differs from fine " +
+                       formatRupees(account.getTotalFine()));
+            }
+            totalFines += account.getTotalFine();
+        }
+        if (fineLedger.outstandingTotal() != totalFines) {
+            report(currentDate, "outstanding total " + formatRupees(fineLedger.outstandingTotal()) +
+                   " differs from sum of account fines " + formatRupees(totalFines));
+        }
+    }
+
+    // Book IDs come back from a data file with the key and the text they
+    // were saved with: the seed IDs, the generated ISBNs and IDs at the
+    // edges of the legacy encoding. IDs that cannot be keyed must say so.
+    void checkBookIds() {
+        vector<pair<string, string>> cases;  // stored form, canonical form
+        for (int i = 1; i <= 10; i++) cases.push_back({to_string(i), to_string(i)});
+        for (const string& isbn : isbns) cases.push_back({isbn, isbn});
+        cases.insert(cases.end(), {{"0", "0"},
+                                   {"007", "007"},
+                                   {"000000000000000000", "000000000000000000"},
+                                   {"999999999999999999", "999999999999999999"},
+                                   {"0000000000", "#0000000000"},  // passes the ISBN-10 check
+                                   {"#9780000000002", "#9780000000002"},
+                                   {"ABCDEFGH", "ABCDEFGH"},
+                                   {"X", "X"},
+                                   {"##5", "##5"},
+                                   {" 42\r", "42"}});
+        for (const auto& c : cases) {
+            IsbnKey key = packStoredIsbn(c.first);
+            if (key == INVALID_ISBN) {
+                report(0, "book ID '" + c.first + "' cannot be keyed");
+            } else if (unpackIsbn(key) != c.second) {
+                report(0, "book ID '" + c.first + "' comes back as '" + unpackIsbn(key) + "'");
+            } else if (packStoredIsbn(c.second) != key || packIsbn(c.second) != key) {
+                report(0, "book ID '" + c.second + "' changes key when read back");
+            }
+        }
+        for (const char* id : {"ABCDEFGHI", "080442957X", "1234567890123456789", "", "#", "A B"}) {
+            if (packStoredIsbn(id) != INVALID_ISBN) report(0, string("book ID '") + id + "' should not be keyed");
+        }
+        // An ISBN-10 typed in is the same book as its stored ISBN-13
+        if (packIsbn("0-8044-2957-X") != packStoredIsbn(normalizeIsbn("080442957X"))) {
+            report(0, "ISBN-10 0-8044-2957-X and its ISBN-13 have different keys");
+        }
+    }
+
+    // Retitle every hundredth book, drop an available one and add a new one
+    void changeSomeBooks() {
+        vector<pair<IsbnKey, Book>> retitled;
+        IsbnKey dropped = INVALID_ISBN;
+        size_t seen = 0;
+        books->forEach([&](IsbnKey key, const Book& book) {
+            if (seen++ % 100 == 0) retitled.push_back({key, book});
+            if (dropped == INVALID_ISBN && book.isAvailable() && !book.isReserved()) dropped = key;
+        });
+        for (auto& book : retitled) {
+            book.second.setTitle(book.second.getTitle() + " (revised)");
+            books->store(book.first, book.second);
+        }
+        if (dropped != INVALID_ISBN) books->erase(dropped);
+        books->store(packIsbn("9999"), Book("Added Title", "Added Author", "Added Publisher", 2024, "9999"));
+    }
+
+    // What the persistence checks compare: users, accounts with their fines
+    // as of asOf, books, ledger balances and circulation totals
+    string dumpState(int asOf) {
+        ostringstream out;
+        writeUsers(out);
+        for (auto& p : accounts) {
+            p.second.updateFines(asOf);
+        }
+        writeAccounts(out);
+        writeBooks(out);
+        out << fineLedger.outstandingTotal() << "\n";
+        for (const auto& p : accounts) {
+            out << p.first << " " << fineLedger.balance(p.first);
+            const CirculationTotals* totals = circulation.forUser(p.first);
+            if (totals) {
+                out << " ";
+                totals->write(out);
+            }
+            out << "\n";
+        }
+        books->forEach([&](IsbnKey key, const Book&) {
+            const CirculationTotals* totals = circulation.forTitle(key);
+            if (!totals) return;
+            out << unpackIsbn(key) << " ";
+            totals->write(out);
+            out << "\n";
+        });
+        for (int faculty = 0; faculty < 2; faculty++) {
+            circulation.forRole(faculty).write(out);
+            out << "\n";
+        }
+        return out.str();
+    }
+
+    void compareState(int asOf, const string& expected, const string& what) {
+        string actual = dumpState(asOf);
+        if (actual == expected) return;
+        istringstream before(expected), after(actual);
+        string lineBefore, lineAfter;
+        int line = 1;
+        while (getline(before, lineBefore) && getline(after, lineAfter) && lineBefore == lineAfter) line++;
+        report(asOf, what + " changed line " + to_string(line) + " from '" + lineBefore + "' to '" + lineAfter + "'");
+    }
+
+    // Save the state and load it back in every storage mode, each in a
+    // directory of its own so no mode loads the files of another. A paged
+    // catalogue is written from one loaded in paged mode, so that mode comes
+    // last and takes a second round, which loads the books-N.db, and a third
+    // that changes a few books first, which goes through books-N.delta.
+    void checkSaveAndLoad(int asOf) {
+        struct Mode {
+            const char* name;
+            bool compact, paged, compressed;
+        };
+        const Mode modes[] = {{"text", false, false, false},
+                              {"compact", true, false, false},
+                              {"compress", false, false, true},
+                              {"paged", false, true, false}};
+        string expected = dumpState(asOf);
+        filesystem::path home = filesystem::current_path();
+        for (const Mode& mode : modes) {
+            filesystem::create_directory(mode.name);
+            filesystem::current_path(mode.name);
+            compactStorage = mode.compact;
+            pagedStorage = mode.paged;
+            compressedStorage = mode.compressed;
+            for (int round = 0; round < (mode.paged ? 3 : 1); round++) {
+                if (round == 2) {
+                    changeSomeBooks();
+                    expected = dumpState(asOf);
+                }
+                persistence.requestSave();
+                persistence.flush();
+                clearAllData();
+                Library().loadAllData();
+                compareState(asOf, expected, string(mode.name) + " save and load");
+            }
+            persistence.flush();
+            filesystem::current_path(home);
+        }
+
+        // Back to the in-memory catalogue, from the text files
+        compactStorage = pagedStorage = compressedStorage = false;
+        filesystem::current_path("text");
+        books.reset(new MemoryBookStorage());
+        clearAllData();
+        Library().loadAllData();
+        filesystem::current_path(home);
+    }
+
+public:
+    SimulationHarness(int users, int days, unsigned seed)
+        : numUsers(users), numBooks(max(1, users * 2)), numDays(days), rng(seed),
+          operations(0), divergences(0) {}
+
+    bool run() {
+        cout << "Simulating " << numUsers << " users, " << numBooks << " books, "
+             << numDays << " days...\n";
+        setup();
+        checkBookIds();
+
+        // Silence the interactive messages printed by the borrow/return paths,
+        // and keep the simulated traffic's routine events out of events.log
+        ostringstream discard;
+        streambuf* original = cout.rdbuf(discard.rdbuf());
+        EventLog::Severity severity = events.getMinSeverity();
+        events.setMinSeverity(max(severity, EventLog::WARN));
+
+        // The traffic is logged to operations.log in a scratch directory, and
+        // the state at the end of the middle day is kept for the restore check
+        filesystem::path home = filesystem::current_path();
+        filesystem::path scratch = filesystem::temp_directory_path() /
+                                   ("lms-simulate-" + to_string(chrono::steady_clock::now().time_since_epoch().count()));
+        filesystem::create_directories(scratch);
+        filesystem::current_path(scratch);
+        simulatedDate = START_DATE;
+        opLog.open();
+        int middleDay = numDays / 2;
+        int middleTime = START_DATE + (middleDay + 1) * DAY - 1;
+        string middleState;
+
+        chrono::duration<double> trafficTime(0), checkTime(0);
+        for (int day = 0; day < numDays; day++) {
+            auto trafficStart = chrono::steady_clock::now();
+            for (int i = 0; i < numUsers; i++) {
+                // Spread each day's traffic over office hours
+                simulatedDate = START_DATE + day * DAY + 9 * 60 * 60 + (int)((long long)i * 8 * 60 * 60 / numUsers);
+                if (chance(0.2)) {
+                    simulateUser(users[userIds[i]], simulatedDate);
+                }
+            }
+            discard.str("");
+            auto checkStart = chrono::steady_clock::now();
+            checkInvariants(START_DATE + (day + 1) * DAY - 1);
+            discard.str("");
+            trafficTime += checkStart - trafficStart;
+            checkTime += chrono::steady_clock::now() - checkStart;
+            if (day == middleDay) middleState = dumpState(middleTime);
+        }
+
+        // Point-in-time restore gets back the middle day's state, which then
+        // has to survive a save and load in every storage mode
+        auto persistenceStart = chrono::steady_clock::now();
+        if (numDays > 0) {
+            simulatedDate = middleTime;
+            if (opLog.restoreTo(middleTime)) {
+                compareState(middleTime, middleState, "restore to day " + to_string(middleDay + 1));
+            } else {
+                report(middleTime, "restore to day " + to_string(middleDay + 1) + " failed");
+            }
+            checkSaveAndLoad(middleTime);
+        }
+        chrono::duration<double> persistenceTime = chrono::steady_clock::now() - persistenceStart;
+        opLog.close();
+        filesystem::current_path(home);
+        error_code ec;
+        filesystem::remove_all(scratch, ec);
+
+        cout.rdbuf(original);
+        events.setMinSeverity(severity);
+        simulatedDate = 0;
+
+        cout << "Operations: " << operations << "\n";
+        cout << "Traffic time: " << trafficTime.count() << " s ("
+             << (trafficTime.count() > 0 ? operations / trafficTime.count() : 0) << " ops/s)\n";
+        cout << "Invariant check time: " << checkTime.count() << " s\n";
+        cout << "Restore and save/load check time: " << persistenceTime.count() << " s\n";
+        cout << "Divergences: " << divergences << "\n";
+        return divergences == 0;
+    }
+};
+
+void writeAccounts(ostream &out) {
+    writeAccounts(out, snapshotAccounts(versions.read()->accounts));
+}
+
+void writeAccounts(ostream &out, const AccountSnapshot& source) {
+    out << source.size() << "\n";
+    source.forEach([&](const string&, const shared_ptr<const Account>& account) {
+        account->saveToFile(out);
+    });
+}
+
+// accounts.dat layout: magic "LMSA", version, base epoch, ISBN table, then
+// every account in Account::saveToCompact form
+void writeAccountsCompact(ostream &out, const AccountSnapshot& source) {
+    map<string, unsigned> isbnIndex;
+    vector<string> isbnTable;
+    long long baseEpoch = numeric_limits<int>::max();
+    source.forEach([&](const string&, const shared_ptr<const Account>& account) {
+        for (const auto& book : account->getBorrowedBooks()) {
+            string isbn = unpackIsbn(book.first);
+            if (isbnIndex.emplace(isbn, isbnTable.size()).second) isbnTable.push_back(isbn);
+            baseEpoch = min<long long>(baseEpoch, book.second);
+        }
+        for (const auto& history : account->getBorrowingHistory()) {
+            if (isbnIndex.emplace(history.first, isbnTable.size()).second) isbnTable.push_back(history.first);
+            baseEpoch = min<long long>(baseEpoch, history.second);
+        }
+    });
+    if (isbnTable.empty()) baseEpoch = 0;
+
+    out.write("LMSA", 4);
+    out.put(1);
+    writeSignedVarint(out, baseEpoch);
+    writeVarint(out, isbnTable.size());
+    for (const string& isbn : isbnTable) {
+        writeCompactString(out, isbn);
+    }
+    writeVarint(out, source.size());
+    source.forEach([&](const string&, const shared_ptr<const Account>& account) {
+        account->saveToCompact(out, isbnIndex, baseEpoch);
+    });
+}
+
+// Set when a damaged accounts.dat could not be moved aside on load
+bool keepDamagedAccounts = false;
+
+bool readAccountsCompact(istream &in) {
+    char magic[4];
+    in.read(magic, 4);
+    if (!in || string(magic, 4) != "LMSA" || in.get() != 1) {
+        events.record(EventLog::ERROR, "load.damaged", {{"file", "accounts.dat"}, {"action", "not a compact accounts file"}});
+        return false;
+    }
+    int baseEpoch = readSignedVarint(in);
+    vector<string> isbnTable(readVarint(in));
+    for (auto& isbn : isbnTable) {
+        string stored = readCompactString(in);
+        if (loadIsbn(stored, "accounts.dat") != INVALID_ISBN) isbn = canonicalStoredIsbn(stored);
+    }
+    unsigned long long numUsers = readVarint(in);
+    events.record(EventLog::INFO, "load.started", {{"file", "accounts"}, {"records", numUsers}});
+    for (unsigned long long i = 0; i < numUsers && in; i++) {
+        Account acc;
+        acc.loadFromCompact(in, isbnTable, baseEpoch, getCurrentDate());
+        accounts[acc.getUserID()] = acc;
+        markAccountChanged(acc.getUserID());
+    }
+    if (!in) {
+        events.record(EventLog::ERROR, "load.damaged", {{"file", "accounts.dat"}, {"action", "truncated"}});
+        return false;
+    }
+    events.record(EventLog::INFO, "load.finished", {{"file", "accounts"}});
+    return true;
+}
+
+void saveAccounts() {
+    saveAccounts(snapshotAccounts(versions.read()->accounts), compactStorage);
+}
+
+void saveAccounts(const AccountSnapshot& source, bool compact) {
+    if (compact) {
+        // Written as accounts.dat.tmp and renamed, so a crash mid-write
+        // leaves the previous accounts.dat in place
+        if (keepDamagedAccounts) {
+            events.record(EventLog::ERROR, "save.refused", {{"file", "accounts.dat"}, {"reason", "damaged original kept"}});
+            return;
+        }
+        ostringstream buffer;
+        writeAccountsCompact(buffer, source);
+        ofstream file("accounts.dat.tmp", ios::out | ios::binary | ios::trunc);
         if (!file) {
-            cout << "No existing users file found. Will create new file when saving.\n";
+            events.record(EventLog::ERROR, "save.open_failed", {{"file", "accounts.dat"}});
             return;
         }
-        int numUsers;
-        file >> numUsers;
-        file.ignore();
-        cout << "Loading " << numUsers << " users...\n";
-        
-        // Don't clear existing users, merge with loaded data
-        for (int i = 0; i < numUsers; i++) {
-            string id, name, password;
-            int type;
-            getline(file, id);
-            getline(file, name);
-            getline(file, password);
-            file >> type;
-            file.ignore();
-            
-            // Only create new user if it doesn't exist
-            if (users.find(id) == users.end()) {
-                User* user = nullptr;
-                switch (type) {
-                    case 2: user = new Librarian(id, name, password); break;
-                    case 1: user = new Faculty(id, name, password); break;
-                    case 0: user = new Student(id, name, password); break;
-                }
-                if (user) users[id] = user;
+        string data = buffer.str();
+        file.write(data.data(), data.size());
+        file.close();
+        error_code ec;
+        if (file) filesystem::rename("accounts.dat.tmp", "accounts.dat", ec);
+        if (!file || ec) events.record(EventLog::ERROR, "save.failed", {{"file", "accounts.dat"}});
+        return;
+    }
+
+    if (compressedStorage) {
+        SnapshotWriter file("accounts.lmz");
+        writeAccounts(file, source);
+        if (!file.close()) events.record(EventLog::ERROR, "save.failed", {{"file", "accounts.lmz"}});
+        return;
+    }
+
+    ofstream file("accounts.txt", ios::out);  // Open in write mode, create if doesn't exist
+    if (!file) {
+        events.record(EventLog::ERROR, "save.open_failed", {{"file", "accounts.txt"}});
+        return;
+    }
+    writeAccounts(file, source);
+    file.close();
+}
+
+void readAccounts(istream &file) {
+    int numUsers;
+    file >> numUsers;
+    events.record(EventLog::INFO, "load.started", {{"file", "accounts"}, {"records", numUsers}});
+    
+    // Don't clear existing accounts, merge with loaded data
+    for (int i = 0; i < numUsers; i++) {
+        Account acc;
+        acc.loadFromFile(file, getCurrentDate());
+        string userId = acc.getUserID();
+        accounts[userId] = acc;  // Update or add the account
+        markAccountChanged(userId);
+    }
+    events.record(EventLog::INFO, "load.finished", {{"file", "accounts"}});
+}
+
+void loadAccounts() {
+    // A compact accounts.dat takes precedence and keeps compact storage on
+    ifstream compact("accounts.dat", ios::binary);
+    if (compact) {
+        compactStorage = true;
+        if (!readAccountsCompact(compact)) {
+            // The next save would replace it with only the accounts read
+            // before the damage, so keep the original aside first
+            compact.close();
+            string kept = "accounts.dat.damaged-" + to_string(time(nullptr));
+            error_code ec;
+            filesystem::rename("accounts.dat", kept, ec);
+            if (ec) {
+                events.record(EventLog::ERROR, "load.keep_failed", {{"file", "accounts.dat"}, {"reason", ec.message()}});
+                kept = "accounts.dat (could not be moved aside, so it will not be overwritten)";
+                keepDamagedAccounts = true;
+            } else {
+                events.record(EventLog::WARN, "load.kept_damaged", {{"file", "accounts.dat"}, {"kept", kept}});
+            }
+            cout << "Warning: accounts.dat is damaged; only the accounts before the damage were loaded. "
+                 << "The original is kept as " << kept << ".\n";
+        }
+        return;
+    }
+    // Then a compressed accounts.lmz, which keeps compressed storage on
+    SnapshotReader compressed("accounts.lmz");
+    if (compressed) {
+        compressedStorage = true;
+        readAccounts(compressed);
+        if (compressed.isDamaged()) {
+            events.record(EventLog::ERROR, "load.damaged", {{"file", "accounts.lmz"}, {"action", "loaded the accounts before the damage"}});
+        }
+        return;
+    }
+
+    ifstream file("accounts.txt");
+    if (!file) {
+        events.record(EventLog::INFO, "load.missing", {{"file", "accounts"}});
+        return;
+    }
+    readAccounts(file);
+    file.close();
+}
+
+void writeBooks(ostream &out) {
+    writeBooks(out, *books);
+}
+
+void writeBooks(ostream &out, const BookStorage& source) {
+    out << source.size() << "\n";
+    source.forEach([&](IsbnKey, const Book& book) {
+        book.saveToFile(out);
+    });
+}
+
+void saveBooks() {
+    books->save();
+}
+
+// books.txt or books.lmz, for the in-memory storage; a paged catalogue saves itself
+void saveBooks(const BookStorage& source) {
+    if (compressedStorage) {
+        SnapshotWriter file("books.lmz");
+        writeBooks(file, source);
+        if (!file.close()) events.record(EventLog::ERROR, "save.failed", {{"file", "books.lmz"}});
+        return;
+    }
+
+    ostringstream text;
+    writeBooks(text, source);
+    ofstream file("books.txt", ios::out);  // Open in write mode, create if doesn't exist
+    if (!file) {
+        events.record(EventLog::ERROR, "save.open_failed", {{"file", "books.txt"}});
+        return;
+    }
+    file << text.str();
+    file.close();
+    catalogueRefresh.rebase(text.str());  // Our own save is not a change to refresh from
+}
+
+void readBooks(istream &file) {
+    int numBooks;
+    file >> numBooks;
+    file.ignore();
+    events.record(EventLog::INFO, "load.started", {{"file", "books.txt"}, {"records", numBooks}});
+    
+    // Don't clear existing books, merge with loaded data
+    for (int i = 0; i < numBooks; i++) {
+        Book book;
+        book.loadFromFile(file);
+        IsbnKey key = loadIsbn(book.getISBN(), "books");
+        if (key == INVALID_ISBN) continue;
+        book.setISBN(unpackIsbn(key));
+        books->store(key, book);  // Update or add the book
+    }
+    events.record(EventLog::INFO, "load.finished", {{"file", "books.txt"}});
+}
+
+// The newest books-N.db, if any, by generation; older ones, their deltas
+// and unfinished .tmp files left by an interrupted save are deleted
+string findPagedCatalogue(unsigned long long& generation) {
+    string newest;
+    generation = 0;
+    vector<pair<unsigned long long, string>> stale;
+    vector<pair<unsigned long long, string>> deltas;
+    error_code ec;
+    for (const auto& entry : filesystem::directory_iterator(".", ec)) {
+        string name = entry.path().filename().string();
+        if (name.compare(0, 6, "books-") != 0) continue;
+        size_t digits = name.find_first_not_of("0123456789", 6);
+        if (digits == 6 || digits == string::npos) continue;
+        string suffix = name.substr(digits);
+        if (suffix == ".db.tmp") {
+            stale.push_back({0, name});
+        } else if (suffix == ".delta") {
+            deltas.push_back({stoull(name.substr(6, digits - 6)), name});
+        } else if (suffix == ".db") {
+            unsigned long long found = stoull(name.substr(6, digits - 6));
+            if (found > generation) {
+                if (!newest.empty()) stale.push_back({generation, newest});
+                generation = found;
+                newest = name;
+            } else {
+                stale.push_back({found, name});
             }
         }
-        file.close();
-        cout << "Users loaded successfully.\n";
     }
-};
+    for (const auto& delta : deltas) {
+        if (delta.first != generation) stale.push_back(delta);
+    }
+    for (const auto& file : stale) {
+        filesystem::remove(file.second, ec);
+    }
+    return newest;
+}
+
+void loadBooks() {
+    // A paged books-N.db takes precedence and keeps the catalogue on disk
+    unsigned long long generation;
+    string paged = findPagedCatalogue(generation);
+    if (!paged.empty()) {
+        auto file = make_shared<BookPageFile>(paged, generation);
+        if (file->isValid()) {
+            PagedBookStorage* storage = new PagedBookStorage(file);
+            storage->loadDelta();
+            books.reset(storage);
+            events.record(EventLog::INFO, "load.paged_catalogue", {{"file", paged}, {"books", books->size()}});
+            return;
+        }
+        events.record(EventLog::ERROR, "load.damaged", {{"file", paged}, {"action", "loading books.txt instead"}});
+    }
+    if (pagedStorage) {
+        books.reset(new PagedBookStorage());
+    }
 
-void saveAccounts() {
-    ofstream file("accounts.txt", ios::out);  // Open in write mode, create if doesn't exist
-    if (!file) {
-        cerr << "Error: Unable to create/open accounts.txt for writing!\n";
+    // A compressed books.lmz comes next and keeps compressed storage on. It
+    // is read a batch of blocks at a time rather than as a whole.
+    SnapshotReader compressed("books.lmz");
+    if (compressed) {
+        compressedStorage = true;
+        readBooks(compressed);
+        if (compressed.isDamaged()) {
+            events.record(EventLog::ERROR, "load.damaged", {{"file", "books.lmz"}, {"action", "loaded the books before the damage"}});
+        }
         return;
     }
-    file << accounts.size() << "\n";
-    for (const auto& pair : accounts) {
-        pair.second.saveToFile(file);
+
+    ifstream file("books.txt", ios::in | ios::binary);
+    if (!file) {
+        events.record(EventLog::INFO, "load.missing", {{"file", "books.txt"}});
+        return;
     }
+    string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
     file.close();
+    istringstream in(text);
+    readBooks(in);
+    catalogueRefresh.rebase(text);
 }
 
-void loadAccounts() {
-    ifstream file("accounts.txt");
+void writeUsers(ostream &out, const vector<UserRecord>& records) {
+    out << records.size() << "\n";
+    for (const auto& record : records) {
+        out << record.id << "\n" << record.name << "\n"
+            << record.password << "\n" << record.role << "\n";
+    }
+}
+
+void writeUsers(ostream &out) {
+    writeUsers(out, snapshotUsers());
+}
+
+void saveUsers() {
+    saveUsers(snapshotUsers());
+}
+
+void saveUsers(const vector<UserRecord>& records) {
+    ofstream file("users.txt", ios::out);  // Open in write mode, create if doesn't exist
     if (!file) {
-        cout << "No existing accounts file found. Will create new file when saving.\n";
+        events.record(EventLog::ERROR, "save.open_failed", {{"file", "users.txt"}});
         return;
     }
+    writeUsers(file, records);
+    file.close();
+}
+
+void readUsers(istream &file) {
     int numUsers;
     file >> numUsers;
-    cout << "Loading " << numUsers << " accounts...\n";
+    file.ignore();
+    events.record(EventLog::INFO, "load.started", {{"file", "users.txt"}, {"records", numUsers}});
     
-    // Don't clear existing accounts, merge with loaded data
+    // Don't clear existing users, merge with loaded data
     for (int i = 0; i < numUsers; i++) {
-        Account acc;
-        acc.loadFromFile(file, getCurrentDate());
-        string userId = acc.getUserID();
-        accounts[userId] = acc;  // Update or add the account
+        string id, name, password;
+        int type;
+        getline(file, id);
+        getline(file, name);
+        getline(file, password);
+        file >> type;
+        file.ignore();
+        
+        // Only create new user if it doesn't exist
+        if (users.find(id) == users.end()) {
+            User* user = nullptr;
+            switch (type) {
+                case 2: user = new Librarian(id, name, password); break;
+                case 1: user = new Faculty(id, name, password); break;
+                case 0: user = new Student(id, name, password); break;
+            }
+            if (user) users[id] = user;
+        }
+    }
+    events.record(EventLog::INFO, "load.finished", {{"file", "users.txt"}});
+}
+
+void loadUsers() {
+    ifstream file("users.txt");
+    if (!file) {
+        events.record(EventLog::INFO, "load.missing", {{"file", "users.txt"}});
+        return;
     }
+    readUsers(file);
     file.close();
-    cout << "Accounts loaded successfully.\n";
 }
 
-void saveBooks() {
-    ofstream file("books.txt", ios::out);  // Open in write mode, create if doesn't exist
+// Drop all in-memory state (used before rebuilding it from a checkpoint)
+void clearAllData() {
+    for (auto& p : users) {
+        delete p.second;
+    }
+    users.clear();
+    accounts.clear();
+    allAccountsChanged = true;
+    books->clear();
+    fineLedger.clear();
+    recommender.clear();
+    dueIndex.clear();
+    circulation.clear();
+}
+
+void rebuildRecommendations() {
+    vector<const vector<pair<string, int>>*> histories;
+    for (const auto& p : accounts) {
+        histories.push_back(&p.second.getBorrowingHistory());
+    }
+    recommender.build(histories);
+}
+
+void rebuildDueIndex() {
+    dueIndex.clear();
+    for (const auto& p : accounts) {
+        for (const auto& loan : p.second.getBorrowedBooks()) {
+            dueIndex.add(loan.second, p.first, loan.first);
+        }
+    }
+}
+
+void rebuildFuzzyIndex() {
+    fuzzyIndex.clear();
+    fuzzyIndexReady = false;
+    // Indexing reads every book, so a paged catalogue waits for the first search
+    if (!books->isPaged()) ensureFuzzyIndex();
+}
+
+void ensureFuzzyIndex() {
+    if (fuzzyIndexReady) return;
+    fuzzyIndex.clear();
+    books->forEach([](IsbnKey key, const Book& book) {
+        fuzzyIndex.add(FuzzyIndex::TITLE, unpackIsbn(key), book.getTitle());
+        fuzzyIndex.add(FuzzyIndex::AUTHOR, unpackIsbn(key), book.getAuthor());
+    });
+    for (const auto& p : users) {
+        fuzzyIndex.add(FuzzyIndex::USER_NAME, p.first, p.second->getName());
+    }
+    fuzzyIndexReady = true;
+}
+
+void saveLedger() {
+    saveLedger(fineLedger);
+}
+
+void saveLedger(const FineLedger& ledger) {
+    ofstream file("fine_ledger.txt", ios::out);
     if (!file) {
-        cerr << "Error: Unable to create/open books.txt for writing!\n";
+        events.record(EventLog::ERROR, "save.open_failed", {{"file", "fine_ledger.txt"}});
         return;
     }
-    file << books.size() << "\n";
-    for (const auto& p : books) {
-        p.second.saveToFile(file);
+    ledger.write(file);
+    file.close();
+}
+
+void saveCirculation(const CirculationStats& stats) {
+    ofstream file("circulation.txt", ios::out);
+    if (!file) {
+        events.record(EventLog::ERROR, "save.open_failed", {{"file", "circulation.txt"}});
+        return;
     }
+    stats.write(file);
     file.close();
 }
 
-void loadBooks() {
-    ifstream file("books.txt");
+// Loaded after the accounts; without a saved file the statistics start from their histories
+void loadCirculation() {
+    ifstream file("circulation.txt");
     if (!file) {
-        cout << "No existing books file found. Will create new file when saving.\n";
+        seedCirculation();
         return;
     }
-    int numBooks;
-    file >> numBooks;
-    file.ignore();
-    cout << "Loading " << numBooks << " books...\n";
-    
-    // Don't clear existing books, merge with loaded data
-    for (int i = 0; i < numBooks; i++) {
-        Book book;
-        book.loadFromFile(file);
-        books[book.getISBN()] = book;  // Update or add the book
+    circulation.read(file);
+    file.close();
+}
+
+void seedCirculation() {
+    circulation.clear();
+    for (const auto& p : accounts) {
+        const Account& account = p.second;
+        circulation.seed(p.first, account.isFacultyMember(), account.getMaxDays(),
+                         account.getBorrowingHistory(), account.getBorrowedBooks());
     }
+}
+
+// Loaded before the accounts so that their fines reconcile against it
+void loadLedger() {
+    ifstream file("fine_ledger.txt");
+    if (!file) return;
+    fineLedger.read(file);
     file.close();
-    cout << "Books loaded successfully.\n";
 }
 
 int getCurrentDate() {
@@ -1035,7 +7737,327 @@ int getCurrentDate() {
     return static_cast<int>(now); // Return seconds instead of days
 }
 
-int main() {
+// Split a tab-separated operation log line into its fields
+vector<string> splitFields(const string& line) {
+    vector<string> fields;
+    string field;
+    istringstream in(line);
+    while (getline(in, field, '\t')) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+void OperationLog::open() {
+    // Recover the last sequence number from the tail of the existing log
+    ifstream existing(logFile);
+    if (existing) {
+        existing.seekg(0, ios::end);
+        streamoff size = existing.tellg();
+        existing.seekg(size > 65536 ? size - 65536 : 0);
+        string line, last;
+        while (getline(existing, line)) {
+            if (!line.empty()) last = line;
+        }
+        if (!last.empty()) lastSeq = atoll(last.c_str());
+    }
+
+    logStream.open(logFile, ios::app);
+    if (!logStream) {
+        cerr << "Error: Unable to open " << logFile << " for appending!\n";
+        return;
+    }
+
+    // A base checkpoint is required so the log can be replayed from it
+    vector<CheckpointInfo> checkpoints = listCheckpoints();
+    if (checkpoints.empty()) {
+        writeCheckpoint();
+    } else {
+        opsSinceCheckpoint = lastSeq - checkpoints.back().seq;
+    }
+}
+
+void OperationLog::record(const string& op, const vector<string>& args) {
+    recordAll({{op, args}});
+}
+
+// A batch is written with one flush and checkpointed at most once, after it
+void OperationLog::recordAll(const vector<pair<string, vector<string>>>& operations) {
+    if (replaying || !logStream.is_open() || operations.empty()) return;
+
+    int now = getCurrentDate();
+    for (const auto& operation : operations) {
+        logStream << ++lastSeq << "\t" << now << "\t" << operation.first;
+        for (string arg : operation.second) {
+            // Tabs and newlines would break the one-record-per-line format
+            replace(arg.begin(), arg.end(), '\t', ' ');
+            replace(arg.begin(), arg.end(), '\n', ' ');
+            logStream << "\t" << arg;
+        }
+        logStream << "\n";
+    }
+    logStream.flush();
+
+    opsSinceCheckpoint += operations.size();
+    if (opsSinceCheckpoint >= CHECKPOINT_INTERVAL) {
+        writeCheckpoint();
+    }
+}
+
+void OperationLog::writeCheckpoint() {
+    filesystem::create_directories(checkpointDir);
+    string stamp = to_string(lastSeq) + "_" + to_string(getCurrentDate());
+    string path = checkpointDir + "/cp_" + stamp + (compressedStorage ? ".lmz" : ".txt");
+    string partialPath = checkpointDir + "/tmp_cp_" + stamp + ".txt";  // Replicas only see finished checkpoints
+    unique_ptr<ostream> file;
+    if (compressedStorage) {
+        file.reset(new SnapshotWriter(path));  // Written as path.tmp until closed
+    } else {
+        file.reset(new ofstream(partialPath, ios::out));
+    }
+    if (!*file) {
+        cerr << "Error: Unable to create checkpoint " << path << "!\n";
+        return;
+    }
+
+    ofstream ledgerFile(checkpointDir + "/ledger_" + stamp + ".txt", ios::out);
+    fineLedger.write(ledgerFile);
+    ledgerFile.close();
+    ofstream circulationFile(checkpointDir + "/circulation_" + stamp + ".txt", ios::out);
+    circulation.write(circulationFile);
+    circulationFile.close();
+
+    // Header: sequence number covered and the log offset replay resumes from
+    logStream.flush();
+    long long offset = filesystem::exists(logFile) ? (long long)filesystem::file_size(logFile) : 0;
+    *file << lastSeq << " " << offset << "\n";
+    writeAccounts(*file);
+    writeBooks(*file);
+    writeUsers(*file);
+    if (compressedStorage) {
+        if (!static_cast<SnapshotWriter&>(*file).close()) cerr << "Error: Unable to create checkpoint " << path << "!\n";
+    } else {
+        file.reset();
+        error_code ec;
+        filesystem::rename(partialPath, path, ec);
+        if (ec) cerr << "Error: Unable to create checkpoint " << path << ": " << ec.message() << "\n";
+    }
+    opsSinceCheckpoint = 0;
+}
+
+vector<OperationLog::CheckpointInfo> OperationLog::listCheckpoints() const {
+    vector<CheckpointInfo> checkpoints;
+    if (!filesystem::exists(checkpointDir)) return checkpoints;
+
+    for (const auto& entry : filesystem::directory_iterator(checkpointDir)) {
+        // File names look like cp_<seq>_<time>.txt, or .lmz when compressed
+        string name = entry.path().filename().string();
+        CheckpointInfo info;
+        int length = 0;
+        if (sscanf(name.c_str(), "cp_%lld_%d%n", &info.seq, &info.time, &length) == 2 &&
+            (name.substr(length) == ".txt" || name.substr(length) == ".lmz")) {
+            info.path = entry.path().string();
+            checkpoints.push_back(info);
+        }
+    }
+    sort(checkpoints.begin(), checkpoints.end(),
+         [](const CheckpointInfo& a, const CheckpointInfo& b) { return a.seq < b.seq; });
+    return checkpoints;
+}
+
+bool OperationLog::applyOperation(const vector<string>& fields) {
+    const string& op = fields[2];
+    vector<string> args(fields.begin() + 3, fields.end());
+
+    // Book IDs in entries written before ISBN support are migrated like
+    // those in the data files; an entry with an unusable one is skipped
+    size_t isbnArg = (op == "ADD_BOOK" || op == "REMOVE_BOOK" || op == "UPDATE_BOOK") ? 0
+                     : (op == "BORROW" || op == "RETURN" || op == "REISSUE") ? 1 : args.size();
+    if (isbnArg < args.size()) {
+        if (loadIsbn(args[isbnArg], "operations.log") == INVALID_ISBN) return false;
+        args[isbnArg] = canonicalStoredIsbn(args[isbnArg]);
+    }
+
+    if (op == "ADD_USER" && args.size() == 4) {
+        if (users.find(args[0]) == users.end()) {
+            if (args[3] == "1") users[args[0]] = new Faculty(args[0], args[1], args[2]);
+            else users[args[0]] = new Student(args[0], args[1], args[2]);
+        }
+    } else if (op == "UPDATE_USER" && args.size() == 4) {
+        auto it = users.find(args[0]);
+        if (it != users.end()) delete it->second;
+        if (args[3] == "1") users[args[0]] = new Faculty(args[0], args[1], args[2]);
+        else users[args[0]] = new Student(args[0], args[1], args[2]);
+    } else if (op == "REMOVE_USER" && args.size() == 1) {
+        auto it = users.find(args[0]);
+        if (it != users.end()) {
+            delete it->second;
+            users.erase(it);
+        }
+        if (accounts.count(args[0])) {
+            dueIndex.removeAll(args[0], accounts[args[0]].getBorrowedBooks());
+            recommender.removePatron(accounts[args[0]].getBorrowingHistory());
+        }
+        accounts.erase(args[0]);
+        markAccountChanged(args[0]);
+        fineLedger.removeAccount(args[0]);
+    } else if (op == "ADD_BOOK" && args.size() == 5) {
+        books->store(packIsbn(args[0]), Book(args[1], args[2], args[3], stoi(args[4]), args[0], true));
+    } else if (op == "REMOVE_BOOK" && args.size() == 1) {
+        books->erase(packIsbn(args[0]));
+    } else if (op == "UPDATE_BOOK" && args.size() == 5) {
+        Book existing;
+        bool available = books->find(packIsbn(args[0]), existing) ? existing.isAvailable() : true;
+        books->store(packIsbn(args[0]), Book(args[1], args[2], args[3], stoi(args[4]), args[0], available));
+    } else if (op == "BORROW" && args.size() == 3) {
+        accounts[args[0]].addLoan(args[1], stoi(args[2]));
+        books->setAvailability(packIsbn(args[1]), false);
+    } else if (op == "RETURN" && args.size() == 3) {
+        Account& account = accounts[args[0]];
+        int returnDate = stoi(args[2]);
+        account.addToHistory(args[1], returnDate);
+        account.removeLoan(args[1], returnDate);
+        books->setAvailability(packIsbn(args[1]), true);
+    } else if (op == "REISSUE" && args.size() == 3) {
+        // The fine due at that moment was paid, then the book reissued
+        Account& account = accounts[args[0]];
+        int paidDate = stoi(args[2]);
+        account.updateFines(paidDate);
+        account.settleBookFine(args[1], paidDate);
+        account.reissueLoan(args[1], paidDate);
+    } else if (op == "PAY_FINE" && args.size() == 2) {
+        Account& account = accounts[args[0]];
+        int paidDate = stoi(args[1]);
+        account.updateFines(paidDate);
+        vector<string> borrowed;
+        for (const auto& book : account.getBorrowedBooks()) {
+            borrowed.push_back(unpackIsbn(book.first));
+        }
+        for (const auto& isbn : borrowed) {
+            account.settleBookFine(isbn, paidDate);
+            account.reissueLoan(isbn, paidDate);
+        }
+    } else {
+        return false;  // RESTORE markers and unknown records change nothing
+    }
+    return true;
+}
+
+// Replace the live data with a checkpoint; seq and offset say where in the log it ends
+void OperationLog::readCheckpoint(const CheckpointInfo& base, long long& seq, long long& offset) {
+    unique_ptr<istream> checkpointFile;
+    if (base.path.size() > 4 && base.path.compare(base.path.size() - 4, 4, ".lmz") == 0) {
+        checkpointFile.reset(new SnapshotReader(base.path));
+    } else {
+        checkpointFile.reset(new ifstream(base.path));
+    }
+    *checkpointFile >> seq >> offset;
+    checkpointFile->ignore();
+
+    clearAllData();
+    string stamp = to_string(base.seq) + "_" + to_string(base.time) + ".txt";
+    ifstream ledgerFile(checkpointDir + "/ledger_" + stamp);
+    if (ledgerFile) fineLedger.read(ledgerFile);
+    readAccounts(*checkpointFile);
+    readBooks(*checkpointFile);
+    readUsers(*checkpointFile);
+    ifstream circulationFile(checkpointDir + "/circulation_" + stamp);
+    if (circulationFile) {
+        circulation.read(circulationFile);
+    } else {
+        seedCirculation();  // Checkpoints from before statistics were kept
+    }
+    rebuildRecommendations();
+    rebuildDueIndex();
+}
+
+// Load the newest checkpoint, provided it covers at least minSeq
+bool OperationLog::loadLatestCheckpoint(long long minSeq, long long& seq, long long& offset) {
+    vector<CheckpointInfo> checkpoints = listCheckpoints();
+    if (checkpoints.empty() || checkpoints.back().seq < minSeq) return false;
+    if (!ifstream(checkpoints.back().path)) return false;
+    readCheckpoint(checkpoints.back(), seq, offset);
+    return true;
+}
+
+bool OperationLog::restoreTo(int targetTime) {
+    // Start from the newest checkpoint taken at or before the target time
+    vector<CheckpointInfo> checkpoints = listCheckpoints();
+    const CheckpointInfo* base = nullptr;
+    for (const auto& checkpoint : checkpoints) {
+        if (checkpoint.time <= targetTime) base = &checkpoint;
+    }
+    if (!base) {
+        cout << "No checkpoint exists at or before that time.\n";
+        return false;
+    }
+
+    if (!ifstream(base->path)) {
+        cerr << "Error: Unable to open checkpoint " << base->path << "!\n";
+        return false;
+    }
+    cout << "Restoring from checkpoint " << base->seq << "...\n";
+    long long checkpointSeq, logOffset;
+    readCheckpoint(*base, checkpointSeq, logOffset);
+
+    // Replay the log tail written after the checkpoint
+    logStream.flush();
+    ifstream log(logFile);
+    log.seekg(logOffset);
+    replaying = true;
+    long long applied = 0;
+    string line;
+    while (getline(log, line)) {
+        vector<string> fields = splitFields(line);
+        if (fields.size() < 3) continue;
+        try {
+            long long seq = stoll(fields[0]);
+            int time = stoi(fields[1]);
+            if (seq <= checkpointSeq || time > targetTime) continue;
+            if (applyOperation(fields)) applied++;
+        } catch (const exception& e) {
+            cerr << "Skipping malformed log record: " << line << "\n";
+        }
+    }
+    replaying = false;
+    cout << "Replayed " << applied << " operations.\n";
+    rebuildFuzzyIndex();
+
+    // Later restores and replays start from the restored state
+    record("RESTORE", {to_string(targetTime)});
+    writeCheckpoint();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // Stress harness: library_systemexe --simulate [users] [days] [seed]
+    if (argc > 1 && string(argv[1]) == "--simulate") {
+        int numUsers = argc > 2 ? atoi(argv[2]) : 2000;
+        int numDays = argc > 3 ? atoi(argv[3]) : 90;
+        unsigned seed = argc > 4 ? (unsigned)atoi(argv[4]) : 42;
+        SimulationHarness harness(numUsers, numDays, seed);
+        return harness.run() ? 0 : 1;
+    }
+    // Read-only replica of the primary running in this directory: library_systemexe --replica
+    if (argc > 1 && string(argv[1]) == "--replica") {
+        ReadReplica replica;
+        if (!replica.start()) return 1;
+        replica.serve();
+        return 0;
+    }
+    // Switch accounts to the compact accounts.dat encoding
+    if (argc > 1 && string(argv[1]) == "--compact") {
+        compactStorage = true;
+    }
+    // Move the catalogue from books.txt to a paged books-N.db
+    if (argc > 1 && string(argv[1]) == "--paged") {
+        pagedStorage = true;
+    }
+    // Keep books, accounts and checkpoints in block-compressed .lmz files
+    if (argc > 1 && string(argv[1]) == "--compress") {
+        compressedStorage = true;
+    }
+
     cout << "Starting Library Management System...\n";
     Library library;
     
@@ -1047,16 +8069,73 @@ int main() {
     if (users.empty()) {
         cout << "No existing users found. Creating initial setup...\n";
         library.initializeDefaultData();
+        rebuildFuzzyIndex();
     }
     
+    // Nightly job: library_systemexe --reminders [hours], writes the spool and exits
+    if (argc > 1 && string(argv[1]) == "--reminders") {
+        int windowHours = argc > 2 ? atoi(argv[2]) : 48;
+        versions.commit();
+        size_t reminded = generateDueReminders(getCurrentDate(), windowHours, "reminders");
+        cout << "Reminders written for " << reminded << " patrons.\n";
+        return 0;
+    }
+
+    // Duplicate audit: library_systemexe --dedup [file], writes merge proposals and exits
+    if (argc > 1 && string(argv[1]) == "--dedup") {
+        versions.commit();
+        auto version = versions.read();
+        DuplicateFinder::Report report = DuplicateFinder::run(*version);
+        DuplicateFinder::print(report, *version);
+        return DuplicateFinder::write(report, *version, argc > 2 ? argv[2] : "duplicates.jsonl") ? 0 : 1;
+    }
+
+    // Analytics export: library_systemexe --export [directory]
+    if (argc > 1 && string(argv[1]) == "--export") {
+        versions.commit();
+        long long rows = ColumnarExporter::exportTo(argc > 2 ? argv[2] : "export");
+        if (rows < 0) return 1;
+        cout << "Exported " << rows << " rows.\n";
+        return 0;
+    }
+
     // Save current state
     library.saveAllData();
+    opLog.open();
+
+    // Start-of-semester batch: library_systemexe --rollover roster.csv
+    if (argc > 2 && string(argv[1]) == "--rollover") {
+        SemesterRollover::Report report;
+        if (!SemesterRollover::run(argv[2], report)) return 1;
+        SemesterRollover::print(report);
+        library.saveAllData();
+        persistence.flush();
+        return 0;
+    }
+
+    // Consistency check: library_systemexe --fsck [--repair]
+    if (argc > 1 && string(argv[1]) == "--fsck") {
+        bool repair = argc > 2 && string(argv[2]) == "--repair";
+        ConsistencyChecker::print(ConsistencyChecker::check(repair));
+        if (repair) {
+            library.saveAllData();
+            persistence.flush();
+        }
+        return 0;
+    }
+
+    federation.loadConfig();
+    catalogueRefresh.start();
+#ifdef SIGHUP
+    signal(SIGHUP, requestCatalogueRefresh);
+#endif
     cout << "System initialized and data saved.\n";
 
     while (true) {
         string currentUserId;
         string password;
         bool loginSuccess = false;
+        bool loggedOut = false;
         User* currentUser = nullptr;
 
         do {
@@ -1065,6 +8144,10 @@ int main() {
             cin >> currentUserId;
             cout << "Enter your password: ";
             cin >> password;
+            if (cin.eof()) {
+                persistence.flush();
+                return 0;
+            }
 
             auto it = users.find(currentUserId);
             if (it == users.end()) {
@@ -1086,6 +8169,12 @@ int main() {
         int currentDate = getCurrentDate();
 
         do {
+            // A catalogue refresh prepared in the background goes live between commands
+            CatalogueRefresher::Report refreshed;
+            if (catalogueRefresh.applyPending(refreshed)) {
+                library.saveAllData();
+            }
+
             // Update current time and fines at the start of each menu iteration
             currentDate = getCurrentDate();
             cout << "\nCurrent Time: " << currentDate << "\n";
@@ -1094,6 +8183,7 @@ int main() {
             currentUser->displayMenu();
             cout << "Enter your choice: ";
             cin >> choice;
+            if (cin.eof()) break;
 
             // Add date simulation option for testing
             if (choice == 0 && dynamic_cast<Librarian*>(currentUser)) {
@@ -1114,18 +8204,24 @@ int main() {
                     break;
                 case 2: // Borrow Book
                     if (!dynamic_cast<Librarian*>(currentUser)) {
-                        string isbn;
-                        cout << "Enter ISBN to borrow: ";
-                        cin >> isbn;
-                        currentUser->borrowBook(isbn, currentDate);
+                        cout << "Enter ISBN to borrow (several separated by spaces to borrow them together): ";
+                        vector<string> isbns = readIsbnList(cin);
+                        if (isbns.size() == 1) {
+                            currentUser->borrowBook(isbns[0], currentDate);
+                        } else if (isbns.size() > 1) {
+                            currentUser->borrowBooks(isbns, currentDate);
+                        }
                     }
                     break;
                 case 3: // Return Book
                     if (!dynamic_cast<Librarian*>(currentUser)) {
-                        string isbn;
-                        cout << "Enter ISBN to return: ";
-                        cin >> isbn;
-                        currentUser->returnBook(isbn, currentDate);
+                        cout << "Enter ISBN to return (several separated by spaces to return them together): ";
+                        vector<string> isbns = readIsbnList(cin);
+                        if (isbns.size() == 1) {
+                            currentUser->returnBook(isbns[0], currentDate);
+                        } else if (isbns.size() > 1) {
+                            currentUser->returnBooks(isbns, currentDate);
+                        }
                     }
                     break;
                 case 4: // View Borrowed Books
@@ -1136,12 +8232,12 @@ int main() {
                             cout << "No books currently borrowed.\n";
                         } else {
                             for (const auto& book : borrowedBooks) {
-                                auto bookIt = books.find(book.first);
-                                if (bookIt != books.end()) {
+                                Book details;
+                                if (books->find(book.first, details)) {
                                     cout << "\nBook Details:\n";
-                                    cout << "ISBN: " << book.first << "\n";
-                                    cout << "Title: " << bookIt->second.getTitle() << "\n";
-                                    cout << "Author: " << bookIt->second.getAuthor() << "\n";
+                                    cout << "ISBN: " << unpackIsbn(book.first) << "\n";
+                                    cout << "Title: " << details.getTitle() << "\n";
+                                    cout << "Author: " << details.getAuthor() << "\n";
                                     
                                     // Convert due date to human-readable format
                                     time_t dueTime = book.second;
@@ -1156,7 +8252,7 @@ int main() {
                                     if (daysOverdue > 0) {
                                         cout << "Status: OVERDUE by " << daysOverdue << " days\n";
                                         if (!currentUser->getAccount().isFacultyMember()) {
-                                            cout << "Fine Amount: " << (daysOverdue * 10.0) << " rupees\n";
+                                            cout << "Fine Amount: " << formatRupees(daysOverdue * FINE_PER_DAY) << " rupees\n";
                                         }
                                     } else {
                                         cout << "Status: On time\n";
@@ -1172,7 +8268,7 @@ int main() {
                         // Recalculate fines before displaying
                         currentUser->getAccount().updateFines(currentDate);
                         cout << "\n=== Fine Details ===\n";
-                        cout << "Current Total Fine: " << currentUser->getAccount().getTotalFine() << " rupees\n";
+                        cout << "Current Total Fine: " << formatRupees(currentUser->getAccount().getTotalFine()) << " rupees\n";
                         
                         // Display individual book fines
                         cout << "\nIndividual Book Fines:\n";
@@ -1182,10 +8278,10 @@ int main() {
                             int secondsOverdue = currentDate - book.second;
                             int daysOverdue = secondsOverdue / (24 * 60 * 60);
                             
-                            auto bookIt = books.find(book.first);
-                            if (bookIt != books.end()) {
-                                cout << "\nBook: " << bookIt->second.getTitle() << "\n";
-                                cout << "ISBN: " << book.first << "\n";
+                            Book details;
+                            if (books->find(book.first, details)) {
+                                cout << "\nBook: " << details.getTitle() << "\n";
+                                cout << "ISBN: " << unpackIsbn(book.first) << "\n";
                                 
                                 // Convert due date to human-readable format
                                 time_t dueTime = book.second;
@@ -1196,10 +8292,10 @@ int main() {
                                 
                                 if (daysOverdue > 0) {
                                     hasOverdueBooks = true;
-                                    double bookFine = daysOverdue * 10.0; // 10 rupees per day
+                                    Paise bookFine = daysOverdue * FINE_PER_DAY;
                                     cout << "Days Overdue: " << daysOverdue << "\n";
                                     cout << "Fine Rate: 10 rupees per day\n";
-                                    cout << "Fine Amount: " << bookFine << " rupees\n";
+                                    cout << "Fine Amount: " << formatRupees(bookFine) << " rupees\n";
                                 } else {
                                     cout << "Status: On time (No fine)\n";
                                 }
@@ -1219,12 +8315,12 @@ int main() {
                             cout << "No borrowing history.\n";
                         } else {
                             for (const auto& item : history) {
-                                auto bookIt = books.find(item.first);
-                                if (bookIt != books.end()) {
+                                Book details;
+                                if (books->find(packIsbn(item.first), details)) {
                                     cout << "\nBook Details:\n";
                                     cout << "ISBN: " << item.first << "\n";
-                                    cout << "Title: " << bookIt->second.getTitle() << "\n";
-                                    cout << "Author: " << bookIt->second.getAuthor() << "\n";
+                                    cout << "Title: " << details.getTitle() << "\n";
+                                    cout << "Author: " << details.getAuthor() << "\n";
                                     
                                     // Convert return date to human-readable format
                                     time_t returnTime = item.second;
@@ -1240,11 +8336,10 @@ int main() {
                     break;
                 case 6: // Pay Fine (Student) or View Account Details (Faculty)
                     if (dynamic_cast<Student*>(currentUser)) {
-                        double amount;
                         cout << "\n=== Pay Fine ===\n";
-                        cout << "Current fine amount: " << currentUser->getAccount().getTotalFine() << " rupees\n";
+                        cout << "Current fine amount: " << formatRupees(currentUser->getAccount().getTotalFine()) << " rupees\n";
                         cout << "Enter amount to pay: ";
-                        cin >> amount;
+                        Paise amount = readRupees(cin);
                         
                         if (currentUser->getAccount().payFine(amount, currentDate)) {
                             cout << "Fine paid successfully.\n";
@@ -1267,7 +8362,9 @@ int main() {
                 }
                 break;
                 default:
-                    cout << "Invalid choice!\n";
+                    if (!dynamic_cast<Librarian*>(currentUser)) {
+                        cout << "Invalid choice!\n";
+                    }
             }
 
             // Handle Librarian-specific menu options
@@ -1329,12 +8426,12 @@ int main() {
                             
                             // Get and validate ISBN
                             do {
-                                cout << "Enter ISBN (non-empty): ";
+                                cout << "Enter ISBN (ISBN-10 or ISBN-13, hyphens allowed): ";
                                 getline(cin, isbn);
-                                if (isbn.empty()) {
-                                    cout << "ISBN cannot be empty.\n";
+                                if (!isValidIsbn(isbn)) {
+                                    cout << "Invalid ISBN. Check the digits and the check digit.\n";
                                 }
-                            } while (isbn.empty());
+                            } while (!isValidIsbn(isbn) && cin);
                             
                             // Get and validate title
                             do {
@@ -1394,7 +8491,7 @@ int main() {
                             cout << "Enter ISBN to update: ";
                             getline(cin, isbn);
                             
-                            if (books.find(isbn) == books.end()) {
+                            if (!books->contains(packIsbn(isbn))) {
                                 cout << "Book not found!\n";
                                 break;
                             }
@@ -1444,6 +8541,255 @@ int main() {
                         break;
                     case 8: // Exit
                         break;
+                    case 10: // Restore Data to a Point in Time
+                        {
+                            int targetTime;
+                            cout << "\n=== Point-in-Time Restore ===\n";
+                            cout << "Enter time to restore to (seconds from epoch): ";
+                            if (!(cin >> targetTime)) {
+                                cout << "Invalid input. Please enter a number.\n";
+                                cin.clear();
+                                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                                break;
+                            }
+                            if (opLog.restoreTo(targetTime)) {
+                                library.saveAllData();
+                                // The restore rebuilt every User object, so look the session user up again
+                                auto it = users.find(currentUserId);
+                                if (it == users.end()) {
+                                    cout << "Your user did not exist at that time. Logging out.\n";
+                                    loggedOut = true;
+                                } else {
+                                    currentUser = it->second;
+                                }
+                            }
+                        }
+                        break;
+                    case 11: // Search Sister Branches
+                        {
+                            string query;
+                            cin.ignore();
+                            cout << "\n=== Search Sister Branches ===\n";
+                            if (!federation.isConfigured()) {
+                                cout << "No sister branches configured (see branches.txt).\n";
+                                break;
+                            }
+                            cout << "Enter ISBN or part of the title: ";
+                            getline(cin, query);
+                            federation.displaySearch(query);
+                        }
+                        break;
+                    case 12: // Request Inter-Branch Transfer
+                        {
+                            string branchName, isbn, patronId;
+                            cin.ignore();
+                            cout << "\n=== Request Inter-Branch Transfer ===\n";
+                            if (!federation.isConfigured()) {
+                                cout << "No sister branches configured (see branches.txt).\n";
+                                break;
+                            }
+                            cout << "Enter branch name: ";
+                            getline(cin, branchName);
+                            cout << "Enter ISBN: ";
+                            getline(cin, isbn);
+                            cout << "Enter requesting user ID: ";
+                            getline(cin, patronId);
+                            federation.requestTransfer(branchName, isbn, patronId);
+                        }
+                        break;
+                    case 13: // View Incoming Transfer Requests
+                        federation.displayIncomingTransfers();
+                        break;
+                    case 16: // Generate Due-Soon Reminders
+                        {
+                            auto start = chrono::steady_clock::now();
+                            size_t reminded = generateDueReminders(currentDate, 48, "reminders");
+                            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+                            cout << "\nReminders written for " << reminded << " patrons with books due in the next 48 hours"
+                                 << " (in " << elapsed.count() << " ms, see the reminders directory).\n";
+                        }
+                        break;
+                    case 22: // Find Duplicate Books
+                        {
+                            auto version = versions.read();
+                            DuplicateFinder::Report report = DuplicateFinder::run(*version);
+                            DuplicateFinder::print(report, *version);
+                            if (!report.proposals.empty() && DuplicateFinder::write(report, *version, "duplicates.jsonl")) {
+                                cout << "All proposals written to duplicates.jsonl.\n";
+                            }
+                        }
+                        break;
+                    case 21: // Circulation Statistics
+                        {
+                            int view;
+                            cout << "\n=== Circulation Statistics ===\n"
+                                 << "1. By role\n2. By user\n3. By title\n4. Most borrowed titles\n"
+                                 << "Enter your choice: ";
+                            if (!(cin >> view)) {
+                                cout << "Invalid input.\n";
+                                cin.clear();
+                                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                                break;
+                            }
+                            if (view == 1) {
+                                cout << "\nStudents\n";
+                                CirculationStats::print(circulation.forRole(false));
+                                cout << "\nFaculty\n";
+                                CirculationStats::print(circulation.forRole(true));
+                            } else if (view == 2) {
+                                string userId;
+                                cout << "Enter user ID: ";
+                                cin >> userId;
+                                const CirculationTotals* totals = circulation.forUser(userId);
+                                if (totals) {
+                                    cout << "\nUser " << userId << "\n";
+                                    CirculationStats::print(*totals);
+                                } else {
+                                    cout << "No loans recorded for this user.\n";
+                                }
+                            } else if (view == 3) {
+                                string isbn;
+                                cout << "Enter ISBN: ";
+                                cin >> isbn;
+                                isbn = canonicalIsbn(isbn);
+                                const CirculationTotals* totals = circulation.forTitle(packIsbn(isbn));
+                                if (totals) {
+                                    Book details;
+                                    cout << "\n" << (books->find(packIsbn(isbn), details) ? details.getTitle() : isbn)
+                                         << " (ISBN: " << isbn << ")\n";
+                                    CirculationStats::print(*totals);
+                                } else {
+                                    cout << "No loans recorded for this title.\n";
+                                }
+                            } else if (view == 4) {
+                                cout << "\n";
+                                for (const auto& title : circulation.mostBorrowed(10)) {
+                                    Book details;
+                                    bool known = books->find(title.first, details);
+                                    cout << (known ? details.getTitle() : unpackIsbn(title.first))
+                                         << " (ISBN: " << unpackIsbn(title.first) << ") - "
+                                         << title.second->borrows << " borrows\n";
+                                }
+                            } else {
+                                cout << "Invalid choice!\n";
+                            }
+                        }
+                        break;
+                    case 20: // Refresh Catalogue
+                        {
+                            CatalogueRefresher::Report report;
+                            if (catalogueRefresh.refreshNow(report)) {
+                                library.saveAllData();
+                                CatalogueRefresher::print(report);
+                            } else {
+                                cout << "\nbooks.txt has not changed since it was last read or saved.\n";
+                            }
+                        }
+                        break;
+                    case 19: // Check Data Consistency
+                        {
+                            int repair;
+                            cout << "\n=== Check Data Consistency ===\n";
+                            cout << "Repair what can be repaired? (1 for yes, 0 for no): ";
+                            if (!(cin >> repair)) {
+                                cout << "Invalid input. Please enter 1 or 0.\n";
+                                cin.clear();
+                                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                                break;
+                            }
+
+                            auto start = chrono::steady_clock::now();
+                            ConsistencyChecker::Report report = ConsistencyChecker::check(repair == 1);
+                            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+                            if (repair == 1) library.saveAllData();
+                            ConsistencyChecker::print(report);
+                            cout << "Check took " << elapsed.count() << " ms\n";
+                        }
+                        break;
+                    case 18: // Semester Rollover
+                        {
+                            string rosterPath;
+                            cin.ignore();
+                            cout << "\n=== Semester Rollover ===\n";
+                            cout << "Enter roster file (id,name,password,role per line): ";
+                            getline(cin, rosterPath);
+
+                            auto start = chrono::steady_clock::now();
+                            SemesterRollover::Report report;
+                            if (SemesterRollover::run(rosterPath, report)) {
+                                chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+                                library.saveAllData();
+                                SemesterRollover::print(report);
+                                cout << "Rollover took " << elapsed.count() << " ms\n";
+                            }
+                        }
+                        break;
+                    case 17: // Export Circulation Data for Analysis
+                        {
+                            auto start = chrono::steady_clock::now();
+                            long long rows = ColumnarExporter::exportTo("export");
+                            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+                            if (rows >= 0) {
+                                cout << "\nExported " << rows << " history and loan rows to the export directory"
+                                     << " (in " << elapsed.count() << " ms).\n";
+                            }
+                        }
+                        break;
+                    case 15: // Fuzzy Search
+                        {
+                            string query;
+                            cin.ignore();
+                            cout << "\n=== Fuzzy Search ===\n";
+                            cout << "Enter title, author or user name (typos allowed): ";
+                            getline(cin, query);
+
+                            auto start = chrono::steady_clock::now();
+                            ensureFuzzyIndex();
+                            auto matches = fuzzyIndex.search(query);
+                            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+                            if (matches.empty()) {
+                                cout << "No close matches found.\n";
+                            }
+                            for (const auto& match : matches) {
+                                if (match.kind == FuzzyIndex::USER_NAME) {
+                                    cout << "[User] " << match.text << " (ID: " << match.id << ")";
+                                } else {
+                                    cout << (match.kind == FuzzyIndex::TITLE ? "[Title] " : "[Author] ")
+                                         << match.text << " (ISBN: " << match.id << ")";
+                                }
+                                cout << " - " << match.distance << " edit(s)\n";
+                            }
+                            cout << "Search took " << elapsed.count() << " ms\n";
+                        }
+                        break;
+                    case 14: // Outstanding Fines Report
+                        {
+                            // Bring every account's fines up to date (O(1) for unchanged accounts)
+                            for (const auto& p : accounts) {
+                                p.second.updateFines(currentDate);
+                            }
+                            library.saveAllData();
+
+                            // The report reads the version just committed
+                            auto version = versions.read();
+                            auto start = chrono::steady_clock::now();
+                            Paise outstanding = version->ledger.outstandingTotal();
+                            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+                            cout << "\n=== Outstanding Fines Report ===\n";
+                            int accountsWithFines = 0;
+                            version->accounts.forEach([&](const string& id, const shared_ptr<const Account>& account) {
+                                if (account->getTotalFine() > 0) {
+                                    cout << "User " << id << ": " << formatRupees(account->getTotalFine()) << " rupees\n";
+                                    accountsWithFines++;
+                                }
+                            });
+                            cout << "Accounts with fines: " << accountsWithFines << "\n";
+                            cout << "Total outstanding: " << formatRupees(outstanding) << " rupees"
+                                 << " (summed in " << elapsed.count() << " ms)\n";
+                        }
+                        break;
                     default:
                         cout << "Invalid choice!\n";
                 }
@@ -1455,12 +8801,16 @@ int main() {
                 cout << "\nChanges saved successfully.\n";
             }
 
-        } while (choice != (dynamic_cast<Librarian*>(currentUser) ? 8 : 
+        } while (!loggedOut && choice != (dynamic_cast<Librarian*>(currentUser) ? 8 : 
                           dynamic_cast<Faculty*>(currentUser) ? 7 : 8));
 
         // Save data before user logs out
         library.saveAllData();
         cout << "\nLogging out. All data saved.\n";
+        if (cin.eof()) {
+            persistence.flush();
+            return 0;
+        }
     }
 
     return 0;